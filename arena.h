@@ -0,0 +1,217 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <sys/mman.h>
+
+// ---- Buffer Pool ----
+// Large blocks mapped straight from the system and, once freed, kept for the
+// next file instead of being unmapped. A file's buffers (samples, pyramids,
+// page cache, decode blocks) are a handful of large allocations whose sizes
+// recur from one file to the next. Through malloc, those below glibc's mmap
+// threshold (which it raises as large blocks are freed, up to 32 MB) come
+// from the heap, which then fragments, and the process grows file after
+// file. Here the next file takes the same blocks back and the resident size
+// settles.
+//
+// Blocks come in power-of-two size classes from minimumBytes up; the pages
+// of a block that are never touched cost address space only. At most
+// retainLimit() bytes of free blocks are kept, the rest is unmapped at once.
+class BufferPool {
+public:
+    static constexpr size_t minimumBytes = size_t(64) << 10;
+
+    BufferPool() = default;
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // A block of at least bytes, page aligned; its size class goes to
+    // capacity, to be passed back to release(). Throws std::bad_alloc.
+    void* acquire(size_t bytes, size_t& capacity) {
+        size_t index = classOf(bytes);
+        capacity = minimumBytes << index;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (index < free.size() && !free[index].empty()) {
+                void* block = free[index].back();
+                free[index].pop_back();
+                retained -= capacity;
+                return block;
+            }
+        }
+
+        void* block = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (block == MAP_FAILED) throw std::bad_alloc();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        mapped += capacity;
+        return block;
+    }
+
+    void release(void* block, size_t capacity) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (retained + capacity <= limit) {
+                size_t index = classOf(capacity);
+                if (index >= free.size()) free.resize(index + 1);
+                free[index].push_back(block);
+                retained += capacity;
+                return;
+            }
+
+            mapped -= capacity;
+        }
+
+        ::munmap(block, capacity);
+    }
+
+    // Free blocks beyond bytes are unmapped.
+    void setRetainLimit(size_t bytes) {
+        std::vector<std::pair<void*, size_t>> unmap;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            limit = bytes;
+
+            // Largest first: they are the least likely to fit the next file.
+            for (size_t index = free.size(); index-- > 0 && retained > limit; ) {
+                size_t capacity = minimumBytes << index;
+
+                while (!free[index].empty() && retained > limit) {
+                    unmap.emplace_back(free[index].back(), capacity);
+                    free[index].pop_back();
+                    retained -= capacity;
+                    mapped -= capacity;
+                }
+            }
+        }
+
+        for (const auto& block : unmap) ::munmap(block.first, block.second);
+    }
+
+    size_t retainLimit() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return limit;
+    }
+
+    // Mapped in total (in use or free), and free of that.
+    size_t mappedBytes() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return mapped;
+    }
+
+    size_t retainedBytes() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return retained;
+    }
+
+private:
+    static size_t classOf(size_t bytes) {
+        size_t index = 0;
+        while ((minimumBytes << index) < bytes) ++index;
+        return index;
+    }
+
+    mutable std::mutex mutex;
+    // Free blocks by size class.
+    std::vector<std::vector<void*>> free;
+    size_t retained = 0;
+    size_t mapped = 0;
+    size_t limit = size_t(256) << 20;
+};
+
+// The process-wide pool.
+inline BufferPool& bufferPool() {
+    static BufferPool pool;
+    return pool;
+}
+
+// ---- Arena ----
+// The memory of one file's buffers, taken from bufferPool() and handed back in
+// one go when the arena is destroyed. Everything carved from it shares the
+// file's lifetime: the arena is held through a shared_ptr by the objects
+// using it (PeakPyramid::reserve(), SampleBuffer, PagedSampleSource), so it
+// goes once the last of them does.
+//
+// Allocations are bumped from chunks of chunkBytes; larger ones get a block
+// of their own. Nothing is freed individually and nothing is constructed or
+// destroyed, so only trivially destructible types go in.
+class Arena {
+public:
+    static constexpr size_t chunkBytes = size_t(1) << 20;
+    // Every allocation starts on a cache line.
+    static constexpr size_t alignment = 64;
+
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena() {
+        for (const Block& block : blocks) {
+            bufferPool().release(block.data, block.capacity);
+        }
+    }
+
+    // count uninitialised Ts.
+    template <typename T>
+    T* allocate(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena storage is never destroyed");
+        static_assert(alignof(T) <= alignment, "Arena storage is only cache line aligned");
+        return static_cast<T*>(allocateBytes(count * sizeof(T)));
+    }
+
+    void* allocateBytes(size_t bytes) {
+        bytes = std::max((bytes + alignment - 1) / alignment * alignment, alignment);
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // Too large to share a chunk: own block, used from the start, which
+        // leaves the current chunk open for the small ones.
+        if (bytes > chunkBytes / 4) {
+            Block block;
+            block.data = static_cast<char*>(bufferPool().acquire(bytes, block.capacity));
+            block.used = bytes;
+            blocks.insert(blocks.begin(), block);
+            used += bytes;
+            return block.data;
+        }
+
+        if (blocks.empty() || blocks.back().capacity - blocks.back().used < bytes) {
+            Block block;
+            block.data = static_cast<char*>(bufferPool().acquire(chunkBytes, block.capacity));
+            blocks.push_back(block);
+        }
+
+        Block& chunk = blocks.back();
+        void* out = chunk.data + chunk.used;
+        chunk.used += bytes;
+        used += bytes;
+        return out;
+    }
+
+    // Bytes handed out so far.
+    size_t bytesUsed() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return used;
+    }
+
+private:
+    struct Block {
+        char* data = nullptr;
+        size_t capacity = 0;
+        size_t used = 0;
+    };
+
+    mutable std::mutex mutex;
+    // Own blocks first, the chunk in use last.
+    std::vector<Block> blocks;
+    size_t used = 0;
+};
@@ -0,0 +1,402 @@
+#include "audio.h"
+#include "instrumentation.h"
+#include <cmath>
+#include <cctype>
+#include <limits>
+
+bool parseBackend(const std::string& name, ma_backend& backend)
+{
+    auto normalize = [](const std::string& text) {
+        std::string result;
+        for (char c : text) {
+            if (c != ' ') result += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        return result;
+    };
+
+    for (int b = 0; b <= ma_backend_null; ++b) {
+        if (normalize(ma_get_backend_name(static_cast<ma_backend>(b))) == normalize(name)) {
+            backend = static_cast<ma_backend>(b);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool initBackendContext(const std::string& name, ma_context& context)
+{
+    ma_backend backend;
+
+    if (!parseBackend(name, backend)) {
+        std::cerr << "Unknown audio backend: " << name << "\n";
+        return false;
+    }
+
+    if (ma_context_init(&backend, 1, nullptr, &context) != MA_SUCCESS) {
+        std::cerr << "Audio backend unavailable: " << name << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+void Audio::configure(std::shared_ptr<const SampleSource> source, int rate, unsigned outputRate)
+{
+    // Share the samples, no copy.
+    samples = std::move(source);
+    totalSamples = static_cast<int64_t>(samples->frames());
+    zip = zipKernel().run;
+    sampleRate = rate > 0 ? rate : 44100;
+
+    // Convert only if the output doesn't run at the file's rate.
+    resampling = outputRate != static_cast<unsigned>(sampleRate);
+    size_t scratchFrames = 4096;
+
+    if (resampling) {
+        resampler.configure(sampleRate, outputRate, options.quality);
+        // Output frames whose input fits the scratch buffers.
+        size_t outputFrames = static_cast<size_t>((scratchFrames - 1) / resampler.ratio()) + 1;
+        scratchFrames += resampler.length() + 1;
+        resampledLeft.resize(outputFrames);
+        resampledRight.resize(outputFrames);
+    }
+
+    scratchLeft.resize(scratchFrames);
+    scratchRight.resize(scratchFrames);
+
+    outputStep = resampling ? resampler.ratio() : 1.0;
+    crossfadeFrames = std::max(static_cast<int>(outputRate * crossfadeSeconds), 1);
+    scrubGrainFrames = std::max(static_cast<int>(outputRate * scrubGrainSeconds), 1);
+    fadeScratch.assign(static_cast<size_t>(crossfadeFrames) * 2, 0.0f);
+    fadeRemaining = 0;
+    meter.configure(outputRate);
+}
+
+void Audio::render(float* out, int frameCount)
+{
+    int64_t now = clockNow();
+    applyCommands();
+
+    // Paged sources load what follows in the background.
+    if (running) samples->prefetch(position);
+
+    int done = 0;
+
+    while (done < frameCount) {
+        float* span = out + done * 2;
+        int count = frameCount - done;
+
+        if (!running) {
+            // Stopped during a fade: the old head finishes fading out.
+            if (fadeRemaining == 0 || !fadeToSilence) break;
+
+            count = std::min(count, fadeRemaining);
+            std::fill(span, span + count * 2, 0.0f);
+            mixFade(span, count);
+            done += count;
+            continue;
+        }
+
+        int64_t end = looping ? std::min(loopEnd, totalSamples) : totalSamples;
+
+        if (position >= end) {
+            // Wrap around the loop region, or stop at the end of the file.
+            if (!looping || loopStart >= end) break;
+
+            // Keep what went past the end so the period stays exact (the
+            // resampler steps over it by a fraction of a frame).
+            int64_t length = end - loopStart;
+            int64_t over = position - end;
+            int fade = static_cast<int>(std::min<double>(crossfadeFrames, length / outputStep / 2));
+            jump(over < length ? loopStart + over : loopStart, fraction, fade);
+            continue;
+        }
+
+        if (scrubbing && scrubRemaining == 0) {
+            // The pointer held still for a whole grain.
+            fadeOut();
+            continue;
+        }
+
+        // Spans end where a fade or a scrub grain does, so neither needs a
+        // test per frame.
+        if (fadeRemaining > 0) count = std::min(count, fadeRemaining);
+        if (scrubbing) count = std::min(count, scrubRemaining);
+
+        int rendered = renderHead(span, count, end);
+        if (fadeRemaining > 0) mixFade(span, rendered);
+        if (scrubbing) scrubRemaining -= rendered;
+        done += rendered;
+    }
+
+    // Fill remaining frames with silence
+    std::fill(out + done * 2, out + frameCount * 2, 0.0f);
+
+    // Ramp to a new gain over the buffer rather than stepping (no clicks).
+    if (gain != 1.0f || targetGain != 1.0f) {
+        float step = (targetGain - gain) / std::max(frameCount, 1);
+
+        for (int i = 0; i < frameCount; ++i) {
+            float g = gain + step * (i + 1);
+            out[i * 2] *= g;
+            out[i * 2 + 1] *= g;
+        }
+
+        gain = targetGain;
+    }
+
+    publish(done > 0 ? now : 0);
+}
+
+int64_t Audio::heardSample() const
+{
+    int64_t sample = currentSample();
+
+    // Nothing is buffered while stopped, and a pending seek is shown at its target.
+    if (!deviceRunning || appliedSerial.load(std::memory_order_acquire) != seekSerial) return sample;
+
+    int64_t position, start, time;
+    unsigned before, after;
+
+    do {
+        before = playheadSequence.load(std::memory_order_acquire);
+        position = playbackSampleIndex.load(std::memory_order_relaxed);
+        start = playheadOrigin.load(std::memory_order_relaxed);
+        time = playheadTime.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = playheadSequence.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+
+    // The last rendered frame reaches the speakers latencyFrames after it was
+    // handed over; nothing later than it can have been heard yet.
+    double elapsed = time ? (clockNow() - time) * 1e-9 : 0.0;
+    int64_t heard = position - latencyFrames + static_cast<int64_t>(elapsed * sampleRate);
+
+    return std::clamp(heard, std::min(start, position), position);
+}
+
+// Moves the read head to target. With fadeFrames > 0 the old head (or
+// silence when stopped) fades out over that many output frames.
+void Audio::jump(int64_t target, double targetFraction, int fadeFrames)
+{
+    if (fadeFrames > 0) {
+        fadeFromSilence = !running;
+        fadeToSilence = false;
+        fadePosition = position;
+        fadeFraction = fraction;
+        fadeLength = fadeFrames;
+        fadeRemaining = fadeFrames;
+    }
+
+    position = target;
+    fraction = targetFraction;
+    origin = target;
+}
+
+// Stops playback, letting the current head fade out.
+void Audio::fadeOut()
+{
+    if (running && crossfadeFrames > 0) {
+        fadeFromSilence = false;
+        fadeToSilence = true;
+        fadePosition = position;
+        fadeFraction = fraction;
+        fadeLength = crossfadeFrames;
+        fadeRemaining = crossfadeFrames;
+    }
+
+    running = false;
+}
+
+// Blends the old head into the count frames of out just rendered by the new
+// one. count must not exceed fadeRemaining.
+void Audio::mixFade(float* out, int count)
+{
+    float* old = fadeScratch.data();
+
+    if (fadeFromSilence) {
+        std::fill(old, old + count * 2, 0.0f);
+    }
+    else {
+        // The old head plays on, past loop ends and the end of the file (silence).
+        std::swap(position, fadePosition);
+        std::swap(fraction, fadeFraction);
+        renderHead(old, count, std::numeric_limits<int64_t>::max() / 2);
+        std::swap(position, fadePosition);
+        std::swap(fraction, fadeFraction);
+    }
+
+    float step = 1.0f / fadeLength;
+    float weight = (fadeLength - fadeRemaining) * step;
+
+    for (int i = 0; i < count; ++i) {
+        weight += step;
+        out[i * 2] = out[i * 2] * weight + old[i * 2] * (1.0f - weight);
+        out[i * 2 + 1] = out[i * 2 + 1] * weight + old[i * 2 + 1] * (1.0f - weight);
+    }
+
+    fadeRemaining -= count;
+}
+
+// Up to count frames from the read head, stopping before end. Advances it;
+// returns the frames written.
+int Audio::renderHead(float* out, int count, int64_t end)
+{
+    if (resampling) return resampleFrames(out, count, end);
+
+    count = static_cast<int>(std::min<int64_t>(count, end - position));
+    copyFrames(out, position, count);
+    position += count;
+
+    return count;
+}
+
+// Interleaved stereo frames [start, start + count), in chunks that fit the
+// scratch buffers. Files with more channels play their first two. Frames
+// outside the file are silent.
+void Audio::copyFrames(float* out, int64_t start, int count)
+{
+    const SampleSource& source = *samples;
+    // Mono files play their single channel on both sides.
+    size_t rightChannel = source.isStereo() ? 1 : 0;
+    int chunkFrames = static_cast<int>(scratchLeft.size());
+
+    for (int done = 0; done < count; ) {
+        int chunk = std::min(count - done, chunkFrames);
+        const float* left = fetchPadded(0, start + done, chunk, scratchLeft.data());
+        const float* right = fetchPadded(rightChannel, start + done, chunk, scratchRight.data());
+        zip(left, right, out + done * 2, chunk);
+        done += chunk;
+    }
+}
+
+// Up to count interleaved frames converted to the device rate, stopping at the
+// last one that falls before end. Advances position; returns the frames written.
+int Audio::resampleFrames(float* out, int count, int64_t end)
+{
+    double step = resampler.ratio();
+    double available = std::ceil((end - position - fraction) / step);
+    count = static_cast<int>(std::min<double>(count, available));
+
+    size_t rightChannel = samples->isStereo() ? 1 : 0;
+    int inputFrames = static_cast<int>(scratchLeft.size());
+    int chunkFrames = static_cast<int>(resampledLeft.size());
+
+    for (int done = 0; done < count; ) {
+        int chunk = std::min(count - done, chunkFrames);
+        // Input around every output of the chunk, starting before() frames
+        // ahead of position.
+        int64_t first = position - resampler.before();
+        int needed = std::min(static_cast<int>(fraction + (chunk - 1) * step) + resampler.length() + 1, inputFrames);
+        double time = fraction + resampler.before();
+
+        const float* left = fetchPadded(0, first, needed, scratchLeft.data());
+        resampler.process(left, time, resampledLeft.data(), chunk);
+
+        if (rightChannel != 0) {
+            const float* right = fetchPadded(rightChannel, first, needed, scratchRight.data());
+            resampler.process(right, time, resampledRight.data(), chunk);
+            zip(resampledLeft.data(), resampledRight.data(), out + done * 2, chunk);
+        }
+        else {
+            zip(resampledLeft.data(), resampledLeft.data(), out + done * 2, chunk);
+        }
+
+        double next = fraction + chunk * step;
+        int whole = static_cast<int>(next);
+        position += whole;
+        fraction = next - whole;
+        done += chunk;
+    }
+
+    return count;
+}
+
+// count frames from first, which may reach outside the file; those read as silence.
+const float* Audio::fetchPadded(size_t channel, int64_t first, int count, float* scratch) const
+{
+    int64_t begin = std::max<int64_t>(first, 0);
+    int64_t end = std::min(first + count, totalSamples);
+
+    if (begin == first && end == first + count) {
+        return samples->tryFetch(channel, first, count, scratch);
+    }
+
+    std::fill(scratch, scratch + count, 0.0f);
+
+    if (end > begin) {
+        samples->tryRead(channel, begin, end - begin, scratch + (begin - first));
+    }
+
+    return scratch;
+}
+
+void audio_data_callback(ma_device* pDevice, void* output, const void*, ma_uint32 frameCount)
+{
+    auto* self = static_cast<Audio*>(pDevice->pUserData);
+    uint64_t start = Instrumentation::now();
+
+    self->render(static_cast<float*>(output), static_cast<int>(frameCount));
+    self->meter.process(static_cast<const float*>(output), static_cast<int>(frameCount));
+
+    uint64_t end = Instrumentation::now();
+    // The buffer has to be filled within its own duration.
+    uint64_t budget = static_cast<uint64_t>(frameCount) * 1000000000ull / std::max<ma_uint32>(pDevice->sampleRate, 1);
+    instrumentation().record(Probe::Callback, start, end, budget);
+
+    // Late, or more than two buffers went by since the last call: the device ran dry.
+    if (end - start > budget || (self->lastCallback > 0 && start - self->lastCallback > 2 * self->lastBudget)) {
+        instrumentation().underrun();
+    }
+
+    self->lastCallback = start;
+    self->lastBudget = budget;
+}
+
+
+bool Audio::init(std::shared_ptr<const SampleSource> source, int rate)
+{
+    ma_device_config config = ma_device_config_init(ma_device_type_playback);
+    config.playback.format = ma_format_f32;
+    config.playback.channels = 2;
+    config.playback.shareMode = options.shareMode;
+    config.sampleRate = options.sampleRate;
+    config.periodSizeInFrames = options.periodSizeInFrames;
+    config.periods = options.periods;
+    // render() takes any frame count, so skip miniaudio's extra buffer
+    // (and its period of latency) that would fix the callback size.
+    config.noFixedSizedCallback = MA_TRUE;
+    config.dataCallback = audio_data_callback;
+    config.pUserData = this;
+
+    if (!options.backend.empty()) {
+        if (!initBackendContext(options.backend, context)) return false;
+
+        hasContext = true;
+    }
+
+    ready = ma_device_init(hasContext ? &context : nullptr, &config, &device) == MA_SUCCESS;
+
+    if (!ready) return false;
+
+    configure(std::move(source), rate, device.sampleRate);
+
+    if (resampling) {
+        std::cout << "Audio: resampling " << sampleRate << " Hz to " << device.sampleRate
+                  << " Hz (" << resampleQualityName(options.quality) << ", " << resampler.length() << " taps)\n";
+    }
+
+    // What the backend actually granted, which may differ from the request.
+    const auto& granted = device.playback;
+    double framesPerInternal = static_cast<double>(device.sampleRate) / std::max<ma_uint32>(granted.internalSampleRate, 1);
+    double deviceLatency = granted.internalPeriodSizeInFrames * granted.internalPeriods * framesPerInternal;
+    double latencyMs = device.sampleRate ? 1000.0 * deviceLatency / device.sampleRate : 0.0;
+    latencyFrames = static_cast<int64_t>(latencyMs * sampleRate / 1000.0);
+
+    std::cout << "Audio: " << ma_get_backend_name(device.pContext->backend)
+              << ", " << granted.internalPeriods << " x " << granted.internalPeriodSizeInFrames << " frames at "
+              << granted.internalSampleRate << " Hz, " << latencyMs << " ms output latency\n";
+
+    return true;
+}
@@ -0,0 +1,350 @@
+#pragma once
+
+#include "../libraries/miniaudio.h"
+#include "kernels.h"
+#include "resampler.h"
+#include "sample_source.h"
+#include "spsc_queue.h"
+#include "levels.h"
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+#include <cstdint>
+
+// ---- Audio Commands ----
+// Everything the UI thread asks of the playback engine. They travel through a
+// wait-free ring and the audio callback applies them at the start of a buffer,
+// so the engine state is only ever touched by one thread at a time.
+struct AudioCommand {
+    enum Type { Seek, Start, Stop, LoopRegion, Gain, Scrub, ScrubEnd };
+
+    Type type = Seek;
+    // Seek or scrub target, or loop start.
+    int64_t position = 0;
+    // Loop end (exclusive); a loop region with end <= position clears the loop.
+    int64_t end = 0;
+    float gain = 1.0f;
+    // Seeks are numbered so currentSample() knows when one has been applied.
+    unsigned serial = 0;
+};
+
+// ---- Device Options ----
+// How the playback device is opened. Zero / empty fields leave the choice to
+// miniaudio.
+struct AudioDeviceOptions {
+    // Frames per callback.
+    ma_uint32 periodSizeInFrames = 0;
+    // Number of periods the device buffers.
+    ma_uint32 periods = 0;
+    ma_share_mode shareMode = ma_share_mode_shared;
+    // Device rate; 0 opens the device at its own rate, so conversion (if the
+    // file differs) happens in our resampler rather than in the OS mixer.
+    ma_uint32 sampleRate = 0;
+    ResampleQuality quality = ResampleQuality::Sinc;
+    // Backend name as listed by ma_get_backend_name(), e.g. "alsa" or "jack".
+    std::string backend;
+};
+
+// Case and space insensitive, so "pulseaudio" matches "PulseAudio" and "coreaudio" "Core Audio".
+bool parseBackend(const std::string& name, ma_backend& backend);
+
+// A context for the backend called name, reporting why not on std::cerr.
+bool initBackendContext(const std::string& name, ma_context& context);
+
+// ---- Audio Class ----
+class Audio {
+public:
+    // The file's samples, shared with the waveform view.
+    std::shared_ptr<const SampleSource> samples;
+    // Conversion space for sources without float channels (see SampleSource::fetch()).
+    std::vector<float> scratchLeft;
+    std::vector<float> scratchRight;
+    int64_t totalSamples = 0;
+    // The file's rate. Positions count file frames.
+    int sampleRate = 44100;
+    ma_device device;
+    AudioDeviceOptions options;
+    // File frames between the callback and the speakers, known once the device is open.
+    int64_t latencyFrames = 0;
+    // Set once init() has opened the device.
+    bool ready = false;
+    // Start and buffer duration (ns) of the last callback, for underrun
+    // detection. Audio thread, or the UI thread while stopped.
+    uint64_t lastCallback = 0;
+    uint64_t lastBudget = 0;
+    // Levels of the output, fed by audio_data_callback; read() from any thread.
+    LevelMeter meter;
+
+    // Opens the device and configures playback for it.
+    bool init(std::shared_ptr<const SampleSource> source, int rate);
+
+    // Prepares playback of source (at rate) into outputRate frames without a
+    // device. Headless callers (the benchmarks) then drive render() themselves.
+    void configure(std::shared_ptr<const SampleSource> source, int rate, unsigned outputRate);
+
+    // UI thread.
+
+    void start() {
+        send({ AudioCommand::Start });
+        startDevice();
+    }
+
+    // Starts the engine without the device, for render() called directly.
+    void startHeadless() {
+        send({ AudioCommand::Start });
+    }
+
+    void stop() {
+        send({ AudioCommand::Stop });
+        ma_device_stop(&device);
+        deviceRunning = false;
+        // The callback is idle now and may not have seen the last commands.
+        applyCommands();
+        publish();
+        meter.reset();
+    }
+
+    void seek(int64_t sample) {
+        AudioCommand command{ AudioCommand::Seek, sample };
+        command.serial = ++seekSerial;
+        seekTarget = sample;
+        send(command);
+
+        // Start loading paged samples before the callback gets there.
+        if (samples) samples->prefetch(static_cast<size_t>(std::max<int64_t>(sample, 0)));
+    }
+
+    void setLoopRegion(int64_t start, int64_t end) {
+        send({ AudioCommand::LoopRegion, start, end });
+    }
+
+    void setGain(float gain) {
+        AudioCommand command{ AudioCommand::Gain };
+        command.gain = gain;
+        send(command);
+    }
+
+    // Plays a short grain from sample, crossfading from whatever was playing.
+    // Called for every move of a drag; holding still fades out to silence.
+    // Starts the device if needed, which then keeps running (silent) until
+    // stop(); a scrub that doesn't resume playback stops it once settled (see
+    // scrubSettleSeconds()).
+    void scrub(int64_t sample) {
+        send({ AudioCommand::Scrub, sample });
+        startDevice();
+    }
+
+    // The drag is over: playback resumes from sample if it was running before
+    // the scrub, otherwise it fades out and rests there.
+    void endScrub(int64_t sample) {
+        send({ AudioCommand::ScrubEnd, sample });
+    }
+
+    // Seconds from endScrub() until its fade out has been heard: a period or
+    // so for the callback to pick it up, then the device buffering.
+    double scrubSettleSeconds() const {
+        return crossfadeSeconds + 2.0 * latencyFrames / std::max(sampleRate, 1);
+    }
+
+    // Position last published by the callback, or the target of a seek it
+    // hasn't applied yet.
+    int64_t currentSample() const {
+        if (appliedSerial.load(std::memory_order_acquire) != seekSerial) return seekTarget;
+        return playbackSampleIndex.load(std::memory_order_acquire);
+    }
+
+    // The sample being heard now, which lags currentSample() by the device
+    // buffering. Between callbacks it advances with the clock.
+    int64_t heardSample() const;
+
+    // True once playback has run off the end of the file, until the next seek.
+    bool atEnd() const {
+        return eof.load(std::memory_order_acquire);
+    }
+
+    // Audio thread (or the UI thread while the device is stopped).
+    void render(float* out, int frameCount);
+
+private:
+    void startDevice() {
+        if (deviceRunning) return;
+
+        lastCallback = 0;
+        ma_device_start(&device);
+        deviceRunning = true;
+    }
+
+    // While the device runs the callback owns the engine state, so commands are
+    // queued for it. Once stopped, the UI thread owns it and applies them directly.
+    void send(const AudioCommand& command) {
+        if (!deviceRunning) {
+            apply(command);
+            publish();
+            return;
+        }
+
+        if (!commands.push(command)) {
+            std::cerr << "Audio command queue full, command dropped.\n";
+        }
+    }
+
+    void applyCommands() {
+        AudioCommand command;
+        while (commands.pop(command)) apply(command);
+    }
+
+    void apply(const AudioCommand& command) {
+        switch (command.type) {
+            case AudioCommand::Seek:
+                jump(std::max<int64_t>(command.position, 0), 0.0, crossfadeFrames);
+                serial = command.serial;
+                break;
+            case AudioCommand::Start:
+                if (!running) jump(position, fraction, crossfadeFrames);
+                running = true;
+                scrubbing = false;
+                break;
+            case AudioCommand::Stop:
+                running = false;
+                break;
+            case AudioCommand::LoopRegion:
+                loopStart = std::max<int64_t>(command.position, 0);
+                loopEnd = command.end;
+                looping = loopEnd > loopStart;
+                break;
+            case AudioCommand::Gain:
+                targetGain = command.gain;
+                break;
+            case AudioCommand::Scrub:
+                if (!scrubbing) {
+                    scrubbing = true;
+                    scrubResume = running;
+                }
+
+                jump(std::max<int64_t>(command.position, 0), 0.0, crossfadeFrames);
+                running = true;
+                scrubRemaining = scrubGrainFrames;
+                break;
+            case AudioCommand::ScrubEnd:
+                if (!scrubbing) break;
+
+                scrubbing = false;
+
+                if (scrubResume) {
+                    jump(std::max<int64_t>(command.position, 0), 0.0, crossfadeFrames);
+                    running = true;
+                }
+                else {
+                    fadeOut();
+                    position = std::max<int64_t>(command.position, 0);
+                    fraction = 0.0;
+                    origin = position;
+                }
+                break;
+        }
+    }
+
+    // Makes the engine position visible to the UI thread. now is when the
+    // frames just rendered were handed over, or 0 if none were.
+    void publish(int64_t now = 0) {
+        // Seqlock: heardSample() retries if it reads while the count is odd
+        // or changes under it, so position, origin and time always match.
+        unsigned sequence = playheadSequence.load(std::memory_order_relaxed);
+        playheadSequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        playbackSampleIndex.store(position, std::memory_order_relaxed);
+        playheadOrigin.store(origin, std::memory_order_relaxed);
+        // Only written when playback moves, so the cursor keeps running
+        // through the last buffered audio after the end of the file.
+        if (now) playheadTime.store(now, std::memory_order_relaxed);
+        playheadSequence.store(sequence + 2, std::memory_order_release);
+
+        eof.store(!looping && position >= totalSamples, std::memory_order_release);
+        appliedSerial.store(serial, std::memory_order_release);
+    }
+
+    static int64_t clockNow() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void jump(int64_t target, double targetFraction, int fadeFrames);
+    void fadeOut();
+    void mixFade(float* out, int count);
+    int renderHead(float* out, int count, int64_t end);
+    void copyFrames(float* out, int64_t start, int count);
+    int resampleFrames(float* out, int count, int64_t end);
+    const float* fetchPadded(size_t channel, int64_t first, int count, float* scratch) const;
+
+    SpscQueue<AudioCommand, 256> commands;
+    // Picked in init(), outside the callback.
+    ZipFn zip = zipScalar;
+    // Only used when the device doesn't run at the file's rate.
+    Resampler resampler;
+    bool resampling = false;
+    std::vector<float> resampledLeft;
+    std::vector<float> resampledRight;
+
+    // Engine state, owned by the callback while the device runs.
+    int64_t position = 0;
+    // Position between position and position + 1 when resampling.
+    double fraction = 0.0;
+    // Where playback last started, jumped or looped to; the heard position
+    // never goes back before it.
+    int64_t origin = 0;
+    bool running = false;
+    bool looping = false;
+    int64_t loopStart = 0;
+    int64_t loopEnd = 0;
+    float gain = 1.0f;
+    float targetGain = 1.0f;
+    unsigned serial = 0;
+
+    // Jumps (seeks, loop wraps, scrub moves) don't cut: the old read head
+    // keeps playing past the jump, fading out, while the new one fades in.
+    static constexpr double crossfadeSeconds = 0.005;
+    // Output frames, set by configure().
+    int crossfadeFrames = 0;
+    // Input frames per output frame.
+    double outputStep = 1.0;
+    // The old head's output during a fade, interleaved.
+    std::vector<float> fadeScratch;
+    int fadeLength = 0;
+    int fadeRemaining = 0;
+    int64_t fadePosition = 0;
+    double fadeFraction = 0.0;
+    // Nothing was playing before the jump: the new head fades in from silence.
+    bool fadeFromSilence = false;
+    // Playback stopped: only the old head plays, fading out.
+    bool fadeToSilence = false;
+
+    // Scrubbing plays grains of this length from each new drag position.
+    static constexpr double scrubGrainSeconds = 0.08;
+    int scrubGrainFrames = 0;
+    int scrubRemaining = 0;
+    bool scrubbing = false;
+    // Playback was running when the scrub began.
+    bool scrubResume = false;
+
+    // Published once per buffer.
+    std::atomic<unsigned> playheadSequence{0};
+    std::atomic<int64_t> playbackSampleIndex{0};
+    std::atomic<int64_t> playheadOrigin{0};
+    std::atomic<int64_t> playheadTime{0};
+    std::atomic<bool> eof{false};
+    std::atomic<unsigned> appliedSerial{0};
+
+    ma_context context;
+    bool hasContext = false;
+
+    // UI thread only.
+    bool deviceRunning = false;
+    unsigned seekSerial = 0;
+    int64_t seekTarget = 0;
+};
+
+// miniaudio's data callback; pUserData is the Audio.
+void audio_data_callback(ma_device* pDevice, void* output, const void* input, ma_uint32 frameCount);
@@ -0,0 +1,332 @@
+#include "batch.h"
+#include "stream_decoder.h"
+#include "peak_cache.h"
+#include "peak_builder.h"
+#include "column_worker.h"
+#include "waveform_geometry.h"
+#include "raster.h"
+#include "png_writer.h"
+#include "peak_export.h"
+#include "arena.h"
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <sys/stat.h>
+
+namespace {
+
+// pattern with "{}" replaced by input's name, without directory and extension.
+std::string outputPath(const std::string& pattern, const std::string& input)
+{
+    size_t at = pattern.find("{}");
+    if (at == std::string::npos) return pattern;
+
+    size_t slash = input.find_last_of('/');
+    std::string name = slash == std::string::npos ? input : input.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+
+    if (dot != std::string::npos && dot > 0) name.resize(dot);
+
+    return pattern.substr(0, at) + name + pattern.substr(at + 2);
+}
+
+// What a worker did with one file, for the report.
+struct FileStats {
+    double audioSeconds = 0.0;
+    uint64_t bytes = 0;
+};
+
+class BatchWorker {
+public:
+    explicit BatchWorker(const BatchOptions& options) : options(options) {
+        columns.onReady = [this]() {
+            std::lock_guard<std::mutex> lock(readyMutex);
+            readyWake.notify_one();
+        };
+    }
+
+    // Renders and exports path. Failures are reported here and return false.
+    bool process(const std::string& path, FileStats& stats);
+
+private:
+    // Decodes the whole file (pyramids and samples); true if it got to the end.
+    bool decode(StreamingDecoder& loader);
+    // The columns of view, once the column worker has them.
+    std::shared_ptr<const ColumnData> prepareColumns(const ColumnView& view);
+    bool render(const std::string& path, const std::vector<std::shared_ptr<const PeakPyramid>>& pyramids,
+                const LevelTracks& levels, std::shared_ptr<const SampleSource> samples, size_t frames);
+
+    const BatchOptions& options;
+    // Kept from file to file.
+    BatchGeometry geometry;
+    RasterImage image;
+    PeakExport exported;
+    std::mutex readyMutex;
+    std::condition_variable readyWake;
+    // Last, so its thread stops before the rest goes.
+    ColumnWorker columns;
+};
+
+bool BatchWorker::process(const std::string& path, FileStats& stats)
+{
+    std::vector<std::shared_ptr<PeakPyramid>> cachedPeaks;
+    size_t cachedFrames = 0;
+    SeekIndex cachedIndex;
+    std::vector<std::shared_ptr<LevelTrack>> cachedLevels;
+    bool cached = loadPeakCache(path, cachedPeaks, cachedFrames, &cachedIndex, &cachedLevels);
+
+    // Build the pyramids while decoding unless the cache already has them.
+    StreamingDecoder loader;
+    loader.memoryBudget = options.memoryBudget;
+    loader.seekIndex = cachedIndex;
+
+    if (!loader.open(path, !cached)) return false;
+
+    size_t frames = cached ? cachedFrames : loader.frameCount;
+    // Samples are read for columns narrower than a pyramid block, and for
+    // peaks off the pyramids' block boundaries.
+    bool rendering = !options.renderPath.empty();
+    bool exportPeaks = !options.peaksPath.empty();
+    bool needSamples = (rendering && (frames == 0 || frames / std::max(options.width, 1) < PeakPyramid::baseBlockSize))
+                    || (exportPeaks && !peakExportFromPyramids(options.samplesPerPixel));
+    bool decoded = false;
+
+    if (!cached || (needSamples && !loader.samplesReady())) {
+        if (!decode(loader)) {
+            std::cerr << "Failed to decode: " << path << std::endl;
+            return false;
+        }
+
+        decoded = true;
+    }
+
+    // Decoded files can't be read before the decoder is done.
+    std::shared_ptr<const SampleSource> samples = decoded || loader.samplesReady() ? loader.samples : nullptr;
+    if (samples && !cached) frames = samples->frames();
+
+    std::vector<std::shared_ptr<const PeakPyramid>> pyramids;
+
+    if (cached) {
+        pyramids.assign(cachedPeaks.begin(), cachedPeaks.end());
+    }
+    else if (!loader.peaks.empty()) {
+        pyramids.assign(loader.peaks.begin(), loader.peaks.end());
+    }
+    else if (samples && frames > 0) {
+        // The length wasn't known up front, so the decoder built none.
+        std::vector<std::shared_ptr<PeakPyramid>> built(samples->channels());
+        auto arena = std::make_shared<Arena>();
+
+        for (auto& peaks : built) {
+            peaks = std::make_shared<PeakPyramid>();
+            peaks->reserve(frames, arena);
+        }
+
+        summariseRange(*samples, built, 0, frames);
+        pyramids.assign(built.begin(), built.end());
+    }
+
+    if (frames == 0 || pyramids.empty()) {
+        std::cerr << "No samples in " << path << std::endl;
+        return false;
+    }
+
+    LevelTracks levels;
+    if (cached) levels.assign(cachedLevels.begin(), cachedLevels.end());
+    else levels.assign(loader.levels.begin(), loader.levels.end());
+
+    // Keep the freshly built pyramids for the next run, as the viewer does.
+    if (!cached && pyramids[0]->complete()) {
+        std::vector<const PeakPyramid*> channels;
+        std::vector<const LevelTrack*> tracks;
+        for (const auto& peaks : pyramids) channels.push_back(peaks.get());
+        for (const auto& track : levels) tracks.push_back(track.get());
+        savePeakCache(path, channels, frames, &loader.seekIndex, &tracks);
+    }
+
+    if (rendering && !render(outputPath(options.renderPath, path), pyramids, levels, samples, frames)) return false;
+
+    if (exportPeaks) {
+        exported.sampleRate = loader.sampleRate;
+        exported.samplesPerPixel = options.samplesPerPixel;
+
+        if (!computePeakExport(pyramids, samples.get(), frames, exported)
+            || !writePeakExport(outputPath(options.peaksPath, path), exported)) {
+            return false;
+        }
+    }
+
+    struct stat info;
+    stats.bytes = ::stat(path.c_str(), &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+    stats.audioSeconds = loader.sampleRate > 0 ? static_cast<double>(frames) / loader.sampleRate : 0.0;
+
+    return true;
+}
+
+bool BatchWorker::decode(StreamingDecoder& loader)
+{
+    std::mutex doneMutex;
+    std::condition_variable doneWake;
+    bool finished = false;
+    bool completed = false;
+
+    loader.start(nullptr, [&](bool ok) {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        completed = ok;
+        finished = true;
+        doneWake.notify_one();
+    });
+
+    std::unique_lock<std::mutex> lock(doneMutex);
+    doneWake.wait(lock, [&]() { return finished; });
+
+    return completed;
+}
+
+std::shared_ptr<const ColumnData> BatchWorker::prepareColumns(const ColumnView& view)
+{
+    columns.request(view);
+
+    std::shared_ptr<const ColumnData> data;
+    std::unique_lock<std::mutex> lock(readyMutex);
+    readyWake.wait(lock, [&]() {
+        data = columns.latest();
+        return data && data->view == view;
+    });
+
+    return data;
+}
+
+bool BatchWorker::render(const std::string& path, const std::vector<std::shared_ptr<const PeakPyramid>>& pyramids,
+                         const LevelTracks& levels, std::shared_ptr<const SampleSource> samples, size_t frames)
+{
+    // The whole file across the width, as the viewer first shows it.
+    WaveformScene scene;
+    scene.width = std::max(options.width, 1);
+    scene.height = std::max(options.height, 1);
+    scene.zoomLevel = static_cast<double>(scene.width) / frames;
+    scene.samplesPerColumn = static_cast<double>(frames) / scene.width;
+    scene.totalSamples = static_cast<int64_t>(frames);
+    scene.peaks = &pyramids;
+    scene.levels = options.levels ? &levels : nullptr;
+
+    ColumnView view = scene.columnView();
+    view.decoded = samples ? samples->available() : 0;
+
+    for (const auto& peaks : pyramids) {
+        view.peaksBuilt += peaks->available();
+    }
+
+    columns.setSource(samples, pyramids, scene.totalSamples);
+    std::shared_ptr<const ColumnData> data = prepareColumns(view);
+    // The worker lets go of the file; data still holds the columns.
+    columns.setSource(nullptr, {}, 0);
+
+    scene.columns = data.get();
+    buildWaveformGeometry(geometry, scene);
+    appendLevelOverlays(geometry, scene);
+
+    // White background, as the view clears it.
+    image.reset(scene.width, scene.height, 1.0f, 1.0f, 1.0f);
+    image.draw(geometry);
+
+    return writePng(path, image.width(), image.height(), image.pixels());
+}
+
+} // namespace
+
+int runBatch(const BatchOptions& options, const std::vector<std::string>& files)
+{
+    bool sharedOutput = (!options.renderPath.empty() && options.renderPath.find("{}") == std::string::npos)
+                     || (!options.peaksPath.empty() && options.peaksPath.find("{}") == std::string::npos);
+
+    if (files.empty() || (files.size() > 1 && sharedOutput)) {
+        std::cerr << "With several files, output paths need {} for each file's name (e.g. --render thumbs/{}.png).\n";
+        return 1;
+    }
+
+    unsigned jobs = options.jobs > 0 ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+    jobs = static_cast<unsigned>(std::min<size_t>(jobs, files.size()));
+
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::mutex totalsMutex;
+    size_t failed = 0;
+    FileStats totals;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+
+    for (unsigned j = 0; j < jobs; ++j) {
+        workers.emplace_back([&]() {
+            BatchWorker worker(options);
+
+            for (size_t i = next.fetch_add(1); i < files.size(); i = next.fetch_add(1)) {
+                FileStats stats;
+                bool ok = worker.process(files[i], stats);
+
+                {
+                    std::lock_guard<std::mutex> lock(totalsMutex);
+                    if (!ok) ++failed;
+                    totals.audioSeconds += stats.audioSeconds;
+                    totals.bytes += stats.bytes;
+                }
+
+                done.fetch_add(1);
+            }
+        });
+    }
+
+    // Progress of long runs on stderr.
+    auto lastReport = start;
+
+    while (done.load() < files.size()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastReport >= std::chrono::seconds(5)) {
+            lastReport = now;
+            std::cerr << done.load() << " of " << files.size() << " files\n";
+        }
+    }
+
+    for (auto& worker : workers) worker.join();
+
+    double seconds = std::max(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), 1e-9);
+
+    std::cout << "Processed " << files.size() - failed << " of " << files.size() << " files on " << jobs
+              << " threads in " << seconds << " s: " << files.size() / seconds << " files/s, "
+              << totals.audioSeconds / seconds << "x realtime, " << totals.bytes / seconds / (1 << 20) << " MB/s\n";
+
+    return failed > 0 ? 1 : 0;
+}
+
+bool readFileList(const std::string& listPath, std::vector<std::string>& files)
+{
+    std::ifstream file;
+
+    if (listPath != "-") {
+        file.open(listPath);
+
+        if (!file) {
+            std::cerr << "Cannot read file list: " << listPath << std::endl;
+            return false;
+        }
+    }
+
+    std::istream& in = listPath == "-" ? std::cin : file;
+    std::string line;
+
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!line.empty()) files.push_back(line);
+    }
+
+    return true;
+}
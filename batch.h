@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+// ---- Batch Mode ----
+// waveform_viewer as a command-line tool: with --render or --peaks it draws
+// waveform images and exports peaks for any number of files, without a
+// window or a display. The image is the one the viewer shows for the whole
+// file (the same geometry, see waveform_geometry.h, rasterized in software).
+//
+// Files are shared out to jobs worker threads. Each worker runs one
+// StreamingDecoder at a time, with memoryBudget for its samples, and keeps
+// its column, geometry and image buffers from one file to the next, so
+// memory is bounded by the number of jobs whatever the number of files.
+// Peak caches are used and written as in the viewer.
+struct BatchOptions {
+    // PNG and peak (.json or .dat, see peak_export.h) outputs. With several
+    // input files "{}" stands for each one's name, without directory and
+    // extension.
+    std::string renderPath;
+    std::string peaksPath;
+    int width = 1800;
+    int height = 280;
+    size_t samplesPerPixel = 256;
+    // Draws the level overlays (see appendLevelOverlays()) into the images.
+    bool levels = false;
+    // Worker threads; 0 for one per core.
+    unsigned jobs = 0;
+    size_t memoryBudget = size_t(64) << 20;
+
+    bool active() const { return !renderPath.empty() || !peaksPath.empty(); }
+};
+
+// Processes files and reports the throughput on stdout. Returns the exit
+// status: 0 if every file succeeded.
+int runBatch(const BatchOptions& options, const std::vector<std::string>& files);
+
+// Appends the paths listed in listPath, one per line ("-" for stdin).
+bool readFileList(const std::string& listPath, std::vector<std::string>& files);
@@ -0,0 +1,335 @@
+// ---- Benchmarks ----
+// Headless timings of the hot paths, for catching regressions between
+// releases: pyramid building, envelope columns (the CPU side of drawing) at
+// a range of zoom levels, the audio callback at several buffer sizes, and
+// loading files. No display or audio device is needed.
+//
+// Results go to stdout (or --out) as CSV, one row per case with the median
+// of several runs; progress goes to stderr.
+//
+//   ./waveform_bench [--out results.csv] [--quick] [extra files to load...]
+#include "audio.h"
+#include "peaks.h"
+#include "peak_builder.h"
+#include "column_worker.h"
+#include "sample_buffer.h"
+#include "stream_decoder.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+namespace {
+
+struct Result {
+    std::string benchmark;
+    std::string name;
+    size_t channels = 0;
+    size_t frames = 0;
+    double value = 0.0;
+    std::string unit;
+};
+
+std::vector<Result> results;
+
+void report(const std::string& benchmark, const std::string& name, size_t channels, size_t frames,
+            double value, const std::string& unit) {
+    results.push_back({ benchmark, name, channels, frames, value, unit });
+    std::cerr << benchmark << " " << name << " (" << channels << " ch, " << frames << " frames): "
+              << value << " " << unit << std::endl;
+}
+
+double seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Median duration of runs calls, in seconds.
+double median(int runs, const std::function<void()>& body) {
+    std::vector<double> times;
+
+    for (int r = 0; r < runs; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        times.push_back(seconds(start));
+    }
+
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+// A sweep with some noise on top, so the envelope isn't trivially flat.
+std::shared_ptr<SampleBuffer> makeSignal(size_t channels, size_t frames) {
+    auto buffer = std::make_shared<SampleBuffer>(channels, frames);
+    uint32_t noise = 12345;
+
+    for (size_t c = 0; c < channels; ++c) {
+        float* out = buffer->writableChannel(c);
+        double phase = 0.0;
+
+        for (size_t i = 0; i < frames; ++i) {
+            noise = noise * 1664525u + 1013904223u;
+            phase += 0.001 + 0.2 * static_cast<double>(i) / frames;
+            out[i] = 0.6f * static_cast<float>(std::sin(phase + c)) + 0.1f * ((noise >> 8) * (1.0f / 16777216.0f) - 0.5f);
+        }
+    }
+
+    buffer->publish(frames);
+    return buffer;
+}
+
+std::vector<std::shared_ptr<PeakPyramid>> buildPyramids(const SampleSource& source) {
+    std::vector<std::shared_ptr<PeakPyramid>> peaks(source.channels());
+
+    for (auto& pyramid : peaks) {
+        pyramid = std::make_shared<PeakPyramid>();
+        pyramid->reserve(source.frames());
+    }
+
+    summariseRange(source, peaks, 0, source.frames());
+    return peaks;
+}
+
+void benchPyramids(const SampleBuffer& signal, int runs) {
+    double time = median(runs, [&]() { buildPyramids(signal); });
+    double samples = static_cast<double>(signal.frames()) * signal.channels();
+
+    report("pyramid", "build", signal.channels(), signal.frames(), time * 1e3, "ms");
+    report("pyramid", "throughput", signal.channels(), signal.frames(), samples / time / 1e6, "Msamples/s");
+}
+
+// Waits for the worker to finish view.
+void prepareColumns(ColumnWorker& worker, const ColumnView& view) {
+    worker.request(view);
+
+    for (;;) {
+        auto latest = worker.latest();
+        if (latest && latest->view == view) return;
+        std::this_thread::yield();
+    }
+}
+
+// Columns for a 1920 pixel wide view, jumping to unrelated positions (nothing
+// reusable) and panning by 16 columns at a time (column cache hits).
+void benchEnvelope(const std::shared_ptr<SampleBuffer>& signal, int views) {
+    const int width = 1920;
+    auto built = buildPyramids(*signal);
+    std::vector<std::shared_ptr<const PeakPyramid>> peaks(built.begin(), built.end());
+
+    for (double samplesPerColumn : { 8.0, 64.0, 512.0, 4096.0, 32768.0 }) {
+        int64_t span = static_cast<int64_t>(width * samplesPerColumn);
+        int64_t room = static_cast<int64_t>(signal->frames()) - span;
+
+        // The view must be able to move, otherwise every request is the same one.
+        if (room < static_cast<int64_t>(16 * samplesPerColumn)) continue;
+
+        for (bool pan : { false, true }) {
+            ColumnWorker worker;
+            worker.setSource(signal, peaks, static_cast<int64_t>(signal->frames()));
+
+            ColumnView view;
+            view.width = width;
+            view.samplesPerColumn = samplesPerColumn;
+            view.decoded = signal->frames();
+            view.peaksBuilt = signal->frames() * signal->channels();
+            view.scrollOffset = 0;
+            prepareColumns(worker, view);
+
+            uint64_t jump = 0x9e3779b97f4a7c15ull;
+            auto start = std::chrono::steady_clock::now();
+
+            for (int v = 0; v < views; ++v) {
+                if (pan) {
+                    view.scrollOffset = (view.scrollOffset + static_cast<int64_t>(16 * samplesPerColumn)) % room;
+                }
+                else {
+                    jump = jump * 6364136223846793005ull + 1442695040888963407ull;
+                    view.scrollOffset = static_cast<int64_t>((jump >> 16) % static_cast<uint64_t>(room));
+                }
+
+                prepareColumns(worker, view);
+            }
+
+            char name[64];
+            std::snprintf(name, sizeof(name), "spp=%g %s", samplesPerColumn, pan ? "pan" : "jump");
+            report("envelope", name, signal->channels(), signal->frames(), seconds(start) / views * 1e6, "us/view");
+        }
+    }
+}
+
+// render() as the device would call it, looping over the signal.
+void benchCallback(const std::shared_ptr<SampleBuffer>& signal, double outputSeconds) {
+    struct Case { unsigned rate; ResampleQuality quality; const char* name; };
+    const Case cases[] = {
+        { 44100, ResampleQuality::Sinc, "44100 copy" },
+        { 48000, ResampleQuality::Linear, "48000 linear" },
+        { 48000, ResampleQuality::Sinc, "48000 sinc" },
+        { 96000, ResampleQuality::Sinc, "96000 sinc" },
+    };
+
+    for (const Case& c : cases) {
+        for (int period : { 64, 256, 1024, 4096 }) {
+            Audio audio;
+            audio.options.quality = c.quality;
+            audio.configure(signal, 44100, c.rate);
+            audio.setLoopRegion(0, static_cast<int64_t>(signal->frames()));
+            audio.startHeadless();
+
+            std::vector<float> out(static_cast<size_t>(period) * 2);
+            size_t calls = static_cast<size_t>(outputSeconds * c.rate / period) + 1;
+            auto start = std::chrono::steady_clock::now();
+
+            for (size_t i = 0; i < calls; ++i) {
+                audio.render(out.data(), period);
+            }
+
+            double time = seconds(start);
+            double frames = static_cast<double>(calls) * period;
+            char name[64];
+
+            std::snprintf(name, sizeof(name), "%s period=%d", c.name, period);
+            report("callback", name, signal->channels(), signal->frames(), time / frames * 1e9, "ns/frame");
+            std::snprintf(name, sizeof(name), "%s period=%d realtime", c.name, period);
+            report("callback", name, signal->channels(), signal->frames(), frames / c.rate / time, "x");
+        }
+    }
+}
+
+// A 16-bit PCM WAV of the signal.
+bool writeWav(const std::string& path, const SampleBuffer& signal) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) return false;
+
+    auto u16 = [&](uint16_t v) { out.put(static_cast<char>(v & 0xff)); out.put(static_cast<char>(v >> 8)); };
+    auto u32 = [&](uint32_t v) { u16(static_cast<uint16_t>(v & 0xffff)); u16(static_cast<uint16_t>(v >> 16)); };
+
+    uint16_t channels = static_cast<uint16_t>(signal.channels());
+    uint32_t bytes = static_cast<uint32_t>(signal.frames() * channels * 2);
+
+    out.write("RIFF", 4); u32(36 + bytes); out.write("WAVE", 4);
+    out.write("fmt ", 4); u32(16); u16(1); u16(channels); u32(44100); u32(44100 * channels * 2); u16(channels * 2); u16(16);
+    out.write("data", 4); u32(bytes);
+
+    std::vector<int16_t> frame(channels);
+
+    for (size_t i = 0; i < signal.frames(); ++i) {
+        for (uint16_t c = 0; c < channels; ++c) {
+            frame[c] = static_cast<int16_t>(std::lrint(std::clamp(signal.channelData(c)[i], -1.0f, 1.0f) * 32767.0f));
+        }
+
+        out.write(reinterpret_cast<const char*>(frame.data()), channels * 2);
+    }
+
+    return static_cast<bool>(out);
+}
+
+// Opening plus the worker's pass (decoding and pyramids) until it finishes.
+double loadFile(const std::string& path, size_t& channels, size_t& frames) {
+    auto start = std::chrono::steady_clock::now();
+    StreamingDecoder loader;
+
+    if (!loader.open(path, true)) return -1.0;
+
+    std::atomic<bool> finished{false};
+    loader.start(nullptr, [&](bool) { finished.store(true); });
+
+    while (!finished.load()) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+
+    channels = loader.channelCount;
+    frames = loader.framesDecoded();
+    loader.cancel();
+
+    return seconds(start);
+}
+
+void benchLoad(const SampleBuffer& signal, const std::vector<std::string>& files, int runs) {
+    std::string directory = std::getenv("TMPDIR") ? std::getenv("TMPDIR") : "/tmp";
+    std::string wav = directory + "/waveform_bench_" + std::to_string(::getpid()) + ".wav";
+
+    if (writeWav(wav, signal)) {
+        size_t channels = 0, frames = 0;
+        double time = median(runs, [&]() { loadFile(wav, channels, frames); });
+        report("load", "wav16 mapped", channels, frames, time * 1e3, "ms");
+        std::remove(wav.c_str());
+    }
+
+    for (const std::string& file : files) {
+        size_t channels = 0, frames = 0;
+        double time = median(runs, [&]() { loadFile(file, channels, frames); });
+        report("load", file, channels, frames, time * 1e3, "ms");
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string outPath;
+    bool quick = false;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (arg == "--out" && i + 1 < argc) {
+            outPath = argv[++i];
+        }
+        else if (arg == "--quick") {
+            quick = true;
+        }
+        else if (arg.rfind("--", 0) != 0) {
+            files.push_back(arg);
+        }
+        else {
+            std::cerr << "Usage: ./waveform_bench [--out results.csv] [--quick] [files to load...]\n";
+            return 1;
+        }
+    }
+
+    // Chosen at runtime, so the same binary gives different numbers per CPU.
+    std::cerr << "Kernels: min/max " << minMaxKernel().name << ", dot " << dotKernel().name << ", zip "
+              << zipKernel().name << ", deinterleave " << deinterleaveKernel().name << std::endl;
+
+    int runs = quick ? 1 : 5;
+    std::vector<size_t> lengths = { size_t(1) << 20, size_t(1) << 24 };
+    if (quick) lengths.pop_back();
+
+    for (size_t frames : lengths) {
+        for (size_t channels : { size_t(1), size_t(2), size_t(8) }) {
+            // At most 64M samples (256 MB) at once.
+            if (frames * channels > (size_t(1) << 26)) continue;
+
+            auto signal = makeSignal(channels, frames);
+            benchPyramids(*signal, runs);
+            benchEnvelope(signal, quick ? 20 : 200);
+
+            if (channels == 2) {
+                benchCallback(signal, quick ? 2.0 : 20.0);
+                benchLoad(*signal, frames == lengths.front() ? files : std::vector<std::string>(), runs);
+            }
+        }
+    }
+
+    std::ofstream file;
+    if (!outPath.empty()) file.open(outPath);
+    std::ostream& out = outPath.empty() ? std::cout : file;
+
+    out << "benchmark,case,channels,frames,value,unit\n";
+
+    for (const Result& r : results) {
+        out << r.benchmark << ",\"" << r.name << "\"," << r.channels << ',' << r.frames << ','
+            << r.value << ',' << r.unit << '\n';
+    }
+
+    return out ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+#include "capture.h"
+#include "kernels.h"
+#include "instrumentation.h"
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+// Frames the drain thread moves at a time.
+constexpr size_t drainFrames = 4096;
+
+// How long the drain thread sleeps when the ring is empty; the input waits
+// at most this much before the view can draw it.
+constexpr auto drainInterval = std::chrono::milliseconds(5);
+
+} // namespace
+
+LiveCapture::~LiveCapture()
+{
+    stop();
+
+    if (opened) ma_device_uninit(&device);
+    if (hasContext) ma_context_uninit(&context);
+}
+
+bool LiveCapture::open(const AudioDeviceOptions& options, const CaptureOptions& capture)
+{
+    monitoring = capture.monitor;
+
+    ma_device_config config = ma_device_config_init(monitoring ? ma_device_type_duplex : ma_device_type_capture);
+    config.capture.format = ma_format_f32;
+    config.capture.channels = channels;
+    config.capture.shareMode = options.shareMode;
+    config.playback.format = ma_format_f32;
+    config.playback.channels = channels;
+    config.playback.shareMode = options.shareMode;
+    config.sampleRate = options.sampleRate;
+    config.periodSizeInFrames = options.periodSizeInFrames;
+    config.periods = options.periods;
+    // The callback takes any frame count (see Audio::init()).
+    config.noFixedSizedCallback = MA_TRUE;
+    config.dataCallback = capture_data_callback;
+    config.pUserData = this;
+
+    if (!options.backend.empty()) {
+        if (!initBackendContext(options.backend, context)) return false;
+
+        hasContext = true;
+    }
+
+    if (ma_device_init(hasContext ? &context : nullptr, &config, &device) != MA_SUCCESS) {
+        std::cerr << "Failed to open the input device.\n";
+        return false;
+    }
+
+    opened = true;
+    rate = device.sampleRate;
+
+    // A second of input between the callback and the drain thread, which
+    // only falls that far behind if it is starved of CPU.
+    ring.reset(static_cast<size_t>(rate) * channels);
+    incoming.resize(drainFrames * channels);
+    planar.resize(drainFrames * channels);
+
+    // A second more than is shown is kept, so the view never reads what is
+    // being overwritten.
+    windowFrames = static_cast<size_t>(std::max(capture.windowSeconds, 1.0) * rate);
+    source = std::make_shared<LiveSource>(channels, windowFrames + rate);
+    pyramids.resize(channels);
+    peaks.clear();
+
+    for (auto& pyramid : pyramids) {
+        pyramid = std::make_shared<PeakPyramid>();
+        pyramid->reserveRolling(source->capacity());
+        peaks.push_back(pyramid);
+    }
+
+    meter.configure(rate);
+
+    const auto& granted = device.capture;
+    double latencyMs = granted.internalSampleRate
+        ? 1000.0 * granted.internalPeriodSizeInFrames * granted.internalPeriods / granted.internalSampleRate : 0.0;
+
+    std::cout << "Capture: " << ma_get_backend_name(device.pContext->backend) << ", " << granted.internalPeriods
+              << " x " << granted.internalPeriodSizeInFrames << " frames at " << granted.internalSampleRate << " Hz, "
+              << latencyMs << " ms input latency, " << windowFrames / rate << " s window"
+              << (monitoring ? ", monitoring" : "") << "\n";
+
+    return true;
+}
+
+bool LiveCapture::start()
+{
+    if (!opened) return false;
+
+    if (!draining.exchange(true)) {
+        drainer = std::thread(&LiveCapture::drain, this);
+    }
+
+    if (ma_device_start(&device) != MA_SUCCESS) {
+        std::cerr << "Failed to start the input device.\n";
+        return false;
+    }
+
+    return true;
+}
+
+void LiveCapture::stop()
+{
+    // The callback doesn't run again once the device has stopped.
+    if (opened) ma_device_stop(&device);
+
+    if (draining.exchange(false)) {
+        drainer.join();
+    }
+
+    meter.reset();
+}
+
+void LiveCapture::drain()
+{
+    while (draining.load(std::memory_order_acquire)) {
+        size_t count = ring.pop(incoming.data(), incoming.size());
+
+        if (count == 0) {
+            std::this_thread::sleep_for(drainInterval);
+            continue;
+        }
+
+        store(count / channels);
+    }
+
+    // What arrived before the device stopped.
+    while (size_t count = ring.pop(incoming.data(), incoming.size())) {
+        store(count / channels);
+    }
+}
+
+void LiveCapture::store(size_t count)
+{
+    float* planes[channels];
+
+    for (size_t c = 0; c < channels; ++c) {
+        planes[c] = planar.data() + c * drainFrames;
+    }
+
+    deinterleaveKernel().run(incoming.data(), channels, count, planes);
+
+    // The pyramids first: readers take the source's length as what they may read.
+    for (size_t c = 0; c < channels; ++c) {
+        pyramids[c]->append(planes[c], count);
+    }
+
+    source->append(planes, count);
+}
+
+void capture_data_callback(ma_device* pDevice, void* output, const void* input, ma_uint32 frameCount)
+{
+    auto* self = static_cast<LiveCapture*>(pDevice->pUserData);
+    const float* frames = static_cast<const float*>(input);
+    uint64_t start = Instrumentation::now();
+
+    // Never waits: a buffer that doesn't fit is dropped and counted.
+    if (!self->ring.push(frames, static_cast<size_t>(frameCount) * LiveCapture::channels)) {
+        self->dropped.fetch_add(frameCount, std::memory_order_relaxed);
+    }
+
+    self->meter.process(frames, static_cast<int>(frameCount));
+
+    if (output) {
+        std::memcpy(output, frames, static_cast<size_t>(frameCount) * LiveCapture::channels * sizeof(float));
+    }
+
+    uint64_t end = Instrumentation::now();
+    uint64_t budget = static_cast<uint64_t>(frameCount) * 1000000000ull / std::max<ma_uint32>(pDevice->sampleRate, 1);
+    instrumentation().record(Probe::Callback, start, end, budget);
+}
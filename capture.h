@@ -0,0 +1,99 @@
+#pragma once
+
+#include "../libraries/miniaudio.h"
+#include "audio.h"
+#include "peaks.h"
+#include "live_source.h"
+#include "spsc_queue.h"
+#include "levels.h"
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <cstddef>
+
+// ---- Capture Options ----
+struct CaptureOptions {
+    // Seconds of input kept and shown; older input is dropped.
+    double windowSeconds = 60.0;
+    // Plays the input straight back (a duplex device) to monitor it.
+    bool monitor = false;
+};
+
+// ---- Live Capture ----
+// Records the input device into a rolling window for the waveform view. The
+// device callback only copies each buffer into a wait-free SampleRing (and
+// through the level meter, and to the output when monitoring): it never
+// waits on a lock or on the other threads. A drain thread empties the ring a
+// few milliseconds later into a LiveSource and a rolling PeakPyramid per
+// channel, which readers (the column worker, the view) use as they would a
+// decoding file's. Memory is fixed by the window, however long it runs.
+//
+// Input is always taken as stereo float at the device's rate; miniaudio
+// converts mono inputs.
+class LiveCapture {
+public:
+    static constexpr size_t channels = 2;
+
+    // One rolling pyramid per channel, filled as the input arrives.
+    std::vector<std::shared_ptr<const PeakPyramid>> peaks;
+    // Levels of the input, fed by the device callback; read() from any thread.
+    LevelMeter meter;
+
+    LiveCapture() = default;
+    LiveCapture(const LiveCapture&) = delete;
+    LiveCapture& operator=(const LiveCapture&) = delete;
+    ~LiveCapture();
+
+    // Opens the input (or duplex) device and sizes the buffers; device's
+    // period, rate, share mode and backend apply to it as to playback.
+    bool open(const AudioDeviceOptions& device, const CaptureOptions& options);
+
+    // Starts the device and the drain thread. UI thread.
+    bool start();
+    void stop();
+
+    // The input so far, shared with the view.
+    std::shared_ptr<const SampleSource> samples() const { return source; }
+    // Frames recorded, all of which are readable from the pyramids and samples.
+    size_t frames() const { return source ? source->frames() : 0; }
+    // The frames the view may show, a little short of what is kept, so the
+    // frames being overwritten are never on screen.
+    size_t window() const { return windowFrames; }
+    unsigned sampleRate() const { return rate; }
+    // Input frames lost because the drain thread fell a whole ring behind.
+    uint64_t droppedFrames() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    friend void capture_data_callback(ma_device*, void*, const void*, ma_uint32);
+
+    // Drain thread: moves what has arrived into the source and pyramids.
+    void drain();
+    // Moves count interleaved frames from incoming onward. Drain thread.
+    void store(size_t count);
+
+    ma_device device;
+    ma_context context;
+    bool hasContext = false;
+    bool opened = false;
+    bool monitoring = false;
+    unsigned rate = 0;
+    size_t windowFrames = 0;
+
+    // From the callback to the drain thread, interleaved.
+    SampleRing ring;
+    std::atomic<uint64_t> dropped{0};
+
+    std::shared_ptr<LiveSource> source;
+    std::vector<std::shared_ptr<PeakPyramid>> pyramids;
+
+    std::thread drainer;
+    std::atomic<bool> draining{false};
+    // Drain thread.
+    std::vector<float> incoming;
+    std::vector<float> planar;
+};
+
+// miniaudio's data callback for LiveCapture; pUserData is the LiveCapture.
+void capture_data_callback(ma_device* pDevice, void* output, const void* input, ma_uint32 frameCount);
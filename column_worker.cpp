@@ -0,0 +1,159 @@
+#include "column_worker.h"
+
+void ColumnWorker::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    for (;;) {
+        wake.wait(lock, [this]() { return stopping || (hasRequest && !(result && result->view == pending)); });
+
+        if (stopping) return;
+
+        ColumnView view = pending;
+        uint64_t job = generation.load();
+        auto source = samples;
+        auto pyramids = peaks;
+        int64_t frames = totalSamples;
+        uint64_t version = sourceVersion;
+        lock.unlock();
+
+        auto data = prepare(view, job, version, source.get(), pyramids, frames);
+
+        lock.lock();
+
+        if (data && generation.load() == job) {
+            result = std::move(data);
+            hasRequest = false;
+            lock.unlock();
+
+            if (onReady) onReady();
+
+            lock.lock();
+        }
+    }
+}
+
+std::shared_ptr<ColumnData> ColumnWorker::prepare(const ColumnView& view, uint64_t job, uint64_t version,
+                                                  const SampleSource* source,
+                                                  const std::vector<std::shared_ptr<const PeakPyramid>>& pyramids,
+                                                  int64_t frames)
+{
+    auto data = recycle();
+    data->view = view;
+    int64_t decoded = source ? static_cast<int64_t>(std::min(view.decoded, source->available())) : 0;
+
+    if (view.envelope()) {
+        int64_t first = view.firstColumn();
+        size_t count = view.columnCount();
+        resetCache(view.samplesPerColumn, version, count, pyramids.size());
+        data->samples.clear();
+        data->peaks.resize(pyramids.size());
+
+        for (auto& channel : data->peaks) {
+            channel.assign(count, Peak());
+        }
+
+        for (size_t c = 0; c < pyramids.size(); ++c) {
+            const PeakPyramid& pyramid = *pyramids[c];
+            // Columns before this are final and may be cached.
+            int64_t settled = std::min<int64_t>(decoded, static_cast<int64_t>(pyramid.available()));
+
+            for (size_t i = 0; i < count; ++i) {
+                // Checked every few columns so a stale job ends quickly.
+                if (i % 64 == 0 && generation.load(std::memory_order_relaxed) != job) return nullptr;
+
+                int64_t column = first + static_cast<int64_t>(i);
+                CachedColumn& cached = cache.columns[c][static_cast<size_t>(column) & (cache.capacity - 1)];
+                Peak& peak = data->peaks[c][i];
+
+                if (cached.column == column) {
+                    peak = cached.peak;
+                    continue;
+                }
+
+                int64_t startSample, endSample;
+                columnSamples(column, view.samplesPerColumn, frames, startSample, endSample);
+
+                if (startSample >= endSample) continue;
+
+                // Read the column from the pyramid, or scan the raw samples
+                // when the column is narrower than a pyramid block.
+                if (endSample > decoded) {
+                    // Samples still decoding: coarse preview from level 0.
+                    peak = pyramid.read(startSample, endSample);
+                }
+                else if (!pyramid.query(startSample, endSample, peak)) {
+                    scratch.resize(endSample - startSample);
+                    peak = scanPeak(source->fetch(c, startSample, scratch.size(), scratch.data()), scratch.size());
+                }
+
+                if (endSample <= settled) {
+                    cached.column = column;
+                    cached.peak = peak;
+                }
+            }
+        }
+    }
+    else if (source) {
+        // Note: Add +1 sample to visible range to ensure last visible pixel is drawn.
+        int64_t visibleSamples = static_cast<int64_t>(std::ceil(view.width * view.samplesPerColumn)) + 1;
+        int64_t endSample = std::min(view.scrollOffset + visibleSamples, decoded);
+        size_t count = endSample > view.scrollOffset ? static_cast<size_t>(endSample - view.scrollOffset) : 0;
+        data->peaks.clear();
+        data->samples.resize(source->channels());
+
+        for (auto& channel : data->samples) {
+            channel.resize(count);
+        }
+
+        for (size_t c = 0; c < data->samples.size() && count > 0; ++c) {
+            if (generation.load(std::memory_order_relaxed) != job) return nullptr;
+
+            source->read(c, view.scrollOffset, count, data->samples[c].data());
+        }
+    }
+    else {
+        data->peaks.clear();
+        data->samples.clear();
+    }
+
+    return data;
+}
+
+std::shared_ptr<ColumnData> ColumnWorker::recycle()
+{
+    for (const auto& data : spare) {
+        // Only spare holds it, and nothing else can take it from there.
+        if (data.use_count() == 1) {
+            // Whoever dropped it last is done reading it.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            data->serial = ++serials;
+            return data;
+        }
+    }
+
+    auto data = std::make_shared<ColumnData>();
+    data->serial = ++serials;
+
+    if (spare.size() < spareResults) {
+        spare.push_back(data);
+    }
+
+    return data;
+}
+
+void ColumnWorker::resetCache(double samplesPerColumn, uint64_t version, size_t count, size_t channels)
+{
+    size_t capacity = std::max<size_t>(cache.capacity, 1);
+    while (capacity < 4 * count) capacity *= 2;
+
+    if (cache.samplesPerColumn == samplesPerColumn && cache.version == version && cache.capacity == capacity
+        && cache.columns.size() == channels) {
+        return;
+    }
+
+    cache.samplesPerColumn = samplesPerColumn;
+    cache.version = version;
+    cache.capacity = capacity;
+    cache.columns.assign(channels, std::vector<CachedColumn>(capacity));
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include "peaks.h"
+#include "sample_source.h"
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+// ---- Column Worker ----
+// Prepares what the waveform view draws, away from the UI thread: one
+// envelope column per pixel when zoomed out, the raw visible samples when
+// zoomed in. Reading samples can wait on disk (paged or mapped files), so
+// the view only ever draws finished results, or a preview from the
+// pyramids while the exact one is being prepared.
+//
+// Only the newest request matters: a request replaces the one queued and
+// the job in progress gives up at its next check.
+//
+// Envelope columns sit on a grid fixed to the start of the file (column k
+// covers the samples from k * samplesPerColumn on), so at a given zoom a column is
+// the same whatever the scroll position. The worker keeps recent ones in a
+// ring keyed by column index, and a pan only computes the newly exposed ones.
+//
+// A result lives for a frame or two. The worker keeps the last few and
+// prepares the next one into whichever nobody holds any more, so a steady
+// redraw allocates nothing.
+
+// What a result was prepared for.
+struct ColumnView {
+    int64_t scrollOffset = -1;
+    // The inverse of the zoom level. Exact, so that column boundaries are too.
+    double samplesPerColumn = 0.0;
+    int width = 0;
+    // Samples readable when the request was made; results change as the
+    // file loads.
+    size_t decoded = 0;
+    size_t peaksBuilt = 0;
+    // The raw samples even when zoomed out, for a GPU envelope (see
+    // EnvelopeShader) to reduce itself.
+    bool rawSamples = false;
+
+    // Zoomed out far enough to draw min/max columns rather than samples.
+    bool envelope() const { return samplesPerColumn > 5.0 && !rawSamples; }
+
+    // Envelope mode: the column under the left edge, and how many columns
+    // cover the width (the outer two partly).
+    int64_t firstColumn() const { return static_cast<int64_t>(std::floor(scrollOffset / samplesPerColumn)); }
+    size_t columnCount() const { return static_cast<size_t>(std::max(width, 0)) + 1; }
+
+    bool operator==(const ColumnView& other) const {
+        return scrollOffset == other.scrollOffset && samplesPerColumn == other.samplesPerColumn && width == other.width
+            && decoded == other.decoded && peaksBuilt == other.peaksBuilt && rawSamples == other.rawSamples;
+    }
+};
+
+// Samples [start, end) of envelope column k.
+inline void columnSamples(int64_t column, double samplesPerColumn, int64_t frames, int64_t& start, int64_t& end) {
+    start = std::min(static_cast<int64_t>(column * samplesPerColumn), frames);
+    end = std::min(static_cast<int64_t>((column + 1) * samplesPerColumn), frames);
+}
+
+struct ColumnData {
+    ColumnView view;
+    // Numbers the results. The worker reuses the objects (and their vectors'
+    // capacity) once nobody holds them, so an address doesn't identify one.
+    uint64_t serial = 0;
+    // Per channel: view.columnCount() columns from view.firstColumn() when
+    // view.envelope(), else empty and samples holds the visible samples from
+    // view.scrollOffset.
+    std::vector<std::vector<Peak>> peaks;
+    std::vector<std::vector<float>> samples;
+};
+
+class ColumnWorker {
+public:
+    // Called on the worker thread when a result is ready.
+    std::function<void()> onReady;
+
+    ColumnWorker() : worker(&ColumnWorker::run, this) {}
+
+    ColumnWorker(const ColumnWorker&) = delete;
+    ColumnWorker& operator=(const ColumnWorker&) = delete;
+
+    ~ColumnWorker() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            generation.fetch_add(1);
+        }
+
+        wake.notify_one();
+        worker.join();
+    }
+
+    // What the results are computed from. Drops the current result. samples
+    // may be null while the file is decoding.
+    void setSource(std::shared_ptr<const SampleSource> source,
+                   std::vector<std::shared_ptr<const PeakPyramid>> pyramids, int64_t frames) {
+        std::lock_guard<std::mutex> lock(mutex);
+        samples = std::move(source);
+        peaks = std::move(pyramids);
+        totalSamples = frames;
+        ++sourceVersion;
+        result.reset();
+        hasRequest = false;
+        generation.fetch_add(1);
+    }
+
+    // Asks for view, cancelling any other request.
+    void request(const ColumnView& view) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (hasRequest ? pending == view : result && result->view == view) return;
+            pending = view;
+            hasRequest = true;
+            generation.fetch_add(1);
+        }
+
+        wake.notify_one();
+    }
+
+    // The newest finished result, possibly for an older view. Never blocks on
+    // the job in progress.
+    std::shared_ptr<const ColumnData> latest() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return result;
+    }
+
+private:
+    void run();
+    // Null when a newer request arrived in the meantime.
+    std::shared_ptr<ColumnData> prepare(const ColumnView& view, uint64_t job, uint64_t version, const SampleSource* source,
+                                        const std::vector<std::shared_ptr<const PeakPyramid>>& pyramids,
+                                        int64_t frames);
+    // A spare result nobody holds, or a new one.
+    std::shared_ptr<ColumnData> recycle();
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    // Bumped by every request; the running job compares it with its own.
+    std::atomic<uint64_t> generation{0};
+
+    // Guarded by mutex.
+    std::shared_ptr<const SampleSource> samples;
+    std::vector<std::shared_ptr<const PeakPyramid>> peaks;
+    int64_t totalSamples = 0;
+    // Bumped by setSource(); cached columns belong to one version.
+    uint64_t sourceVersion = 1;
+    ColumnView pending;
+    bool hasRequest = false;
+    std::shared_ptr<const ColumnData> result;
+
+    // Empties the column cache unless it holds columns of this zoom and
+    // source, and makes it hold at least 4 screens.
+    void resetCache(double samplesPerColumn, uint64_t version, size_t count, size_t channels);
+
+    struct CachedColumn {
+        int64_t column = -1;
+        Peak peak;
+    };
+
+    struct ColumnCache {
+        double samplesPerColumn = 0.0;
+        uint64_t version = 0;
+        // Slots per channel, a power of two; column k lives in slot k % capacity.
+        size_t capacity = 0;
+        std::vector<std::vector<CachedColumn>> columns;
+    };
+
+    // Worker side.
+    ColumnCache cache;
+    std::vector<float> scratch;
+    // Results handed out, for recycle(): the view and result hold one each,
+    // the job in progress another.
+    static constexpr size_t spareResults = 4;
+    std::vector<std::shared_ptr<ColumnData>> spare;
+    uint64_t serials = 0;
+    std::thread worker;
+};
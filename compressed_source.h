@@ -0,0 +1,223 @@
+#pragma once
+
+#include "../libraries/miniaudio.h"
+#include "paged_samples.h"
+#include "seek_index.h"
+#include "kernels.h"
+#include <vector>
+#include <string>
+#include <mutex>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
+
+// ---- Compressed Source ----
+// Random access into a FLAC or MP3 file without decoding all of it first.
+// Pages of PagedSampleSource::pageFrames frames are decoded when first read
+// (or prefetched ahead of playback) and kept in the page cache, within the
+// memory budget; evicted pages are simply decoded again.
+//
+// A page is decoded from the nearest point before it: for FLAC a SeekIndex
+// entry (a fresh decoder is started on that frame), for MP3 the decoder's
+// own seek table, generated when the file is opened. Reading on from where
+// the last page ended doesn't seek at all.
+class CompressedSampleSource : public PagedSampleSource {
+public:
+    // Seek points generated for MP3 files, spread over the whole file.
+    static constexpr ma_uint32 mp3SeekPoints = 4096;
+
+    ~CompressedSampleSource() override {
+        stopPrefetch();
+
+        if (opened) {
+            ma_decoder_uninit(&decoder);
+        }
+
+        if (stream.fd >= 0) {
+            ::close(stream.fd);
+        }
+    }
+
+    // Opens path if it's FLAC or MP3 of known length. index may be empty
+    // (FLAC files then seek through the decoder until setSeekIndex()).
+    bool open(const std::string& path, size_t budgetBytes, const SeekIndex& index = SeekIndex()) {
+        stream.fd = ::open(path.c_str(), O_RDONLY);
+        if (stream.fd < 0) return false;
+
+        unsigned char magic[4] = {};
+        bool readMagic = ::pread(stream.fd, magic, sizeof(magic), 0) == sizeof(magic);
+        flacFile = readMagic && std::memcmp(magic, "fLaC", 4) == 0;
+        bool mp3File = readMagic && (std::memcmp(magic, "ID3", 3) == 0 || (magic[0] == 0xff && (magic[1] & 0xe0) == 0xe0));
+
+        if (!flacFile && !mp3File) return false;
+
+        config = ma_decoder_config_init(ma_format_f32, 0, 0);
+        config.encodingFormat = flacFile ? ma_encoding_format_flac : ma_encoding_format_mp3;
+        if (mp3File) config.seekPointCount = mp3SeekPoints;
+
+        if (ma_decoder_init_file(path.c_str(), &config, &decoder) != MA_SUCCESS) return false;
+
+        opened = true;
+
+        ma_uint64 length = 0;
+        if (ma_decoder_get_length_in_pcm_frames(&decoder, &length) != MA_SUCCESS || length == 0) return false;
+
+        stream.size = static_cast<uint64_t>(::lseek(stream.fd, 0, SEEK_END));
+        rate = decoder.outputSampleRate;
+        seekIndex = index;
+        deinterleave = deinterleaveKernel().run;
+
+        allocate(decoder.outputChannels, static_cast<size_t>(length), budgetBytes);
+        interleaved = arena->allocate<float>(pageFrames * channels());
+        planes.resize(channels());
+        return true;
+    }
+
+    // All frames can be read from the start, decoding as needed.
+    size_t available() const override { return frames(); }
+    unsigned sampleRate() const { return rate; }
+    bool isFlac() const { return flacFile; }
+
+    // Seek points found after open() (see buildFlacSeekIndex()).
+    void setSeekIndex(const SeekIndex& index) {
+        std::lock_guard<std::mutex> lock(loadMutex);
+        seekIndex = index;
+    }
+
+protected:
+    void fill(Slot& slot, size_t page) const override {
+        size_t start = page * pageFrames;
+        size_t count = std::min(pageFrames, frames() - std::min(start, frames()));
+        size_t done = 0;
+
+        if (count > 0 && seekTo(start)) {
+            ma_uint64 framesRead = 0;
+            ma_decoder_read_pcm_frames(&decoder, interleaved, count, &framesRead);
+            done = static_cast<size_t>(framesRead);
+            cursor += framesRead;
+
+            for (size_t c = 0; c < planes.size(); ++c) planes[c] = slot.data + c * pageFrames;
+            deinterleave(interleaved, channels(), done, planes.data());
+        }
+        else {
+            // Decoding failed: position unknown.
+            cursor = UINT64_MAX;
+        }
+
+        // Past the end of the file, or a short read.
+        for (size_t c = 0; c < channels(); ++c) {
+            std::fill(slot.data + c * pageFrames + done, slot.data + (c + 1) * pageFrames, 0.0f);
+        }
+    }
+
+private:
+    // The file as a FLAC decoder sees it when started from a seek point: the
+    // header, then the frames from base on.
+    struct Stream {
+        int fd = -1;
+        uint64_t size = 0;
+        uint64_t headerBytes = 0;
+        uint64_t base = 0;
+        uint64_t position = 0;
+
+        uint64_t length() const { return headerBytes + (size - base); }
+    };
+
+    static ma_result readStream(ma_decoder* decoder, void* out, size_t bytes, size_t* bytesRead) {
+        Stream& stream = *static_cast<Stream*>(decoder->pUserData);
+        size_t done = 0;
+
+        while (done < bytes && stream.position < stream.length()) {
+            uint64_t at = stream.position < stream.headerBytes ? stream.position
+                                                                : stream.base + (stream.position - stream.headerBytes);
+            uint64_t end = stream.position < stream.headerBytes ? stream.headerBytes : stream.length();
+            size_t want = static_cast<size_t>(std::min<uint64_t>(bytes - done, end - stream.position));
+            ssize_t n = ::pread(stream.fd, static_cast<char*>(out) + done, want, static_cast<off_t>(at));
+
+            if (n <= 0) break;
+
+            done += static_cast<size_t>(n);
+            stream.position += static_cast<uint64_t>(n);
+        }
+
+        *bytesRead = done;
+        return done == 0 && bytes > 0 ? MA_AT_END : MA_SUCCESS;
+    }
+
+    static ma_result seekStream(ma_decoder* decoder, ma_int64 offset, ma_seek_origin origin) {
+        Stream& stream = *static_cast<Stream*>(decoder->pUserData);
+        int64_t from = origin == ma_seek_origin_start ? 0
+                     : origin == ma_seek_origin_current ? static_cast<int64_t>(stream.position)
+                     : static_cast<int64_t>(stream.length());
+        int64_t target = from + offset;
+
+        if (target < 0 || target > static_cast<int64_t>(stream.length())) return MA_INVALID_ARGS;
+
+        stream.position = static_cast<uint64_t>(target);
+        return MA_SUCCESS;
+    }
+
+    // Moves the decoder to frame. Called with loadMutex held.
+    bool seekTo(uint64_t frame) const {
+        if (frame == cursor) return true;
+
+        if (flacFile && !seekIndex.empty()) {
+            const SeekPoint* point = seekIndex.find(frame);
+
+            // Reading on is cheaper than restarting when already past the point.
+            if (!(cursor >= point->frame && cursor < frame && frame - cursor < pageFrames)) {
+                if (opened) ma_decoder_uninit(&decoder);
+
+                stream.headerBytes = seekIndex.headerBytes;
+                stream.base = point->offset;
+                stream.position = 0;
+                opened = ma_decoder_init(readStream, seekStream, &stream, &config, &decoder) == MA_SUCCESS;
+
+                if (!opened) return false;
+
+                cursor = point->frame;
+            }
+
+            return skip(frame - cursor);
+        }
+
+        if (!opened || ma_decoder_seek_to_pcm_frame(&decoder, frame) != MA_SUCCESS) return false;
+
+        cursor = frame;
+        return true;
+    }
+
+    // Decodes and drops count frames.
+    bool skip(uint64_t count) const {
+        while (count > 0) {
+            ma_uint64 wanted = std::min<uint64_t>(count, pageFrames);
+            ma_uint64 framesRead = 0;
+            ma_decoder_read_pcm_frames(&decoder, interleaved, wanted, &framesRead);
+
+            if (framesRead == 0) return false;
+
+            cursor += framesRead;
+            count -= framesRead;
+        }
+
+        return true;
+    }
+
+    // Decoder state, only touched under loadMutex.
+    mutable ma_decoder decoder;
+    mutable bool opened = false;
+    mutable Stream stream;
+    // The frame the decoder reads next.
+    mutable uint64_t cursor = 0;
+    // One page interleaved, from the arena.
+    float* interleaved = nullptr;
+    mutable std::vector<float*> planes;
+    ma_decoder_config config;
+    SeekIndex seekIndex;
+    DeinterleaveFn deinterleave = nullptr;
+    bool flacFile = false;
+    unsigned rate = 0;
+};
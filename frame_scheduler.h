@@ -0,0 +1,98 @@
+#pragma once
+
+#include "instrumentation.h"
+#include <FL/Fl.H>
+#include <functional>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+
+// ---- Frame Scheduler ----
+// The one timer behind everything that moves on screen by itself (the
+// playback cursor, live input). There is never more than one tick pending,
+// however often it is woken. Each tick asks onFrame() how long until
+// something visible changes next, e.g. until the cursor reaches its next
+// pixel column, and sleeps that long: a display refresh at most (FLTK has
+// no vsync signal, so refreshRate stands in for one; the GL swap itself
+// waits for the display), up to maxInterval when zoomed far out. When
+// nothing moves the timer stops altogether until the next wake().
+class FrameScheduler {
+public:
+    // Returns the seconds until the next tick is needed, or a negative value
+    // when nothing is moving.
+    std::function<double()> onFrame;
+
+    // Display refresh rate (Hz). The ticks come no faster than this.
+    void setRefreshRate(double hz) {
+        frameInterval = 1.0 / std::clamp(hz, 1.0, 1000.0);
+    }
+
+    double refreshInterval() const { return frameInterval; }
+
+    // Makes sure a tick comes within one refresh, bringing forward a tick
+    // that was due later. UI thread.
+    void wake() {
+        int64_t soon = now() + static_cast<int64_t>(frameInterval * 1e9);
+
+        if (armed && due <= soon) return;
+
+        Fl::remove_timeout(tick, this);
+        arm(frameInterval);
+    }
+
+    // Cancels the pending tick.
+    void stop() {
+        Fl::remove_timeout(tick, this);
+        armed = false;
+    }
+
+    bool active() const { return armed; }
+
+private:
+    static constexpr double maxInterval = 0.25;
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void arm(double seconds) {
+        armed = true;
+        requested = seconds;
+        due = now() + static_cast<int64_t>(seconds * 1e9);
+        Fl::add_timeout(seconds, tick, this);
+    }
+
+    static void tick(void* data) {
+        auto* self = static_cast<FrameScheduler*>(data);
+        self->armed = false;
+
+        // The interval since the previous tick against the one asked for; a
+        // long gap means the timer was idle, not jitter.
+        uint64_t tickTime = Instrumentation::now();
+
+        if (self->lastTick > 0 && tickTime - self->lastTick < 2 * static_cast<uint64_t>(maxInterval * 1e9)) {
+            instrumentation().record(Probe::Timer, self->lastTick, tickTime, static_cast<uint64_t>(self->requested * 1e9));
+        }
+
+        self->lastTick = tickTime;
+
+        double next = self->onFrame ? self->onFrame() : -1.0;
+
+        // onFrame() may have woken the timer itself.
+        if (next < 0.0 || self->armed) return;
+
+        next = std::clamp(next, self->frameInterval, maxInterval);
+        self->armed = true;
+        self->requested = next;
+        self->due = now() + static_cast<int64_t>(next * 1e9);
+        // From when this tick was due, so the ticks don't drift.
+        Fl::repeat_timeout(next, tick, self);
+    }
+
+    double frameInterval = 1.0 / 60.0;
+    bool armed = false;
+    // When the pending tick fires, and the interval it was set for.
+    int64_t due = 0;
+    double requested = 0.0;
+    uint64_t lastTick = 0;
+};
@@ -0,0 +1,185 @@
+#pragma once
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+
+// ---- Batch Geometry ----
+// One frame of 2D line art as a flat XY vertex list, split into batches that
+// share a primitive type, color and line width / point size.
+struct DrawBatch {
+    GLenum mode;
+    float r, g, b;
+    // Line width, or point size for GL_POINTS.
+    float size;
+    GLint first;
+    GLsizei count;
+};
+
+struct BatchGeometry {
+    std::vector<float> vertices;
+    std::vector<DrawBatch> batches;
+
+    void clear() {
+        vertices.clear();
+        batches.clear();
+    }
+
+    void reserve(size_t vertexCount) {
+        vertices.reserve(vertexCount * 2);
+    }
+
+    // Starts a new batch; following vertex() calls belong to it.
+    void begin(GLenum mode, float r, float g, float b, float size = 1.0f) {
+        batches.push_back({ mode, r, g, b, size, vertexCount(), 0 });
+    }
+
+    void vertex(float x, float y) {
+        vertices.push_back(x);
+        vertices.push_back(y);
+        batches.back().count++;
+    }
+
+    GLint vertexCount() const { return static_cast<GLint>(vertices.size() / 2); }
+};
+
+// ---- Batch Renderer ----
+// Keeps a BatchGeometry in a vertex buffer object so a frame is a handful of
+// glDrawArrays() calls instead of one driver call per vertex. The buffer is
+// only refilled when the geometry changes; a 2-vertex slot after it holds the
+// playback cursor, which is updated on its own.
+// Without GL 1.5 it falls back to immediate mode (glBegin / glVertex2f).
+class BatchRenderer {
+public:
+    // Call with the GL context current whenever it has been (re)created. Any
+    // previous buffer belonged to the old context and is simply forgotten.
+    void init() {
+        vbo = 0;
+        capacity = 0;
+        useVbo = supportsVbo();
+
+        if (useVbo) {
+            glGenBuffers(1, &vbo);
+        }
+    }
+
+    bool usingVbo() const { return useVbo; }
+
+    // Copies the geometry into the vertex buffer.
+    void upload(const BatchGeometry& geometry) {
+        if (!useVbo) return;
+
+        // Room for the cursor slot after the geometry.
+        size_t bytes = (geometry.vertices.size() + 4) * sizeof(float);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+
+        // Grow only: the buffer is reused for as long as the geometry fits.
+        if (bytes > capacity) {
+            capacity = bytes + bytes / 2;
+            glBufferData(GL_ARRAY_BUFFER, capacity, nullptr, GL_DYNAMIC_DRAW);
+        }
+
+        glBufferSubData(GL_ARRAY_BUFFER, 0, geometry.vertices.size() * sizeof(float), geometry.vertices.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        cursorFirst = geometry.vertexCount();
+    }
+
+    // Draws batches [from, to) of the geometry, all of them by default, so
+    // other drawing can go between two ranges.
+    void draw(const BatchGeometry& geometry, size_t from = 0, size_t to = SIZE_MAX) {
+        to = std::min(to, geometry.batches.size());
+
+        if (!useVbo) {
+            drawImmediate(geometry, from, to);
+            return;
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glVertexPointer(2, GL_FLOAT, 0, nullptr);
+
+        for (size_t i = from; i < to; ++i) {
+            const DrawBatch& batch = geometry.batches[i];
+            if (batch.count == 0) continue;
+            applyStyle(batch);
+            glDrawArrays(batch.mode, batch.first, batch.count);
+        }
+
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Vertical line from y0 to y1 at x, in the cursor slot.
+    void drawCursor(float x, float y0, float y1, float r, float g, float b) {
+        glColor3f(r, g, b);
+        glLineWidth(1.0f);
+
+        if (!useVbo) {
+            glBegin(GL_LINES);
+            glVertex2f(x, y0);
+            glVertex2f(x, y1);
+            glEnd();
+            return;
+        }
+
+        float line[4] = { x, y0, x, y1 };
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, cursorFirst * 2 * sizeof(float), sizeof(line), line);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glVertexPointer(2, GL_FLOAT, 0, nullptr);
+        glDrawArrays(GL_LINES, cursorFirst, 2);
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+private:
+    static bool supportsVbo() {
+        const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+        int major = 0, minor = 0;
+
+        if (version && std::sscanf(version, "%d.%d", &major, &minor) == 2) {
+            if (major > 1 || (major == 1 && minor >= 5)) return true;
+        }
+
+        const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+        return extensions && std::strstr(extensions, "GL_ARB_vertex_buffer_object");
+    }
+
+    static void applyStyle(const DrawBatch& batch) {
+        glColor3f(batch.r, batch.g, batch.b);
+
+        if (batch.mode == GL_POINTS) {
+            glPointSize(batch.size);
+        }
+        else {
+            glLineWidth(batch.size);
+        }
+    }
+
+    // The original per-vertex path, for contexts without buffer objects.
+    static void drawImmediate(const BatchGeometry& geometry, size_t from, size_t to) {
+        for (size_t i = from; i < to; ++i) {
+            const DrawBatch& batch = geometry.batches[i];
+            if (batch.count == 0) continue;
+            applyStyle(batch);
+            glBegin(batch.mode);
+
+            for (GLint i = batch.first; i < batch.first + batch.count; ++i) {
+                glVertex2f(geometry.vertices[i * 2], geometry.vertices[i * 2 + 1]);
+            }
+
+            glEnd();
+        }
+    }
+
+    GLuint vbo = 0;
+    size_t capacity = 0;
+    GLint cursorFirst = 0;
+    bool useVbo = false;
+};
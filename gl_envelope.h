@@ -0,0 +1,479 @@
+#pragma once
+
+#include "gl_batch.h"
+#include "peaks.h"
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+
+// ---- Envelope Shader ----
+// Draws the zoomed-out waveform on the GPU. Each channel's pyramid lives in a
+// texture (every level, flat as in PeakPyramid::data()) and a vertex shader
+// computes each column's min/max from it, so zooming and scrolling only
+// change uniforms. Columns narrower than a pyramid block are reduced from a
+// window of raw samples, prepared off the UI thread (ColumnView::rawSamples)
+// and uploaded as a second texture; until it arrives they read level 0.
+//
+// Matches the CPU envelope in appendWaveformChannel() (waveform_geometry.h):
+// same level choice as PeakPyramid::read(), same silence and flat-section
+// rules.
+// Needs GL 3.0 (GLSL 1.30, float textures, texelFetch); callers build the
+// envelope geometry on the CPU otherwise.
+class EnvelopeShader {
+public:
+    // pyramid indices are ints in the shader; longer files use the CPU path.
+    static constexpr int64_t maxSamples = int64_t(1) << 30;
+
+    // Call with the GL context current whenever it has been (re)created. Any
+    // previous objects belonged to the old context and are simply forgotten.
+    void init() {
+        channels.clear();
+        program = 0;
+        indexBuffer = 0;
+        indexCount = 0;
+        available = supportsShaders() && compile();
+
+        if (available) {
+            glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+            textureWidth = std::min<GLint>(maxTextureSize, 4096);
+            glGenBuffers(1, &indexBuffer);
+        }
+    }
+
+    bool supported() const { return available; }
+
+    // False when pyramid is too long for the shader or its texture, or is a
+    // rolling one (the shader indexes blocks from the start of the file).
+    bool canDraw(const PeakPyramid& pyramid) const {
+        return available && !pyramid.rolling() && static_cast<int64_t>(pyramid.samples()) < maxSamples
+            && rowsFor(pyramid.size()) <= maxTextureSize;
+    }
+
+    // Uploads the entries of channel's pyramid built since the last call (all
+    // of them when it's a different pyramid).
+    void updatePeaks(size_t channel, const PeakPyramid& pyramid) {
+        Channel& state = channelState(channel);
+        size_t ready = pyramid.available();
+
+        if (state.pyramid != &pyramid) {
+            state.pyramid = &pyramid;
+            state.uploaded = 0;
+            state.peakRows = rowsFor(pyramid.size());
+            allocate(state.peakTexture, GL_RGB32F, GL_RGB, state.peakRows);
+        }
+
+        if (ready == state.uploaded || pyramid.empty()) return;
+
+        // Per level, the entries completed by the new samples.
+        glBindTexture(GL_TEXTURE_2D, state.peakTexture);
+        size_t offset = 0;
+
+        for (size_t level = 0; level < pyramid.levelCount(); ++level) {
+            size_t size = pyramid.levelSize(level);
+            size_t block = pyramid.blockSize(level);
+            size_t first = state.uploaded / block;
+            size_t last = ready == pyramid.samples() ? size : std::min(ready / block, size);
+
+            if (last > first) upload(reinterpret_cast<const float*>(pyramid.data()), 3, GL_RGB, offset + first, offset + last);
+            offset += size;
+        }
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        state.uploaded = ready;
+    }
+
+    // Raw samples of channel from frame start, for columns narrower than a
+    // pyramid block. id (non-zero) identifies the window; the same one isn't
+    // uploaded twice.
+    void setSampleWindow(size_t channel, uint64_t id, int64_t start, const std::vector<float>& samples) {
+        Channel& state = channelState(channel);
+
+        if (state.windowId == id) return;
+
+        int rows = rowsFor(samples.size());
+
+        if (rows > state.sampleRows) {
+            state.sampleRows = rows;
+            allocate(state.sampleTexture, GL_R32F, GL_RED, rows);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, state.sampleTexture);
+        upload(samples.data(), 1, GL_RED, 0, samples.size());
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        state.windowId = id;
+        state.windowStart = start;
+        state.windowCount = static_cast<int64_t>(samples.size());
+    }
+
+    // Uploads every pyramid again on the next updatePeaks(), e.g. after they
+    // were replaced (a new one may reuse an old one's address).
+    void resetPeaks() {
+        for (Channel& state : channels) state.pyramid = nullptr;
+    }
+
+    // Forgets the sample windows (they no longer match the view).
+    void clearSampleWindows() {
+        for (Channel& state : channels) {
+            state.windowId = 0;
+            state.windowCount = 0;
+        }
+    }
+
+    // What to draw: count columns from firstColumn, the first one at x = -shift.
+    struct Columns {
+        int64_t firstColumn = 0;
+        size_t count = 0;
+        double samplesPerColumn = 1.0;
+        double shift = 0.0;
+    };
+
+    // Draws channel's envelope (updatePeaks() first) as one vertical line per
+    // column in the lane from top, height pixels tall.
+    void draw(size_t channel, const Columns& columns, float top, float height, float r, float g, float b) {
+        Channel& state = channelState(channel);
+        const PeakPyramid* pyramid = state.pyramid;
+
+        if (!pyramid || pyramid->empty() || columns.count == 0) return;
+
+        GLint levels = static_cast<GLint>(std::min<size_t>(pyramid->levelCount(), maxLevels));
+        GLint offsets[maxLevels] = {};
+        GLint sizes[maxLevels] = {};
+        size_t offset = 0;
+
+        for (GLint level = 0; level < levels; ++level) {
+            offsets[level] = static_cast<GLint>(offset);
+            sizes[level] = static_cast<GLint>(pyramid->levelSize(level));
+            offset += pyramid->levelSize(level);
+        }
+
+        // Column starts are computed from the first column's, in floats only
+        // over the width of the view, so fractional steps stay exact far
+        // into the file.
+        double step = columns.samplesPerColumn;
+        GLint integralStep = step == static_cast<double>(static_cast<GLint>(step)) ? static_cast<GLint>(step) : 0;
+        double firstStart = columns.firstColumn * step;
+        GLint firstSample = static_cast<GLint>(std::floor(firstStart));
+
+        glUseProgram(program);
+        glUniform1i(uniform("textureWidth"), textureWidth);
+        glUniform1i(uniform("levelCount"), levels);
+        glUniform1iv(uniform("levelOffsets"), levels, offsets);
+        glUniform1iv(uniform("levelSizes"), levels, sizes);
+        glUniform1i(uniform("totalSamples"), static_cast<GLint>(pyramid->samples()));
+        glUniform1i(uniform("readySamples"), static_cast<GLint>(state.uploaded));
+        glUniform1i(uniform("firstColumn"), static_cast<GLint>(columns.firstColumn));
+        glUniform1i(uniform("firstSample"), firstSample);
+        glUniform1f(uniform("firstFraction"), static_cast<float>(firstStart - firstSample));
+        glUniform1f(uniform("samplesPerColumn"), static_cast<float>(step));
+        glUniform1i(uniform("integralStep"), integralStep);
+        glUniform1f(uniform("shift"), static_cast<float>(columns.shift));
+        glUniform1i(uniform("windowStart"), static_cast<GLint>(state.windowStart));
+        glUniform1i(uniform("windowCount"), static_cast<GLint>(state.windowCount));
+        glUniform1f(uniform("laneTop"), top);
+        glUniform1f(uniform("laneHeight"), height);
+        glUniform3f(uniform("color"), r, g, b);
+        glUniform1i(uniform("peakTexture"), 0);
+        glUniform1i(uniform("sampleTexture"), 1);
+
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, state.sampleTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, state.peakTexture);
+
+        bindIndices(columns.count * 2);
+        glLineWidth(1.0f);
+        glDrawArrays(GL_LINES, 0, static_cast<GLsizei>(columns.count * 2));
+        glDisableVertexAttribArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glUseProgram(0);
+    }
+
+private:
+    static constexpr int maxLevels = 32;
+
+    struct Channel {
+        const PeakPyramid* pyramid = nullptr;
+        // Samples of the pyramid whose entries are in peakTexture.
+        size_t uploaded = 0;
+        GLuint peakTexture = 0;
+        int peakRows = 0;
+        GLuint sampleTexture = 0;
+        int sampleRows = 0;
+        uint64_t windowId = 0;
+        int64_t windowStart = 0;
+        int64_t windowCount = 0;
+    };
+
+    Channel& channelState(size_t channel) {
+        if (channel >= channels.size()) channels.resize(channel + 1);
+        return channels[channel];
+    }
+
+    // Texels in rows of textureWidth.
+    int rowsFor(size_t texels) const {
+        return static_cast<int>(std::max<size_t>((texels + textureWidth - 1) / textureWidth, 1));
+    }
+
+    void allocate(GLuint& texture, GLenum internalFormat, GLenum format, int rows) {
+        if (!texture) glGenTextures(1, &texture);
+
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, textureWidth, rows, 0, format, GL_FLOAT, nullptr);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Texels [first, last) of data (components floats each) into the bound
+    // texture, where texel i sits at (i % textureWidth, i / textureWidth).
+    void upload(const float* data, size_t components, GLenum format, size_t first, size_t last) {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        while (first < last) {
+            size_t row = first / textureWidth;
+            size_t column = first % textureWidth;
+            // A partial row, or as many whole rows as there are.
+            size_t rows = column == 0 ? std::max<size_t>((last - first) / textureWidth, 1) : 1;
+            size_t count = std::min(rows * textureWidth - column, last - first);
+
+            if (rows > 1) {
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, static_cast<GLint>(row), textureWidth, static_cast<GLsizei>(rows),
+                                format, GL_FLOAT, data + first * components);
+            }
+            else {
+                glTexSubImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(column), static_cast<GLint>(row),
+                                static_cast<GLsizei>(count), 1, format, GL_FLOAT, data + first * components);
+            }
+
+            first += count;
+        }
+    }
+
+    // Vertex i of the draw gets the attribute value i.
+    void bindIndices(size_t count) {
+        glBindBuffer(GL_ARRAY_BUFFER, indexBuffer);
+
+        if (count > indexCount) {
+            indexCount = count + count / 2;
+            std::vector<float> indices(indexCount);
+            for (size_t i = 0; i < indexCount; ++i) indices[i] = static_cast<float>(i);
+            glBufferData(GL_ARRAY_BUFFER, indexCount * sizeof(float), indices.data(), GL_STATIC_DRAW);
+        }
+
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, 0, nullptr);
+    }
+
+    GLint uniform(const char* name) const {
+        return glGetUniformLocation(program, name);
+    }
+
+    bool compile() {
+        static const char* vertexSource = R"(#version 130
+in float vertexIndex;
+
+uniform sampler2D peakTexture;
+uniform sampler2D sampleTexture;
+uniform int textureWidth;
+uniform int levelCount;
+uniform int levelOffsets[32];
+uniform int levelSizes[32];
+uniform int totalSamples;
+uniform int readySamples;
+uniform int firstColumn;
+uniform int firstSample;
+uniform float firstFraction;
+uniform float samplesPerColumn;
+uniform int integralStep;
+uniform float shift;
+uniform int windowStart;
+uniform int windowCount;
+uniform float laneTop;
+uniform float laneHeight;
+
+const int baseBlockSize = 256;
+
+ivec2 texel(int index) {
+    return ivec2(index % textureWidth, index / textureWidth);
+}
+
+// Start of the column index columns after firstColumn.
+int columnStart(int index) {
+    int start = integralStep > 0 ? (firstColumn + index) * integralStep
+                                 : firstSample + int(floor(firstFraction + float(index) * samplesPerColumn));
+    return clamp(start, 0, totalSamples);
+}
+
+// PeakPyramid::read(): min, max and absMax of [start, end).
+vec3 readPyramid(int start, int end) {
+    vec3 peak = vec3(1.0, -1.0, 0.0);
+    int span = end - start;
+    int level = 0;
+
+    while (level + 1 < levelCount && (baseBlockSize << (level + 1)) <= span) {
+        ++level;
+    }
+
+    for (int finer = level; finer >= max(level - 2, 0); --finer) {
+        int size = baseBlockSize << finer;
+
+        if (start % size == 0 && (end % size == 0 || end == totalSamples)) {
+            level = finer;
+            break;
+        }
+    }
+
+    int size = baseBlockSize << level;
+    int first = start / size;
+    int last = min((end + size - 1) / size, levelSizes[level]);
+
+    if (readySamples < totalSamples) {
+        last = min(last, readySamples / size);
+    }
+
+    for (int b = first; b < last && b < first + 16; ++b) {
+        vec3 entry = texelFetch(peakTexture, texel(levelOffsets[level] + b), 0).rgb;
+        peak = vec3(min(peak.x, entry.x), max(peak.y, entry.y), max(peak.z, entry.z));
+    }
+
+    return peak;
+}
+
+vec3 scanSamples(int start, int end) {
+    vec3 peak = vec3(1.0, -1.0, 0.0);
+
+    for (int i = start; i < end; ++i) {
+        float s = texelFetch(sampleTexture, texel(i - windowStart), 0).r;
+        peak = vec3(min(peak.x, s), max(peak.y, s), peak.z);
+    }
+
+    peak.z = max(peak.y, -peak.x);
+    return peak;
+}
+
+void main() {
+    int index = int(vertexIndex);
+    int column = index / 2;
+    bool top = index % 2 == 1;
+    int start = columnStart(column);
+    int end = columnStart(column + 1);
+    vec3 peak;
+
+    // Past the end of the file: nothing, both ends outside the clip volume.
+    if (start >= end) {
+        gl_Position = vec4(2.0, 2.0, 0.0, 1.0);
+        return;
+    }
+
+    if (end - start < baseBlockSize && start >= windowStart && end <= windowStart + windowCount) {
+        peak = scanSamples(start, end);
+    }
+    else {
+        peak = readPyramid(start, end);
+    }
+
+    float x = float(column) - shift;
+    float y;
+
+    if (peak.z <= 0.005) {
+        // Silent: a flat 1-pixel line at zero.
+        y = laneTop + laneHeight / 2.0;
+        if (top) x += 1.0;
+    }
+    else {
+        float lo = peak.x;
+        float hi = peak.y;
+
+        // Pad near-flat sections so they don't disappear.
+        if (abs(hi - lo) < 0.01) {
+            lo -= 0.005;
+            hi += 0.005;
+        }
+
+        y = laneTop + (1.0 - clamp(top ? hi : lo, -1.0, 1.0)) * (laneHeight / 2.0);
+    }
+
+    gl_Position = gl_ModelViewProjectionMatrix * vec4(x, y, 0.0, 1.0);
+}
+)";
+
+        static const char* fragmentSource = R"(#version 130
+uniform vec3 color;
+
+void main() {
+    gl_FragColor = vec4(color, 1.0);
+}
+)";
+
+        GLuint vertex = compileShader(GL_VERTEX_SHADER, vertexSource);
+        GLuint fragment = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+
+        if (!vertex || !fragment) return false;
+
+        program = glCreateProgram();
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
+        glBindAttribLocation(program, 0, "vertexIndex");
+        glLinkProgram(program);
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+        if (!linked) {
+            char log[1024] = {};
+            glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+            std::cerr << "Envelope shader failed to link: " << log << std::endl;
+            glDeleteProgram(program);
+            program = 0;
+            return false;
+        }
+
+        return true;
+    }
+
+    static GLuint compileShader(GLenum type, const char* source) {
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, nullptr);
+        glCompileShader(shader);
+
+        GLint compiled = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+
+        if (!compiled) {
+            char log[1024] = {};
+            glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+            std::cerr << "Envelope shader failed to compile: " << log << std::endl;
+            glDeleteShader(shader);
+            return 0;
+        }
+
+        return shader;
+    }
+
+    static bool supportsShaders() {
+        const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+        int major = 0, minor = 0;
+
+        return version && std::sscanf(version, "%d.%d", &major, &minor) == 2 && major >= 3;
+    }
+
+    std::vector<Channel> channels;
+    GLuint program = 0;
+    GLuint indexBuffer = 0;
+    size_t indexCount = 0;
+    GLint textureWidth = 4096;
+    GLint maxTextureSize = 0;
+    bool available = false;
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "gl_batch.h"
+#include <cstring>
+#include <cstdio>
+
+// ---- Layer Cache ----
+// Offscreen texture (through a framebuffer object) holding a rendered layer,
+// e.g. the waveform without the cursor. While the layer is unchanged a frame
+// is one textured quad instead of a replay of all its geometry.
+// Needs GL 3.0 or ARB_framebuffer_object; callers draw directly otherwise.
+class LayerCache {
+public:
+    // Call with the GL context current whenever it has been (re)created. Any
+    // previous objects belonged to the old context and are simply forgotten.
+    void init() {
+        fbo = 0;
+        texture = 0;
+        width = height = 0;
+        filled = false;
+        available = supportsFbo();
+    }
+
+    bool supported() const { return available; }
+    bool holds(int w, int h) const { return filled && w == width && h == height; }
+
+    // Redirects drawing into the layer, resized to w x h. Returns false if the
+    // layer can't be used, in which case nothing is redirected.
+    bool begin(int w, int h) {
+        if (!available || w <= 0 || h <= 0) return false;
+
+        if (!fbo) {
+            glGenFramebuffers(1, &fbo);
+            glGenTextures(1, &texture);
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+        if (w != width || h != height) {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                // Don't try again on this context.
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                available = false;
+                return false;
+            }
+
+            width = w;
+            height = h;
+        }
+
+        filled = false;
+        return true;
+    }
+
+    // Returns drawing to the window.
+    void end() {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        filled = true;
+    }
+
+    // Draws the layer over the whole viewport (pixel coordinates 0..w, 0..h).
+    void present() const {
+        glEnable(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+
+        glBegin(GL_QUADS);
+        glTexCoord2f(0.0f, 0.0f); glVertex2f(0.0f, 0.0f);
+        glTexCoord2f(1.0f, 0.0f); glVertex2f((float)width, 0.0f);
+        glTexCoord2f(1.0f, 1.0f); glVertex2f((float)width, (float)height);
+        glTexCoord2f(0.0f, 1.0f); glVertex2f(0.0f, (float)height);
+        glEnd();
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glDisable(GL_TEXTURE_2D);
+    }
+
+private:
+    static bool supportsFbo() {
+        const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+        int major = 0, minor = 0;
+
+        if (version && std::sscanf(version, "%d.%d", &major, &minor) == 2 && major >= 3) return true;
+
+        const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+        return extensions && std::strstr(extensions, "GL_ARB_framebuffer_object");
+    }
+
+    GLuint fbo = 0;
+    GLuint texture = 0;
+    int width = 0;
+    int height = 0;
+    bool filled = false;
+    bool available = false;
+};
@@ -0,0 +1,241 @@
+#pragma once
+
+#include "spsc_queue.h"
+#include <vector>
+#include <deque>
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <iostream>
+
+// ---- Instrumentation ----
+// Timings of the UI and audio hot paths. Each thread records into its own
+// wait-free ring, so probes cost a clock read and a push, even in the audio
+// callback. The UI thread collects them into one-second windows (shown by
+// the waveform view's HUD) and, when tracing, into a bounded log that is
+// written to a CSV or Chrome trace file.
+enum class Probe : uint8_t {
+    Draw,      // The whole of WaveformView::draw().
+    Envelope,  // Geometry rebuild and upload.
+    Submit,    // Waveform layer render and present (CPU side).
+    Cursor,    // Playback cursor.
+    Callback,  // Audio callback; budget is the buffer's duration.
+    Timer,     // Frame scheduler tick; duration is the interval since the last one.
+    Count
+};
+
+inline const char* probeName(Probe probe) {
+    switch (probe) {
+        case Probe::Draw: return "draw";
+        case Probe::Envelope: return "envelope";
+        case Probe::Submit: return "submit";
+        case Probe::Cursor: return "cursor";
+        case Probe::Callback: return "callback";
+        case Probe::Timer: return "timer";
+        default: return "?";
+    }
+}
+
+struct ProbeEvent {
+    Probe probe = Probe::Draw;
+    // Nanoseconds on the steady clock.
+    uint64_t start = 0;
+    uint64_t duration = 0;
+    // What duration should stay under (0 for none).
+    uint64_t budget = 0;
+};
+
+class Instrumentation {
+public:
+    // Events kept for export; the oldest go first.
+    static constexpr size_t traceCapacity = 1 << 20;
+
+    static uint64_t now() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // Producer side. Callback events come from the audio thread, the others
+    // from the UI thread.
+    void record(Probe probe, uint64_t start, uint64_t end, uint64_t budget = 0) {
+        ProbeEvent event;
+        event.probe = probe;
+        event.start = start;
+        event.duration = end - start;
+        event.budget = budget;
+
+        auto& ring = probe == Probe::Callback ? audioEvents : uiEvents;
+
+        if (!ring.push(event)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Audio thread: the device was starved or the callback ran late.
+    void underrun() {
+        underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Keeps every collected event for exportTrace().
+    void setTracing(bool enabled) { tracing = enabled; }
+
+    // Consumer side (UI thread): drains both rings.
+    void collect() {
+        ProbeEvent event;
+
+        while (uiEvents.pop(event)) add(event);
+        while (audioEvents.pop(event)) add(event);
+    }
+
+    // Per probe over the last complete second, in milliseconds.
+    struct Stats {
+        double mean = 0.0;
+        double max = 0.0;
+        // The largest distance from the budget (timer jitter).
+        double jitter = 0.0;
+        // Events over budget.
+        size_t late = 0;
+        size_t count = 0;
+    };
+
+    const Stats& stats(Probe probe) const { return published[static_cast<size_t>(probe)]; }
+    size_t underrunCount() const { return underruns.load(std::memory_order_relaxed); }
+    size_t droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+    // Text lines for the HUD.
+    std::vector<std::string> summary() const {
+        std::vector<std::string> lines;
+        char line[160];
+
+        for (Probe probe : { Probe::Draw, Probe::Envelope, Probe::Submit, Probe::Cursor }) {
+            const Stats& s = stats(probe);
+            std::snprintf(line, sizeof(line), "%-8s %6.2f ms avg %6.2f max  %zu/s",
+                          probeName(probe), s.mean, s.max, s.count);
+            lines.push_back(line);
+        }
+
+        const Stats& callback = stats(Probe::Callback);
+        std::snprintf(line, sizeof(line), "callback %6.2f ms avg %6.2f max  %zu late  %zu underruns",
+                      callback.mean, callback.max, callback.late, underrunCount());
+        lines.push_back(line);
+
+        const Stats& timer = stats(Probe::Timer);
+        std::snprintf(line, sizeof(line), "timer    %6.2f ms avg %6.2f jitter  %zu/s", timer.mean, timer.jitter, timer.count);
+        lines.push_back(line);
+
+        return lines;
+    }
+
+    // Writes the traced events: CSV when path ends in .csv, else the Chrome
+    // trace event format (chrome://tracing, Perfetto).
+    bool exportTrace(const std::string& path) const {
+        std::ofstream out(path);
+
+        if (!out) {
+            std::cerr << "Failed to write trace: " << path << std::endl;
+            return false;
+        }
+
+        bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+        // Times are relative to the earliest event; the two rings interleave.
+        uint64_t origin = UINT64_MAX;
+        for (const ProbeEvent& event : trace) origin = std::min(origin, event.start);
+        out << std::fixed << std::setprecision(3);
+
+        if (csv) {
+            out << "probe,start_us,duration_us,budget_us\n";
+
+            for (const ProbeEvent& event : trace) {
+                out << probeName(event.probe) << ',' << (event.start - origin) / 1000.0 << ','
+                    << event.duration / 1000.0 << ',' << event.budget / 1000.0 << '\n';
+            }
+        }
+        else {
+            out << "{\"traceEvents\":[\n";
+
+            for (size_t i = 0; i < trace.size(); ++i) {
+                const ProbeEvent& event = trace[i];
+                // The audio callback on its own track.
+                int thread = event.probe == Probe::Callback ? 2 : 1;
+
+                out << "{\"name\":\"" << probeName(event.probe) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread
+                    << ",\"ts\":" << (event.start - origin) / 1000.0 << ",\"dur\":" << event.duration / 1000.0
+                    << ",\"args\":{\"budget_us\":" << event.budget / 1000.0 << "}}"
+                    << (i + 1 < trace.size() ? ",\n" : "\n");
+            }
+
+            out << "]}\n";
+        }
+
+        return static_cast<bool>(out);
+    }
+
+private:
+    struct Window {
+        double total = 0.0;
+        double max = 0.0;
+        double jitter = 0.0;
+        size_t late = 0;
+        size_t count = 0;
+    };
+
+    void add(const ProbeEvent& event) {
+        // One-second windows; the HUD shows the last complete one.
+        if (event.start >= windowStart + 1000000000ull) {
+            for (size_t p = 0; p < windows.size(); ++p) {
+                const Window& w = windows[p];
+                Stats& s = published[p];
+                s.mean = w.count ? w.total / w.count : 0.0;
+                s.max = w.max;
+                s.jitter = w.jitter;
+                s.late = w.late;
+                s.count = w.count;
+                windows[p] = Window();
+            }
+
+            windowStart = event.start;
+        }
+
+        Window& w = windows[static_cast<size_t>(event.probe)];
+        double ms = event.duration / 1e6;
+        w.total += ms;
+        w.max = std::max(w.max, ms);
+        w.count += 1;
+
+        if (event.budget > 0) {
+            double budget = event.budget / 1e6;
+            w.jitter = std::max(w.jitter, std::abs(ms - budget));
+            if (ms > budget) w.late += 1;
+        }
+
+        if (tracing) {
+            if (trace.size() == traceCapacity) trace.pop_front();
+            trace.push_back(event);
+        }
+    }
+
+    SpscQueue<ProbeEvent, 4096> uiEvents;
+    SpscQueue<ProbeEvent, 4096> audioEvents;
+    std::atomic<size_t> underruns{0};
+    std::atomic<size_t> dropped{0};
+
+    // UI thread.
+    bool tracing = false;
+    uint64_t windowStart = 0;
+    std::vector<Window> windows = std::vector<Window>(static_cast<size_t>(Probe::Count));
+    std::vector<Stats> published = std::vector<Stats>(static_cast<size_t>(Probe::Count));
+    std::deque<ProbeEvent> trace;
+};
+
+// The process-wide instance.
+inline Instrumentation& instrumentation() {
+    static Instrumentation instance;
+    return instance;
+}
@@ -0,0 +1,635 @@
+#pragma once
+
+#include <cstddef>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AV_KERNELS_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#define AV_KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+// ---- SIMD Kernels ----
+// Hot inner loops with one implementation per instruction set. The best one
+// the CPU supports is picked once at runtime, so a generic build still uses
+// AVX2 where it's available (x86 kernels are compiled with target attributes
+// rather than global -m flags).
+
+// Smallest and largest of count samples. Empty input gives +inf / -inf.
+using MinMaxFn = void (*)(const float* samples, size_t count, float& min, float& max);
+
+inline void minMaxScalar(const float* samples, size_t count, float& min, float& max) {
+    float lo = std::numeric_limits<float>::infinity();
+    float hi = -lo;
+
+    for (size_t i = 0; i < count; ++i) {
+        lo = std::min(lo, samples[i]);
+        hi = std::max(hi, samples[i]);
+    }
+
+    min = lo;
+    max = hi;
+}
+
+#if AV_KERNELS_X86
+// SSE2 is part of x86-64, so this one needs no runtime check there.
+__attribute__((target("sse2")))
+inline void minMaxSse2(const float* samples, size_t count, float& min, float& max) {
+    __m128 lo0 = _mm_set1_ps(std::numeric_limits<float>::infinity());
+    __m128 hi0 = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+    __m128 lo1 = lo0, hi1 = hi0;
+    size_t i = 0;
+
+    // Two independent accumulators hide the min/max latency.
+    for (; i + 8 <= count; i += 8) {
+        __m128 a = _mm_loadu_ps(samples + i);
+        __m128 b = _mm_loadu_ps(samples + i + 4);
+        lo0 = _mm_min_ps(lo0, a);
+        hi0 = _mm_max_ps(hi0, a);
+        lo1 = _mm_min_ps(lo1, b);
+        hi1 = _mm_max_ps(hi1, b);
+    }
+
+    lo0 = _mm_min_ps(lo0, lo1);
+    hi0 = _mm_max_ps(hi0, hi1);
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, lo0);
+    float lo = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+    _mm_storeu_ps(lanes, hi0);
+    float hi = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+
+    for (; i < count; ++i) {
+        lo = std::min(lo, samples[i]);
+        hi = std::max(hi, samples[i]);
+    }
+
+    min = lo;
+    max = hi;
+}
+
+__attribute__((target("avx2")))
+inline void minMaxAvx2(const float* samples, size_t count, float& min, float& max) {
+    __m256 lo0 = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    __m256 hi0 = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+    __m256 lo1 = lo0, hi1 = hi0, lo2 = lo0, hi2 = hi0, lo3 = lo0, hi3 = hi0;
+    size_t i = 0;
+
+    // 32 samples per iteration over four accumulator pairs.
+    for (; i + 32 <= count; i += 32) {
+        __m256 a = _mm256_loadu_ps(samples + i);
+        __m256 b = _mm256_loadu_ps(samples + i + 8);
+        __m256 c = _mm256_loadu_ps(samples + i + 16);
+        __m256 d = _mm256_loadu_ps(samples + i + 24);
+        lo0 = _mm256_min_ps(lo0, a);
+        hi0 = _mm256_max_ps(hi0, a);
+        lo1 = _mm256_min_ps(lo1, b);
+        hi1 = _mm256_max_ps(hi1, b);
+        lo2 = _mm256_min_ps(lo2, c);
+        hi2 = _mm256_max_ps(hi2, c);
+        lo3 = _mm256_min_ps(lo3, d);
+        hi3 = _mm256_max_ps(hi3, d);
+    }
+
+    for (; i + 8 <= count; i += 8) {
+        __m256 a = _mm256_loadu_ps(samples + i);
+        lo0 = _mm256_min_ps(lo0, a);
+        hi0 = _mm256_max_ps(hi0, a);
+    }
+
+    lo0 = _mm256_min_ps(_mm256_min_ps(lo0, lo1), _mm256_min_ps(lo2, lo3));
+    hi0 = _mm256_max_ps(_mm256_max_ps(hi0, hi1), _mm256_max_ps(hi2, hi3));
+
+    // Fold 8 lanes down to 1.
+    __m128 lo4 = _mm_min_ps(_mm256_castps256_ps128(lo0), _mm256_extractf128_ps(lo0, 1));
+    __m128 hi4 = _mm_max_ps(_mm256_castps256_ps128(hi0), _mm256_extractf128_ps(hi0, 1));
+    lo4 = _mm_min_ps(lo4, _mm_movehl_ps(lo4, lo4));
+    hi4 = _mm_max_ps(hi4, _mm_movehl_ps(hi4, hi4));
+    lo4 = _mm_min_ss(lo4, _mm_shuffle_ps(lo4, lo4, 1));
+    hi4 = _mm_max_ss(hi4, _mm_shuffle_ps(hi4, hi4, 1));
+
+    float lo = _mm_cvtss_f32(lo4);
+    float hi = _mm_cvtss_f32(hi4);
+
+    for (; i < count; ++i) {
+        lo = std::min(lo, samples[i]);
+        hi = std::max(hi, samples[i]);
+    }
+
+    min = lo;
+    max = hi;
+}
+#endif
+
+#if AV_KERNELS_NEON
+inline void minMaxNeon(const float* samples, size_t count, float& min, float& max) {
+    float32x4_t lo0 = vdupq_n_f32(std::numeric_limits<float>::infinity());
+    float32x4_t hi0 = vdupq_n_f32(-std::numeric_limits<float>::infinity());
+    float32x4_t lo1 = lo0, hi1 = hi0;
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        float32x4_t a = vld1q_f32(samples + i);
+        float32x4_t b = vld1q_f32(samples + i + 4);
+        lo0 = vminq_f32(lo0, a);
+        hi0 = vmaxq_f32(hi0, a);
+        lo1 = vminq_f32(lo1, b);
+        hi1 = vmaxq_f32(hi1, b);
+    }
+
+    lo0 = vminq_f32(lo0, lo1);
+    hi0 = vmaxq_f32(hi0, hi1);
+
+    float lanes[4];
+    vst1q_f32(lanes, lo0);
+    float lo = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+    vst1q_f32(lanes, hi0);
+    float hi = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+
+    for (; i < count; ++i) {
+        lo = std::min(lo, samples[i]);
+        hi = std::max(hi, samples[i]);
+    }
+
+    min = lo;
+    max = hi;
+}
+#endif
+
+struct MinMaxKernel {
+    const char* name;
+    MinMaxFn run;
+};
+
+inline MinMaxKernel selectMinMaxKernel() {
+#if AV_KERNELS_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) return { "avx2", minMaxAvx2 };
+    if (__builtin_cpu_supports("sse2")) return { "sse2", minMaxSse2 };
+#elif AV_KERNELS_NEON
+    return { "neon", minMaxNeon };
+#endif
+
+    return { "scalar", minMaxScalar };
+}
+
+// The kernel used by scanPeak(), chosen on first use.
+inline const MinMaxKernel& minMaxKernel() {
+    static const MinMaxKernel kernel = selectMinMaxKernel();
+    return kernel;
+}
+
+// Sum of a[i] * b[i], e.g. one output of an FIR filter.
+using DotFn = float (*)(const float* a, const float* b, size_t count);
+
+inline float dotScalar(const float* a, const float* b, size_t count) {
+    float sum = 0.0f;
+
+    for (size_t i = 0; i < count; ++i) {
+        sum += a[i] * b[i];
+    }
+
+    return sum;
+}
+
+#if AV_KERNELS_X86
+__attribute__((target("sse2")))
+inline float dotSse2(const float* a, const float* b, size_t count) {
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(sum0, sum1));
+    float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+
+    return sum + dotScalar(a + i, b + i, count - i);
+}
+
+__attribute__((target("avx2,fma")))
+inline float dotAvx2(const float* a, const float* b, size_t count) {
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+        sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum1);
+    }
+
+    for (; i + 8 <= count; i += 8) {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+    }
+
+    sum0 = _mm256_add_ps(sum0, sum1);
+    __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(sum0), _mm256_extractf128_ps(sum0, 1));
+    sum4 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+    sum4 = _mm_add_ss(sum4, _mm_shuffle_ps(sum4, sum4, 1));
+
+    return _mm_cvtss_f32(sum4) + dotScalar(a + i, b + i, count - i);
+}
+#endif
+
+#if AV_KERNELS_NEON
+inline float dotNeon(const float* a, const float* b, size_t count) {
+    float32x4_t sum0 = vdupq_n_f32(0.0f);
+    float32x4_t sum1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        sum0 = vmlaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+        sum1 = vmlaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+
+    float lanes[4];
+    vst1q_f32(lanes, vaddq_f32(sum0, sum1));
+    float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+
+    return sum + dotScalar(a + i, b + i, count - i);
+}
+#endif
+
+struct DotKernel {
+    const char* name;
+    DotFn run;
+};
+
+inline DotKernel selectDotKernel() {
+#if AV_KERNELS_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return { "avx2", dotAvx2 };
+    if (__builtin_cpu_supports("sse2")) return { "sse2", dotSse2 };
+#elif AV_KERNELS_NEON
+    return { "neon", dotNeon };
+#endif
+
+    return { "scalar", dotScalar };
+}
+
+// The kernel used by the resampler, chosen on first use.
+inline const DotKernel& dotKernel() {
+    static const DotKernel kernel = selectDotKernel();
+    return kernel;
+}
+
+// Largest magnitude of a polyphase FIR's output: every phase of filter
+// (phases rows of taps coefficients) at each of count positions of input,
+// which holds count + taps - 1 samples. Used for true peak (4x oversampling).
+using PolyphasePeakFn = float (*)(const float* input, size_t count, const float* filter, size_t phases, size_t taps);
+
+inline float polyphasePeakScalar(const float* input, size_t count, const float* filter, size_t phases, size_t taps) {
+    float peak = 0.0f;
+
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t p = 0; p < phases; ++p) {
+            const float* row = filter + p * taps;
+            float sum = 0.0f;
+
+            for (size_t t = 0; t < taps; ++t) sum += row[t] * input[i + t];
+
+            peak = std::max(peak, std::abs(sum));
+        }
+    }
+
+    return peak;
+}
+
+#if AV_KERNELS_X86
+// 4 (or 8) positions at once: each tap is broadcast and multiplied with the
+// input shifted by that tap.
+__attribute__((target("sse2")))
+inline float polyphasePeakSse2(const float* input, size_t count, const float* filter, size_t phases, size_t taps) {
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 peak4 = _mm_setzero_ps();
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        for (size_t p = 0; p < phases; ++p) {
+            const float* row = filter + p * taps;
+            __m128 sum = _mm_setzero_ps();
+
+            for (size_t t = 0; t < taps; ++t) {
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(row[t]), _mm_loadu_ps(input + i + t)));
+            }
+
+            peak4 = _mm_max_ps(peak4, _mm_andnot_ps(sign, sum));
+        }
+    }
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, peak4);
+    float peak = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+
+    return std::max(peak, polyphasePeakScalar(input + i, count - i, filter, phases, taps));
+}
+
+__attribute__((target("avx2,fma")))
+inline float polyphasePeakAvx2(const float* input, size_t count, const float* filter, size_t phases, size_t taps) {
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 peak8 = _mm256_setzero_ps();
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        for (size_t p = 0; p < phases; ++p) {
+            const float* row = filter + p * taps;
+            __m256 sum0 = _mm256_setzero_ps();
+            __m256 sum1 = _mm256_setzero_ps();
+            size_t t = 0;
+
+            // Two chains, so consecutive FMAs don't wait on each other.
+            for (; t + 2 <= taps; t += 2) {
+                sum0 = _mm256_fmadd_ps(_mm256_set1_ps(row[t]), _mm256_loadu_ps(input + i + t), sum0);
+                sum1 = _mm256_fmadd_ps(_mm256_set1_ps(row[t + 1]), _mm256_loadu_ps(input + i + t + 1), sum1);
+            }
+
+            if (t < taps) sum0 = _mm256_fmadd_ps(_mm256_set1_ps(row[t]), _mm256_loadu_ps(input + i + t), sum0);
+
+            peak8 = _mm256_max_ps(peak8, _mm256_andnot_ps(sign, _mm256_add_ps(sum0, sum1)));
+        }
+    }
+
+    __m128 peak4 = _mm_max_ps(_mm256_castps256_ps128(peak8), _mm256_extractf128_ps(peak8, 1));
+    peak4 = _mm_max_ps(peak4, _mm_movehl_ps(peak4, peak4));
+    peak4 = _mm_max_ss(peak4, _mm_shuffle_ps(peak4, peak4, 1));
+
+    return std::max(_mm_cvtss_f32(peak4), polyphasePeakScalar(input + i, count - i, filter, phases, taps));
+}
+#endif
+
+#if AV_KERNELS_NEON
+inline float polyphasePeakNeon(const float* input, size_t count, const float* filter, size_t phases, size_t taps) {
+    float32x4_t peak4 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        for (size_t p = 0; p < phases; ++p) {
+            const float* row = filter + p * taps;
+            float32x4_t sum = vdupq_n_f32(0.0f);
+
+            for (size_t t = 0; t < taps; ++t) {
+                sum = vmlaq_n_f32(sum, vld1q_f32(input + i + t), row[t]);
+            }
+
+            peak4 = vmaxq_f32(peak4, vabsq_f32(sum));
+        }
+    }
+
+    float lanes[4];
+    vst1q_f32(lanes, peak4);
+    float peak = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+
+    return std::max(peak, polyphasePeakScalar(input + i, count - i, filter, phases, taps));
+}
+#endif
+
+struct PolyphasePeakKernel {
+    const char* name;
+    PolyphasePeakFn run;
+};
+
+inline PolyphasePeakKernel selectPolyphasePeakKernel() {
+#if AV_KERNELS_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return { "avx2", polyphasePeakAvx2 };
+    if (__builtin_cpu_supports("sse2")) return { "sse2", polyphasePeakSse2 };
+#elif AV_KERNELS_NEON
+    return { "neon", polyphasePeakNeon };
+#endif
+
+    return { "scalar", polyphasePeakScalar };
+}
+
+// The kernel used for true peak (see LevelTrack), chosen on first use.
+inline const PolyphasePeakKernel& polyphasePeakKernel() {
+    static const PolyphasePeakKernel kernel = selectPolyphasePeakKernel();
+    return kernel;
+}
+
+// Interleaves count frames of two planar channels into out (L R L R ...).
+// left and right may be the same pointer (mono played on both sides).
+using ZipFn = void (*)(const float* left, const float* right, float* out, size_t count);
+
+inline void zipScalar(const float* left, const float* right, float* out, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        out[i * 2] = left[i];
+        out[i * 2 + 1] = right[i];
+    }
+}
+
+#if AV_KERNELS_X86
+__attribute__((target("sse2")))
+inline void zipSse2(const float* left, const float* right, float* out, size_t count) {
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 l = _mm_loadu_ps(left + i);
+        __m128 r = _mm_loadu_ps(right + i);
+        _mm_storeu_ps(out + i * 2, _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(out + i * 2 + 4, _mm_unpackhi_ps(l, r));
+    }
+
+    zipScalar(left + i, right + i, out + i * 2, count - i);
+}
+
+__attribute__((target("avx2")))
+inline void zipAvx2(const float* left, const float* right, float* out, size_t count) {
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256 l = _mm256_loadu_ps(left + i);
+        __m256 r = _mm256_loadu_ps(right + i);
+        // Unpacking works within 128-bit halves: frames 0,1 | 4,5 and 2,3 | 6,7.
+        __m256 lo = _mm256_unpacklo_ps(l, r);
+        __m256 hi = _mm256_unpackhi_ps(l, r);
+        _mm256_storeu_ps(out + i * 2, _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(out + i * 2 + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+
+    zipScalar(left + i, right + i, out + i * 2, count - i);
+}
+#endif
+
+#if AV_KERNELS_NEON
+inline void zipNeon(const float* left, const float* right, float* out, size_t count) {
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        float32x4x2_t frames = { { vld1q_f32(left + i), vld1q_f32(right + i) } };
+        // Interleaving store.
+        vst2q_f32(out + i * 2, frames);
+    }
+
+    zipScalar(left + i, right + i, out + i * 2, count - i);
+}
+#endif
+
+struct ZipKernel {
+    const char* name;
+    ZipFn run;
+};
+
+inline ZipKernel selectZipKernel() {
+#if AV_KERNELS_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) return { "avx2", zipAvx2 };
+    if (__builtin_cpu_supports("sse2")) return { "sse2", zipSse2 };
+#elif AV_KERNELS_NEON
+    return { "neon", zipNeon };
+#endif
+
+    return { "scalar", zipScalar };
+}
+
+// The kernel used by the audio callback, chosen on first use.
+inline const ZipKernel& zipKernel() {
+    static const ZipKernel kernel = selectZipKernel();
+    return kernel;
+}
+
+// Splits count frames of interleaved channels into one array per channel.
+using DeinterleaveFn = void (*)(const float* in, size_t channels, size_t frames, float* const* out);
+
+// Frames [first, last) only. Works in tiles of frames so all the output
+// streams stay in cache while the input is read once.
+inline void deinterleaveRange(const float* in, size_t channels, size_t first, size_t last, float* const* out) {
+    constexpr size_t tile = 64;
+
+    for (size_t f0 = first; f0 < last; f0 += tile) {
+        size_t f1 = std::min(last, f0 + tile);
+
+        for (size_t c = 0; c < channels; ++c) {
+            float* dst = out[c];
+
+            for (size_t f = f0; f < f1; ++f) {
+                dst[f] = in[f * channels + c];
+            }
+        }
+    }
+}
+
+inline void deinterleaveScalar(const float* in, size_t channels, size_t frames, float* const* out) {
+    deinterleaveRange(in, channels, 0, frames, out);
+}
+
+#if AV_KERNELS_X86
+// Stereo and multiples of 4 channels (4x4 transposes); anything else is scalar.
+__attribute__((target("sse2")))
+inline void deinterleaveSse2(const float* in, size_t channels, size_t frames, float* const* out) {
+    size_t f = 0;
+
+    if (channels == 2) {
+        for (; f + 4 <= frames; f += 4) {
+            __m128 a = _mm_loadu_ps(in + f * 2);
+            __m128 b = _mm_loadu_ps(in + f * 2 + 4);
+            _mm_storeu_ps(out[0] + f, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(out[1] + f, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+    }
+    else if (channels % 4 == 0) {
+        for (; f + 4 <= frames; f += 4) {
+            const float* rows = in + f * channels;
+
+            for (size_t c = 0; c < channels; c += 4) {
+                __m128 r0 = _mm_loadu_ps(rows + c);
+                __m128 r1 = _mm_loadu_ps(rows + channels + c);
+                __m128 r2 = _mm_loadu_ps(rows + channels * 2 + c);
+                __m128 r3 = _mm_loadu_ps(rows + channels * 3 + c);
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                _mm_storeu_ps(out[c] + f, r0);
+                _mm_storeu_ps(out[c + 1] + f, r1);
+                _mm_storeu_ps(out[c + 2] + f, r2);
+                _mm_storeu_ps(out[c + 3] + f, r3);
+            }
+        }
+    }
+
+    deinterleaveRange(in, channels, f, frames, out);
+}
+
+// Stereo 8 frames at a time; other layouts as SSE2.
+__attribute__((target("avx2")))
+inline void deinterleaveAvx2(const float* in, size_t channels, size_t frames, float* const* out) {
+    if (channels != 2) {
+        deinterleaveSse2(in, channels, frames, out);
+        return;
+    }
+
+    size_t f = 0;
+
+    for (; f + 8 <= frames; f += 8) {
+        __m256 a = _mm256_loadu_ps(in + f * 2);
+        __m256 b = _mm256_loadu_ps(in + f * 2 + 8);
+        // Per 128-bit half: frames 0,1,4,5 | 2,3,6,7, then put the quarters in order.
+        __m256 left = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 right = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        left = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(left), _MM_SHUFFLE(3, 1, 2, 0)));
+        right = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(right), _MM_SHUFFLE(3, 1, 2, 0)));
+        _mm256_storeu_ps(out[0] + f, left);
+        _mm256_storeu_ps(out[1] + f, right);
+    }
+
+    deinterleaveRange(in, channels, f, frames, out);
+}
+#endif
+
+#if AV_KERNELS_NEON
+inline void deinterleaveNeon(const float* in, size_t channels, size_t frames, float* const* out) {
+    size_t f = 0;
+
+    if (channels == 2) {
+        for (; f + 4 <= frames; f += 4) {
+            float32x4x2_t v = vld2q_f32(in + f * 2);
+            vst1q_f32(out[0] + f, v.val[0]);
+            vst1q_f32(out[1] + f, v.val[1]);
+        }
+    }
+    else if (channels == 4) {
+        for (; f + 4 <= frames; f += 4) {
+            float32x4x4_t v = vld4q_f32(in + f * 4);
+            vst1q_f32(out[0] + f, v.val[0]);
+            vst1q_f32(out[1] + f, v.val[1]);
+            vst1q_f32(out[2] + f, v.val[2]);
+            vst1q_f32(out[3] + f, v.val[3]);
+        }
+    }
+
+    deinterleaveRange(in, channels, f, frames, out);
+}
+#endif
+
+struct DeinterleaveKernel {
+    const char* name;
+    DeinterleaveFn run;
+};
+
+inline DeinterleaveKernel selectDeinterleaveKernel() {
+#if AV_KERNELS_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) return { "avx2", deinterleaveAvx2 };
+    if (__builtin_cpu_supports("sse2")) return { "sse2", deinterleaveSse2 };
+#elif AV_KERNELS_NEON
+    return { "neon", deinterleaveNeon };
+#endif
+
+    return { "scalar", deinterleaveScalar };
+}
+
+// The kernel used by the decoder, chosen on first use.
+inline const DeinterleaveKernel& deinterleaveKernel() {
+    static const DeinterleaveKernel kernel = selectDeinterleaveKernel();
+    return kernel;
+}
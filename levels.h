@@ -0,0 +1,645 @@
+#pragma once
+
+#include "peaks.h"
+#include "sample_source.h"
+#include "thread_pool.h"
+#include "peak_builder.h"
+#include "arena.h"
+#include "kernels.h"
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+// ---- Level Analysis ----
+// Loudness figures computed in the same pass as the peak pyramids: per block
+// of PeakPyramid::baseBlockSize samples the sum of squares (for RMS) and the
+// true peak, and per 100 ms step the K-weighted power that ITU-R BS.1770
+// loudness is made of. Momentary (400 ms), short-term (3 s) and integrated
+// loudness are then sums over the steps, at any zoom, without going back to
+// the samples.
+//
+// True peak is the largest magnitude of the signal upsampled 4x with the
+// interpolation filter of BS.1770 Annex 2, which catches the overs between
+// samples that a sample peak misses.
+
+// Levels of a range of samples, as amplitudes.
+struct Levels {
+    float rms = 0.0f;
+    float truePeak = 0.0f;
+};
+
+namespace loudness {
+
+// Second-order section, direct form I, in double: the K-weighting's high pass
+// sits at 38 Hz, where float coefficients lose the response.
+struct Biquad {
+    double b0 = 1.0, b1 = 0.0, b2 = 0.0, a1 = 0.0, a2 = 0.0;
+    double x1 = 0.0, x2 = 0.0, y1 = 0.0, y2 = 0.0;
+
+    double process(double x) {
+        double y = b0 * x + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
+        x2 = x1;
+        x1 = x;
+        y2 = y1;
+        y1 = y;
+        return y;
+    }
+
+    // The tail of a decaying signal would otherwise run into denormals,
+    // which are slow, during digital silence.
+    void flushDenormals() {
+        const double tiny = 1e-25;
+        if (std::abs(y1) < tiny && std::abs(y2) < tiny && std::abs(x1) < tiny && std::abs(x2) < tiny) {
+            x1 = x2 = y1 = y2 = 0.0;
+        }
+    }
+
+    void reset() {
+        x1 = x2 = y1 = y2 = 0.0;
+    }
+};
+
+// The two stages of the K-weighting at rate: a high shelf (the head), then a
+// high pass. Derived from the analogue prototypes of BS.1770's 48 kHz
+// filters, so every rate gets the same response.
+inline void kWeighting(double rate, Biquad& shelf, Biquad& highPass) {
+    const double pi = 3.14159265358979323846;
+
+    double f0 = 1681.974450955533, gain = 3.999843853973347, q = 0.7071752369554196;
+    double k = std::tan(pi * f0 / rate);
+    double vh = std::pow(10.0, gain / 20.0);
+    double vb = std::pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+
+    shelf.b0 = (vh + vb * k / q + k * k) / a0;
+    shelf.b1 = 2.0 * (k * k - vh) / a0;
+    shelf.b2 = (vh - vb * k / q + k * k) / a0;
+    shelf.a1 = 2.0 * (k * k - 1.0) / a0;
+    shelf.a2 = (1.0 - k / q + k * k) / a0;
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = std::tan(pi * f0 / rate);
+    a0 = 1.0 + k / q + k * k;
+
+    highPass.b0 = 1.0;
+    highPass.b1 = -2.0;
+    highPass.b2 = 1.0;
+    highPass.a1 = 2.0 * (k * k - 1.0) / a0;
+    highPass.a2 = (1.0 - k / q + k * k) / a0;
+
+    shelf.reset();
+    highPass.reset();
+}
+
+// BS.1770 Annex 2's 4x upsampling filter: 4 phases of 12 taps, oldest sample first.
+constexpr size_t truePeakPhases = 4;
+constexpr size_t truePeakTaps = 12;
+
+inline const float (&truePeakFilter())[truePeakPhases][truePeakTaps] {
+    static const float filter[truePeakPhases][truePeakTaps] = {
+        { 0.0017089843750f, 0.0109863281250f, -0.0196533203125f, 0.0332031250000f, -0.0594482421875f, 0.1373291015625f,
+          0.9721679687500f, -0.1022949218750f, 0.0476074218750f, -0.0266113281250f, 0.0148925781250f, -0.0083007812500f },
+        { -0.0291748046875f, 0.0292968750000f, -0.0517578125000f, 0.0891113281250f, -0.1665039062500f, 0.4650878906250f,
+          0.7797851562500f, -0.2003173828125f, 0.1015625000000f, -0.0582275390625f, 0.0330810546875f, -0.0189208984375f },
+        { -0.0189208984375f, 0.0330810546875f, -0.0582275390625f, 0.1015625000000f, -0.2003173828125f, 0.7797851562500f,
+          0.4650878906250f, -0.1665039062500f, 0.0891113281250f, -0.0517578125000f, 0.0292968750000f, -0.0291748046875f },
+        { -0.0083007812500f, 0.0148925781250f, -0.0266113281250f, 0.0476074218750f, -0.1022949218750f, 0.9721679687500f,
+          0.1373291015625f, -0.0594482421875f, 0.0332031250000f, -0.0196533203125f, 0.0109863281250f, 0.0017089843750f },
+    };
+
+    return filter;
+}
+
+// BS.1770 channel weights, for the 5.1 order miniaudio decodes to (L R C LFE
+// Ls Rs): the surrounds count +1.5 dB and the LFE not at all.
+inline double channelWeight(size_t channel, size_t channels) {
+    if (channels != 6) return 1.0;
+    if (channel == 3) return 0.0;
+    return channel >= 4 ? 1.41 : 1.0;
+}
+
+// Loudness (LUFS) of a weighted mean square; -inf for silence.
+inline float lufs(double power) {
+    return power > 0.0 ? static_cast<float>(-0.691 + 10.0 * std::log10(power)) : -std::numeric_limits<float>::infinity();
+}
+
+inline float decibels(float amplitude) {
+    return amplitude > 0.0f ? 20.0f * std::log10(amplitude) : -std::numeric_limits<float>::infinity();
+}
+
+} // namespace loudness
+
+// ---- Level Track ----
+// The levels of one channel, filled in as it is decoded, like a PeakPyramid
+// (and alongside it). All of it lives in one flat float array, owned, carved
+// from the file's Arena, or borrowed from the peak cache: the blocks (sum of
+// squares, true peak), coarse entries merging coarseBlocks blocks each so
+// long ranges read few entries, then the K-weighted mean square of every step.
+//
+// Unlike pyramids, levels can't be built from independent chunks: the
+// K-weighting filter runs through the channel from start to end. append()
+// takes the samples in order; channels are independent and can be appended
+// from different threads. One thread may append while others read; readers
+// only see blocks and steps that are complete.
+class LevelTrack {
+public:
+    static constexpr size_t blockSize = PeakPyramid::baseBlockSize;
+    static constexpr size_t coarseBlocks = 64;
+
+    LevelTrack() = default;
+    // Readers may hold on to the entries, so a track never moves.
+    LevelTrack(const LevelTrack&) = delete;
+    LevelTrack& operator=(const LevelTrack&) = delete;
+
+    // Frames per loudness step: 100 ms.
+    static size_t stepLength(unsigned rate) {
+        return std::max<size_t>((rate + 5) / 10, 1);
+    }
+
+    // Floats of a track of count samples at rate, as data() lays them out.
+    static size_t floatCount(size_t count, unsigned rate) {
+        size_t blocks = (count + blockSize - 1) / blockSize;
+        return 2 * blocks + 2 * ((blocks + coarseBlocks - 1) / coarseBlocks) + (count + stepLength(rate) - 1) / stepLength(rate);
+    }
+
+    // Allocates an empty track for count samples at rate, from arena when
+    // given (which the track then keeps alive).
+    // Not thread safe: call before the track is shared.
+    void reserve(size_t count, unsigned rate, std::shared_ptr<Arena> arena = nullptr) {
+        layout(count, rate);
+        size_t total = floatCount(count, rate);
+
+        if (arena) {
+            std::vector<float>().swap(owned);
+            writable = arena->allocate<float>(total);
+            std::fill(writable, writable + total, 0.0f);
+        }
+        else {
+            owned.assign(total, 0.0f);
+            writable = owned.data();
+        }
+
+        entries = writable;
+        storage = std::move(arena);
+        loudness::kWeighting(rate, shelf, highPass);
+        std::fill(std::begin(window), std::end(window), 0.0f);
+        blockSquares = 0.0;
+        blockPeak = 0.0f;
+        stepSum = 0.0;
+        built.store(0, std::memory_order_relaxed);
+    }
+
+    // Adds the next count samples of the channel and publishes every block
+    // and step they complete. Only one thread may append.
+    void append(const float* samples, size_t count) {
+        size_t done = built.load(std::memory_order_relaxed);
+        count = std::min(count, sampleCount - done);
+
+        while (count > 0) {
+            size_t take = std::min({ blockSize - done % blockSize, stepSize - done % stepSize, count });
+
+            appendRun(samples, take);
+            samples += take;
+            count -= take;
+            done += take;
+
+            // Blocks and steps are complete when full or when the channel ends.
+            if (done % blockSize == 0 || done == sampleCount) {
+                finishBlock((done - 1) / blockSize);
+            }
+
+            if (done % stepSize == 0 || done == sampleCount) {
+                size_t step = (done - 1) / stepSize;
+                writable[stepOffset + step] = static_cast<float>(stepSum / (done - step * stepSize));
+                stepSum = 0.0;
+            }
+        }
+
+        built.store(done, std::memory_order_release);
+    }
+
+    // Uses the floatCount(count, rate) floats at data as append() would have
+    // filled them, without copying. The owner keeps them alive.
+    void adopt(const float* data, size_t count, unsigned rate, std::shared_ptr<const void> owner) {
+        layout(count, rate);
+        std::vector<float>().swap(owned);
+        writable = nullptr;
+        entries = data;
+        storage = std::move(owner);
+        built.store(count, std::memory_order_release);
+    }
+
+    bool empty() const { return entries == nullptr; }
+    size_t samples() const { return sampleCount; }
+    unsigned sampleRate() const { return rate; }
+    // Samples analysed so far; equals samples() once the track is complete.
+    size_t available() const { return built.load(std::memory_order_acquire); }
+    bool complete() const { return !empty() && available() == sampleCount; }
+    // Flat view of the whole track, as written to the peak cache.
+    const float* data() const { return entries; }
+    size_t size() const { return floatCount(sampleCount, rate); }
+
+    size_t stepFrames() const { return stepSize; }
+    // Steps whose power is known.
+    size_t stepsAvailable() const {
+        size_t ready = available();
+        return ready == sampleCount ? stepTotal : ready / stepSize;
+    }
+
+    // Mean square of the K-weighted signal over step; below stepsAvailable().
+    float stepPower(size_t step) const {
+        return entries[stepOffset + step];
+    }
+
+    // RMS and true peak of [start, end), widened to block boundaries. Blocks
+    // not built yet are left out.
+    Levels read(size_t start, size_t end) const {
+        Levels out;
+        end = std::min(end, sampleCount);
+
+        if (empty() || start >= end) return out;
+
+        size_t ready = available();
+        size_t first = start / blockSize;
+        size_t last = std::min((end + blockSize - 1) / blockSize, ready == sampleCount ? blockTotal : ready / blockSize);
+
+        if (first >= last) return out;
+
+        double squares = 0.0;
+        float peak = 0.0f;
+
+        for (size_t b = first; b < last; ) {
+            if (b % coarseBlocks == 0 && b + coarseBlocks <= last) {
+                const float* entry = entries + coarseOffset + 2 * (b / coarseBlocks);
+                squares += entry[0];
+                peak = std::max(peak, entry[1]);
+                b += coarseBlocks;
+            }
+            else {
+                squares += entries[2 * b];
+                peak = std::max(peak, entries[2 * b + 1]);
+                ++b;
+            }
+        }
+
+        size_t frames = std::min(last * blockSize, sampleCount) - first * blockSize;
+        out.rms = static_cast<float>(std::sqrt(squares / frames));
+        out.truePeak = peak;
+
+        return out;
+    }
+
+private:
+    void layout(size_t count, unsigned sampleRate) {
+        sampleCount = count;
+        rate = sampleRate;
+        stepSize = stepLength(sampleRate);
+        blockTotal = (count + blockSize - 1) / blockSize;
+        stepTotal = (count + stepSize - 1) / stepSize;
+        coarseOffset = 2 * blockTotal;
+        stepOffset = coarseOffset + 2 * ((blockTotal + coarseBlocks - 1) / coarseBlocks);
+    }
+
+    // Samples within one block and one step.
+    void appendRun(const float* samples, size_t count) {
+        const size_t history = loudness::truePeakTaps - 1;
+        std::copy(samples, samples + count, window + history);
+
+        double squares = 0.0, weighted = 0.0;
+        float peak = blockPeak;
+
+        for (size_t i = 0; i < count; ++i) {
+            double x = samples[i];
+            double k = highPass.process(shelf.process(x));
+            squares += x * x;
+            weighted += k * k;
+            peak = std::max(peak, std::abs(samples[i]));
+        }
+
+        shelf.flushDenormals();
+        highPass.flushDenormals();
+
+        const auto& filter = loudness::truePeakFilter();
+        peak = std::max(peak, polyphasePeakKernel().run(window, count, &filter[0][0], loudness::truePeakPhases,
+                                                        loudness::truePeakTaps));
+
+        // The run's last samples lead into the next one.
+        std::copy(window + count, window + count + history, window);
+
+        blockSquares += squares;
+        blockPeak = peak;
+        stepSum += weighted;
+    }
+
+    void finishBlock(size_t block) {
+        writable[2 * block] = static_cast<float>(blockSquares);
+        writable[2 * block + 1] = blockPeak;
+
+        float* coarse = writable + coarseOffset + 2 * (block / coarseBlocks);
+        coarse[0] += static_cast<float>(blockSquares);
+        coarse[1] = std::max(coarse[1], blockPeak);
+
+        blockSquares = 0.0;
+        blockPeak = 0.0f;
+    }
+
+    std::vector<float> owned;
+    // The floats being built: owned's or the arena's. Null when borrowed.
+    float* writable = nullptr;
+    const float* entries = nullptr;
+    // Keeps borrowed entries (e.g. a file mapping) or the arena alive.
+    std::shared_ptr<const void> storage;
+    size_t sampleCount = 0;
+    unsigned rate = 0;
+    size_t stepSize = 1;
+    size_t blockTotal = 0;
+    size_t stepTotal = 0;
+    size_t coarseOffset = 0;
+    size_t stepOffset = 0;
+    std::atomic<size_t> built{0};
+
+    // Appending: the filters, the samples before the run for the true-peak
+    // filter, and the block and step in progress.
+    loudness::Biquad shelf;
+    loudness::Biquad highPass;
+    float window[loudness::truePeakTaps - 1 + blockSize] = {};
+    double blockSquares = 0.0;
+    float blockPeak = 0.0f;
+    double stepSum = 0.0;
+};
+
+// One track per channel of a file.
+using LevelTracks = std::vector<std::shared_ptr<const LevelTrack>>;
+
+// Weighted K-power of steps [first, first + count) over every channel, from
+// the steps built so far; 0 if none are.
+inline double stepPower(const LevelTracks& tracks, size_t first, size_t count) {
+    double power = 0.0;
+
+    for (size_t c = 0; c < tracks.size(); ++c) {
+        const LevelTrack& track = *tracks[c];
+        size_t end = std::min(first + count, track.stepsAvailable());
+
+        if (track.empty() || end <= first) continue;
+
+        double sum = 0.0;
+        for (size_t s = first; s < end; ++s) sum += track.stepPower(s);
+        power += loudness::channelWeight(c, tracks.size()) * sum / (end - first);
+    }
+
+    return power;
+}
+
+// Loudness (LUFS) of the steps second long up to frame: momentary with 0.4,
+// short-term with 3.
+inline float loudnessAt(const LevelTracks& tracks, size_t frame, double seconds) {
+    if (tracks.empty() || tracks[0]->empty()) return -std::numeric_limits<float>::infinity();
+
+    size_t steps = static_cast<size_t>(std::lround(seconds * 10.0));
+    size_t last = frame / tracks[0]->stepFrames() + 1;
+    size_t first = last - std::min(last, steps);
+
+    return loudness::lufs(stepPower(tracks, first, last - first));
+}
+
+// The whole file.
+struct LoudnessSummary {
+    // Gated as in BS.1770, LUFS.
+    float integrated = -std::numeric_limits<float>::infinity();
+    // Over every channel, amplitudes.
+    float truePeak = 0.0f;
+    float rms = 0.0f;
+};
+
+// Integrated loudness over the 400 ms blocks (one starting at every step, so
+// they overlap by 75%) louder than -70 LUFS, then of those within 10 LU of
+// their mean. From the steps built so far.
+inline LoudnessSummary summariseLoudness(const LevelTracks& tracks) {
+    LoudnessSummary summary;
+
+    if (tracks.empty() || tracks[0]->empty()) return summary;
+
+    const size_t blockSteps = 4;
+    size_t steps = tracks[0]->stepsAvailable();
+    for (const auto& track : tracks) steps = std::min(steps, track->stepsAvailable());
+
+    std::vector<double> blocks;
+
+    for (size_t s = 0; s + blockSteps <= steps || (s == 0 && steps > 0); ++s) {
+        blocks.push_back(stepPower(tracks, s, std::min(blockSteps, steps)));
+    }
+
+    auto gatedMean = [&](double threshold) {
+        double sum = 0.0;
+        size_t count = 0;
+
+        for (double power : blocks) {
+            if (power > threshold) {
+                sum += power;
+                ++count;
+            }
+        }
+
+        return count > 0 ? sum / count : 0.0;
+    };
+
+    double absoluteGate = std::pow(10.0, (-70.0 + 0.691) / 10.0);
+    double relativeGate = gatedMean(absoluteGate) * 0.1;
+    summary.integrated = loudness::lufs(gatedMean(std::max(absoluteGate, relativeGate)));
+
+    double squares = 0.0;
+
+    for (const auto& track : tracks) {
+        Levels levels = track->read(0, track->samples());
+        summary.truePeak = std::max(summary.truePeak, levels.truePeak);
+        squares += static_cast<double>(levels.rms) * levels.rms;
+    }
+
+    summary.rms = static_cast<float>(std::sqrt(squares / tracks.size()));
+
+    return summary;
+}
+
+// Queues the analysis of frames [start, start + count) of every channel of
+// source on group, one task per channel. Appends must stay in order: wait
+// for the group before queueing the next range.
+inline void analyseAsync(TaskGroup& group, const SampleSource& source, const std::vector<std::shared_ptr<LevelTrack>>& tracks,
+                         size_t start, size_t count) {
+    for (size_t c = 0; c < tracks.size(); ++c) {
+        LevelTrack* track = tracks[c].get();
+        const SampleSource* from = &source;
+
+        group.run([track, from, c, start, count]() {
+            // One conversion buffer per thread, reused across calls.
+            thread_local std::vector<float> block(peakChunkFrames);
+
+            for (size_t at = start; at < start + count; at += peakChunkFrames) {
+                size_t n = std::min(peakChunkFrames, start + count - at);
+                track->append(from->fetch(c, at, n, block.data()), n);
+            }
+        });
+    }
+}
+
+// ---- Level Meter ----
+// Live levels of what is playing, fed by the audio callback: per side the
+// peak, falling back 20 dB in 1.7 s (as a PPM) so that no peak between
+// redraws is missed, the RMS of the last 400 ms, and the momentary loudness.
+// The callback publishes a reading per buffer through a seqlock; the UI's
+// read() retries instead of ever making the callback wait.
+struct MeterReading {
+    float peak[2] = {};
+    float rms[2] = {};
+    // LUFS, -inf in silence.
+    float momentary = -std::numeric_limits<float>::infinity();
+};
+
+class LevelMeter {
+public:
+    LevelMeter() {
+        configure(48000);
+    }
+
+    // Sets the filters up for rate. Not while process() may run.
+    void configure(unsigned rate) {
+        for (size_t side = 0; side < 2; ++side) {
+            loudness::kWeighting(rate, shelf[side], highPass[side]);
+        }
+
+        stepSize = LevelTrack::stepLength(rate);
+        // 20 dB over 1.7 s.
+        release = static_cast<float>(std::pow(0.1, 1.0 / (1.7 * std::max(rate, 1u))));
+        reset();
+    }
+
+    // Audio thread: count interleaved stereo frames on their way to the device.
+    void process(const float* frames, int count) {
+        for (int i = 0; i < count; ++i) {
+            for (size_t side = 0; side < 2; ++side) {
+                float x = frames[2 * i + side];
+                double k = highPass[side].process(shelf[side].process(x));
+                peaks[side] = std::max(peaks[side] * release, std::abs(x));
+                squares[side] += static_cast<double>(x) * x;
+                weighted[side] += k * k;
+            }
+
+            if (++stepFill == stepSize) finishStep();
+        }
+
+        for (size_t side = 0; side < 2; ++side) {
+            shelf[side].flushDenormals();
+            highPass[side].flushDenormals();
+        }
+
+        publish();
+    }
+
+    // Clears the meter, e.g. once playback stops. Not while process() may run.
+    void reset() {
+        for (size_t side = 0; side < 2; ++side) {
+            shelf[side].reset();
+            highPass[side].reset();
+            peaks[side] = 0.0f;
+            squares[side] = weighted[side] = 0.0;
+            reading.peak[side] = reading.rms[side] = 0.0f;
+
+            for (size_t s = 0; s < windowSteps; ++s) stepSquares[s][side] = stepWeighted[s][side] = 0.0;
+        }
+
+        reading.momentary = -std::numeric_limits<float>::infinity();
+        stepFill = 0;
+        stepIndex = 0;
+        publish();
+    }
+
+    // Any thread.
+    MeterReading read() const {
+        MeterReading out;
+        unsigned before, after;
+
+        do {
+            before = sequence.load(std::memory_order_acquire);
+
+            for (size_t side = 0; side < 2; ++side) {
+                out.peak[side] = sharedPeak[side].load(std::memory_order_relaxed);
+                out.rms[side] = sharedRms[side].load(std::memory_order_relaxed);
+            }
+
+            out.momentary = sharedMomentary.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+
+        return out;
+    }
+
+private:
+    static constexpr size_t windowSteps = 4;
+
+    // A step is over: the RMS and loudness of the last windowSteps.
+    void finishStep() {
+        double power = 0.0;
+
+        for (size_t side = 0; side < 2; ++side) {
+            stepSquares[stepIndex][side] = squares[side];
+            stepWeighted[stepIndex][side] = weighted[side];
+            squares[side] = weighted[side] = 0.0;
+
+            double windowSquares = 0.0, windowWeighted = 0.0;
+
+            for (size_t s = 0; s < windowSteps; ++s) {
+                windowSquares += stepSquares[s][side];
+                windowWeighted += stepWeighted[s][side];
+            }
+
+            reading.rms[side] = static_cast<float>(std::sqrt(windowSquares / (windowSteps * stepSize)));
+            power += windowWeighted / (windowSteps * stepSize);
+        }
+
+        reading.momentary = loudness::lufs(power);
+        stepIndex = (stepIndex + 1) % windowSteps;
+        stepFill = 0;
+    }
+
+    // Seqlock, as Audio publishes the playhead.
+    void publish() {
+        unsigned count = sequence.load(std::memory_order_relaxed);
+        sequence.store(count + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t side = 0; side < 2; ++side) {
+            sharedPeak[side].store(peaks[side], std::memory_order_relaxed);
+            sharedRms[side].store(reading.rms[side], std::memory_order_relaxed);
+        }
+
+        sharedMomentary.store(reading.momentary, std::memory_order_relaxed);
+        sequence.store(count + 2, std::memory_order_release);
+    }
+
+    // Owned by the audio thread.
+    loudness::Biquad shelf[2];
+    loudness::Biquad highPass[2];
+    float release = 1.0f;
+    float peaks[2] = {};
+    size_t stepSize = 1;
+    size_t stepFill = 0;
+    double squares[2] = {};
+    double weighted[2] = {};
+    // The last windowSteps steps, a ring.
+    double stepSquares[windowSteps][2] = {};
+    double stepWeighted[windowSteps][2] = {};
+    size_t stepIndex = 0;
+    MeterReading reading;
+
+    // Published once per buffer.
+    std::atomic<unsigned> sequence{0};
+    std::atomic<float> sharedPeak[2] = {};
+    std::atomic<float> sharedRms[2] = {};
+    std::atomic<float> sharedMomentary{0.0f};
+};
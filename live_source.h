@@ -0,0 +1,92 @@
+#pragma once
+
+#include "sample_source.h"
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+
+// ---- Live Source ----
+// Samples of a stream that never ends (live input, see LiveCapture) in fixed
+// memory: each channel is a ring of capacity() frames, a power of two, and
+// frames keep their absolute position, so frames() grows for as long as the
+// input runs. Only the last capacity() frames are kept; older ones read as
+// silence.
+//
+// One thread appends while others read. Unlike other sources, frames below
+// available() change once they fall out of the ring, so readers stay well
+// inside it (the view shows less than capacity(), see LiveCapture::window()).
+class LiveSource : public SampleSource {
+public:
+    // Keeps at least window frames of each of channels.
+    LiveSource(size_t channels, size_t window) : channelCount(channels) {
+        ringFrames = 1;
+        while (ringFrames < window) ringFrames *= 2;
+
+        data.assign(ringFrames * channelCount, 0.0f);
+    }
+
+    LiveSource(const LiveSource&) = delete;
+    LiveSource& operator=(const LiveSource&) = delete;
+
+    size_t channels() const override { return channelCount; }
+    // Frames appended so far.
+    size_t frames() const override { return written.load(std::memory_order_acquire); }
+    size_t capacity() const { return ringFrames; }
+
+    // The oldest frame still kept.
+    size_t oldest() const {
+        size_t total = frames();
+        return total > ringFrames ? total - ringFrames : 0;
+    }
+
+    void read(size_t c, size_t start, size_t count, float* out) const override {
+        size_t total = frames();
+        size_t end = start + count;
+        size_t from = std::min(std::max(start, total > ringFrames ? total - ringFrames : 0), end);
+        size_t to = std::max(std::min(end, total), from);
+
+        std::fill(out, out + (from - start), 0.0f);
+        copyOut(c, from, to - from, out + (from - start));
+        std::fill(out + (to - start), out + count, 0.0f);
+    }
+
+    // Writer side: appends count frames, one array per channel, and publishes
+    // them. Only one thread may append.
+    void append(const float* const* planes, size_t count) {
+        size_t total = written.load(std::memory_order_relaxed);
+        // More than the ring holds: only the last of them stay.
+        size_t skip = count > ringFrames ? count - ringFrames : 0;
+
+        for (size_t c = 0; c < channelCount; ++c) {
+            copyIn(c, total + skip, planes[c] + skip, count - skip);
+        }
+
+        written.store(total + count, std::memory_order_release);
+    }
+
+private:
+    // Ring copies, in at most two pieces around the end of the channel.
+    void copyIn(size_t c, size_t at, const float* samples, size_t count) {
+        float* channel = data.data() + c * ringFrames;
+        size_t slot = at & (ringFrames - 1);
+        size_t first = std::min(count, ringFrames - slot);
+        std::memcpy(channel + slot, samples, first * sizeof(float));
+        std::memcpy(channel, samples + first, (count - first) * sizeof(float));
+    }
+
+    void copyOut(size_t c, size_t at, size_t count, float* out) const {
+        const float* channel = data.data() + c * ringFrames;
+        size_t slot = at & (ringFrames - 1);
+        size_t first = std::min(count, ringFrames - slot);
+        std::memcpy(out, channel + slot, first * sizeof(float));
+        std::memcpy(out + first, channel, (count - first) * sizeof(float));
+    }
+
+    size_t channelCount = 0;
+    size_t ringFrames = 0;
+    // Channel c's ring starts at c * ringFrames.
+    std::vector<float> data;
+    std::atomic<size_t> written{0};
+};
@@ -1,9 +1,26 @@
-#define MINIAUDIO_IMPLEMENTATION
-#include "../libraries/miniaudio.h"
-#include <GL/gl.h>
+#include "audio.h"
+#include "peaks.h"
+#include "kernels.h"
+#include "resampler.h"
+#include "sample_source.h"
+#include "peak_cache.h"
+#include "stream_decoder.h"
+#include "gl_batch.h"
+#include "gl_layer.h"
+#include "gl_envelope.h"
+#include "waveform_geometry.h"
+#include "levels.h"
+#include "spsc_queue.h"
+#include "peak_builder.h"
+#include "column_worker.h"
+#include "instrumentation.h"
+#include "batch.h"
+#include "capture.h"
+#include "frame_scheduler.h"
 #include <FL/Fl.H>
 #include <FL/Fl_Window.H>
 #include <FL/Fl_Gl_Window.H>
+#include <FL/gl.h>
 #include <FL/Fl_Scrollbar.H>
 #include <FL/Fl_Button.H>
 #include <FL/Fl_Group.H>
@@ -14,6 +31,14 @@
 #include <atomic>
 #include <functional>
 #include <memory>
+#include <string>
+#include <chrono>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <climits>
+#include <limits>
 
 
 // Forward class declarations.
@@ -26,6 +51,11 @@ struct AppContext {
     WaveformView* view;
     Fl_Button* playBtn;
     Fl_Button* stopBtn;
+    StreamingDecoder* loader = nullptr;
+    // Live input, when recording instead of viewing a file.
+    LiveCapture* capture = nullptr;
+    // Ticks advance_frame() while something moves.
+    FrameScheduler* frames = nullptr;
 };
 
 // Forward function declarations.
@@ -34,120 +64,166 @@ void stop(AppContext* ctx);
 void pause(AppContext* ctx);
 void resetCursor(AppContext* ctx);
 
-// ---- Audio Class ----
-class Audio {
+// ---- Waveform View ----
+class WaveformView : public Fl_Gl_Window {
 public:
-    std::vector<float> leftSamples;
-    std::vector<float> rightSamples;
-    std::atomic<int> playbackSampleIndex{0};
-    int totalSamples = 0;
-    // Update this based on the actual file.
-    int sampleRate = 44100;
-    ma_device device;
-    // End of file flag.
-    bool eof = false;
-
-    bool init(const std::vector<float>& left, const std::vector<float>& right, int rate);
+    WaveformView(int X, int Y, int W, int H)
+        : Fl_Gl_Window(X, Y, W, H) {
+        end();
 
-    void start() {
-        ma_device_start(&device);
+        columns.onReady = [this]() {
+            Fl::awake(columnsReady, this);
+        };
     }
 
-    int currentSample() const {
-        return playbackSampleIndex.load();
+    std::function<void(int64_t)> onSeekCallback;
+
+    void setOnSeekCallback(std::function<void(int64_t)> callback) {
+        // Assign the function variable.
+        onSeekCallback = callback;
     }
-};
 
-void audio_data_callback(ma_device* pDevice, void* output, const void*, ma_uint32 frameCount) {
-    auto* self = static_cast<Audio*>(pDevice->pUserData);
-    float* out = static_cast<float*>(output);
+    // Called while the cursor is dragged along the waveform, then once more
+    // with finished set when the button is released.
+    std::function<void(int64_t, bool)> onScrubCallback;
 
-    int remaining = self->totalSamples - self->playbackSampleIndex;
-    int framesToCopy = std::min((int)frameCount, remaining);
+    void setOnScrubCallback(std::function<void(int64_t, bool)> callback) {
+        onScrubCallback = callback;
+    }
+
+    // Called when the A/B loop changes; end <= start means no loop.
+    std::function<void(int64_t, int64_t)> onLoopCallback;
 
-    // Check for end of file.
-    if (remaining == 0 && !self->eof) {
-        self->eof = true;
+    void setOnLoopCallback(std::function<void(int64_t, int64_t)> callback) {
+        onLoopCallback = callback;
     }
 
-    // Fill buffer with interleaved stereo samples
-    for (int i = 0; i < framesToCopy; ++i) {
-        int idx = self->playbackSampleIndex++;
-        // Left
-        out[i * 2]     = self->leftSamples[idx];   
-        // Right
-        out[i * 2 + 1] = self->rightSamples[idx];  
+    // Shows a file from its envelope pyramids alone, e.g. straight from the peak
+    // cache before its samples are decoded. setSamples() fills them in later.
+    // The pyramids may still be filling in (see StreamingDecoder).
+    // One pyramid per channel; missing ones are drawn empty.
+    void setPeaks(const std::vector<std::shared_ptr<const PeakPyramid>>& peaks, int64_t frames, size_t channels) {
+        samples.reset();
+        channelPeaks.assign(std::max<size_t>(channels, 1), nullptr);
+
+        for (size_t c = 0; c < channelPeaks.size(); ++c) {
+            channelPeaks[c] = c < peaks.size() && peaks[c] ? peaks[c] : std::make_shared<PeakPyramid>();
+        }
+
+        totalSamples = frames;
+        liveWindow = 0;
+        columns.setSource(nullptr, channelPeaks, totalSamples);
+        envelopeShader.resetPeaks();
+        channelLevels.clear();
+
+        resetZoom();
     }
 
-    // Fill remaining frames with silence
-    for (int i = framesToCopy; i < (int)frameCount; ++i) {
-        out[i * 2]     = 0.0f;
-        out[i * 2 + 1] = 0.0f;
+    // Shows live input (see LiveCapture): the source and its rolling pyramids
+    // grow without end, followLive() keeps the newest input at the right
+    // edge, and at most window samples are shown.
+    void setLiveInput(std::shared_ptr<const SampleSource> source,
+                      const std::vector<std::shared_ptr<const PeakPyramid>>& peaks, int64_t window) {
+        samples = std::move(source);
+        channelPeaks = peaks;
+        if (channelPeaks.empty()) channelPeaks.push_back(std::make_shared<PeakPyramid>());
+        totalSamples = 0;
+        liveWindow = window;
+        // No end of file to clip the columns at.
+        columns.setSource(samples, channelPeaks, std::numeric_limits<int64_t>::max());
+        envelopeShader.resetPeaks();
+        channelLevels.clear();
+
+        resetZoom();
     }
-}
 
+    // Live input has reached frames: scrolls along so it ends at the right
+    // edge. The view moves by whole columns, and only redraws when the input
+    // has filled a new one.
+    void followLive(int64_t frames) {
+        double perColumn = samplesPerColumn();
+        int64_t filled = static_cast<int64_t>(frames / perColumn);
 
-bool Audio::init(const std::vector<float>& left, const std::vector<float>& right, int rate)
-{
-    // Store the provided audio samples into class members.
-    leftSamples = left;
-    rightSamples = right;
-    // Assuming left and right channels are the same length.
-    totalSamples = static_cast<int>(leftSamples.size());
-    sampleRate = rate;
-
-    ma_device_config config = ma_device_config_init(ma_device_type_playback);
-    config.playback.format = ma_format_f32;
-    config.playback.channels = 2;
-    config.sampleRate = sampleRate;
-    config.dataCallback = audio_data_callback;
-    config.pUserData = this;
-
-    return ma_device_init(nullptr, &config, &device) == MA_SUCCESS;
-}
+        if (filled == liveColumns && perColumn == livePerColumn) return;
 
+        liveColumns = filled;
+        livePerColumn = perColumn;
+        totalSamples = frames;
+        setScrollOffset(static_cast<int64_t>(std::ceil(std::max<int64_t>(filled - w(), 0) * perColumn)));
+        redraw();
+    }
 
-// ---- Waveform View ----
-class WaveformView : public Fl_Gl_Window {
-public:
-    WaveformView(int X, int Y, int W, int H)
-        : Fl_Gl_Window(X, Y, W, H) {
-        end();
+    // The level tracks of the file, one per channel, for the overlays. They
+    // may still be filling in, like the pyramids.
+    void setLevels(const LevelTracks& levels) {
+        channelLevels = levels;
+        summaryReady = false;
+        redraw();
     }
 
-    std::function<void(int)> onSeekCallback;
+    // Shares the samples (no copy) once they can be read.
+    void setSamples(std::shared_ptr<const SampleSource> source) {
+        samples = std::move(source);
+
+        // The pyramids already describe these samples (set through setPeaks(),
+        // possibly still being built), so keep them along with the current
+        // zoom and scroll position.
+        if (channelPeaks.size() == samples->channels() && !channelPeaks[0]->empty()
+            && channelPeaks[0]->samples() == samples->frames()) {
+            columns.setSource(samples, channelPeaks, totalSamples);
+            redraw();
+            return;
+        }
 
-    void setOnSeekCallback(std::function<void(int)> callback) {
-        // Assign the function variable.
-        onSeekCallback = callback;
-    }
+        // Precompute the envelope pyramids read by the zoomed-out draw path,
+        // on every core.
+        std::vector<std::shared_ptr<PeakPyramid>> built(samples->channels());
+        auto arena = std::make_shared<Arena>();
 
-    void setStereoSamples(const std::vector<float>& left, const std::vector<float>& right) {
-        leftSamples = left;
-        rightSamples = right;
+        for (auto& peaks : built) {
+            peaks = std::make_shared<PeakPyramid>();
+            peaks->reserve(samples->frames(), arena);
+        }
+
+        summariseRange(*samples, built, 0, samples->frames());
+
+        channelPeaks.assign(built.begin(), built.end());
+        if (channelPeaks.empty()) channelPeaks.push_back(std::make_shared<PeakPyramid>());
+        totalSamples = static_cast<int64_t>(samples->frames());
+        columns.setSource(samples, channelPeaks, totalSamples);
+        envelopeShader.resetPeaks();
+
+        resetZoom();
+    }
 
-        // Crude check, or pass in a flag.
-        isStereo = (left != right);  
+    void resetZoom() {
+        // Fit entire waveform (or the live window) on screen initially.
+        int64_t span = liveWindow > 0 ? liveWindow : totalSamples;
 
-        // Fit entire waveform on screen initially.
-        if (!leftSamples.empty()) {
+        if (span > 0) {
             // Compute fit-to-screen zoom (pixels per sample that fits entire file).
-            zoomFit = static_cast<float>(w()) / static_cast<float>(leftSamples.size());
-            // Allow zooming out beyond fit-to-screen.
+            zoomFit = static_cast<double>(w()) / static_cast<double>(span);
+            // Allow zooming out beyond fit-to-screen, except past the live
+            // window: older input is gone.
             // Note: Tweak factor (0.01 = 100× smaller than fit).
-            zoomMin = zoomFit * 0.01f;   
+            zoomMin = liveWindow > 0 ? zoomFit : zoomFit * 0.01;
 
             if (zoomMax <= zoomMin) {
                 // Fallback if zoomMax wasn't sensible.
-                zoomMax = zoomMin * 100.0f;    
+                zoomMax = zoomMin * 100.0;
             }
 
             // Start at fit-to-screen.
             zoomLevel = zoomFit;
         }
         else {
-            zoomLevel = 1.0f;
-            zoomFit = zoomMin = 1.0f;
+            zoomLevel = 1.0;
+            zoomFit = zoomMin = 1.0;
+        }
+
+        if (quantizedZoom) {
+            // The closest step that still shows the whole file.
+            setZoomStep(stepForSamplesPerColumn(1.0 / zoomFit));
         }
 
         scrollOffset = 0;
@@ -155,10 +231,12 @@ public:
         redraw();
     }
 
-    void setScrollOffset(int offset) {
-        scrollOffset = std::max(0, offset);
+    // Redraws only if the view actually moved.
+    void setScrollOffset(int64_t offset) {
+        int64_t previous = scrollOffset;
+        scrollOffset = std::max<int64_t>(0, offset);
         updateScrollbar();
-        redraw();
+        if (scrollOffset != previous) redraw();
     }
 
     void setScrollbar(Fl_Scrollbar* sb) {
@@ -167,37 +245,127 @@ public:
     }
 
     void updateScrollbar() {
-        if (!scrollbar || leftSamples.empty()) return;
-        int visibleSamples = static_cast<int>(w() / zoomLevel);
-        int maxOffset = std::max(0, (int)leftSamples.size() - visibleSamples);
-        scrollOffset = std::clamp(scrollOffset, 0, maxOffset);
-        scrollbar->maximum(maxOffset);
-        scrollbar->value(scrollOffset);
-        scrollbar->slider_size((float)visibleSamples / leftSamples.size());
+        if (!scrollbar || totalSamples == 0) return;
+        int64_t visibleSamples = static_cast<int64_t>(w() / zoomLevel);
+        int64_t maxOffset = std::max<int64_t>(0, totalSamples - visibleSamples);
+        scrollOffset = std::clamp<int64_t>(scrollOffset, 0, maxOffset);
+        // Scrollbar values are ints, so very long files scroll in steps of
+        // several samples.
+        scrollbarStep = maxOffset / INT_MAX + 1;
+        scrollbar->maximum(static_cast<double>(maxOffset / scrollbarStep));
+        scrollbar->value(static_cast<int>(scrollOffset / scrollbarStep));
+        scrollbar->slider_size(static_cast<double>(visibleSamples) / totalSamples);
+    }
+
+    // Quantized zoom snaps the zoom level to the steps of stepSamplesPerColumn();
+    // otherwise it changes by 10% per wheel notch.
+    void setQuantizedZoom(bool quantized) {
+        quantizedZoom = quantized;
+        resetZoom();
+    }
+
+    // Draws the zoomed-out envelope with EnvelopeShader where the GL context
+    // supports it, instead of building its vertices on the CPU.
+    void setGpuEnvelope(bool enabled) {
+        gpuEnvelope = enabled;
+        invalidate();
+        redraw();
+    }
+
+    // Samples per pixel column, exact when the zoom is quantized.
+    double samplesPerColumn() const {
+        return quantizedZoom ? stepSamplesPerColumn(zoomStep) : 1.0 / zoomLevel;
+    }
+
+    // Zoom ladder: step s shows (4 + s mod 4) * 2^floor(s / 4) samples per
+    // pixel column, four steps per octave, negative steps zooming in past one
+    // sample per pixel. From 1024 samples per column up, a column is always 4
+    // to 7 whole blocks of one pyramid level, so envelope lookups are exact
+    // and grid-aligned columns are the same from frame to frame.
+    static double stepSamplesPerColumn(int step) {
+        int octave = step >= 0 ? step / 4 : -((3 - step) / 4);
+        return std::ldexp(4 + (step - octave * 4), octave);
+    }
+
+    // The first step with at least samplesPerColumn.
+    static int stepForSamplesPerColumn(double samplesPerColumn) {
+        int step = static_cast<int>(std::floor(4.0 * std::log2(std::max(samplesPerColumn, 1e-6) / 4.0))) - 1;
+
+        while (stepSamplesPerColumn(step) < samplesPerColumn) ++step;
+
+        return step;
+    }
+
+    // The scrollbar was dragged to value.
+    void scrollbarMoved(int value) {
+        setScrollOffset(static_cast<int64_t>(value) * scrollbarStep);
     }
 
     // Getters.
 
-    int getScrollOffset() const { return scrollOffset; }
-    float getZoomLevel() const { return zoomLevel; }
+    int64_t getScrollOffset() const { return scrollOffset; }
+    double getZoomLevel() const { return zoomLevel; }
     bool isPlaying() const { return playing; }
     bool isPaused() const { return paused; }
-    int getPlaybackSample() const { return playbackSample; }
+    int64_t getPlaybackSample() const { return playbackSample; }
+    // The A/B loop is set and switched on.
+    bool isLooping() const { return loopEnabled && loopEnd > loopStart; }
 
     // Setters.
 
     void setContext(AppContext* ctx) { this->ctx = ctx; }
-    int getMovedCursorSample() const { return movedCursorSample; }
+    int64_t getMovedCursorSample() const { return movedCursorSample; }
     void setPlaying(bool state) { playing = state; }
     void setPaused(bool state) { paused = state; }
-    void setPlaybackSample(int sample) {
-        playbackSample = sample;
+    // Shows the timings overlay (see Instrumentation).
+    void toggleHud() {
+        hudVisible = !hudVisible;
+        redraw();
+    }
+
+    // Shows the RMS, true-peak and loudness overlays and the file's loudness.
+    void setLevelsVisible(bool visible) {
+        levelsVisible = visible;
+        redraw();
+    }
+
+    // Shows the live meter of what is playing.
+    bool isMeterVisible() const { return meterVisible; }
+
+    void toggleMeter() {
+        meterVisible = !meterVisible;
         redraw();
     }
-    void setStereoMode(bool stereo) { isStereo = stereo; }
+
+    // Redraws only if the cursor on screen lands on another pixel column.
+    void setPlaybackSample(int64_t sample) {
+        bool moved = cursorColumn(sample) != cursorColumn(drawnCursorSample());
+        playbackSample = sample;
+        if (moved) redraw();
+    }
+
+    // Samples from sample until the cursor there moves to the next pixel column.
+    int64_t samplesToNextColumn(int64_t sample) const {
+        double next = (cursorColumn(sample) + 1) / zoomLevel;
+        return std::max<int64_t>(static_cast<int64_t>(std::ceil(next)) + scrollOffset - sample, 1);
+    }
 
 protected:
     void draw() override {
+        uint64_t drawStart = Instrumentation::now();
+
+        if (!context_valid()) {
+            // New GL context: buffers from the previous one are gone.
+            renderer.init();
+            waveformLayer.init();
+            geometryKey = GeometryKey();
+
+            if (gpuEnvelope) {
+                envelopeShader.init();
+                if (!envelopeShader.supported()) std::cerr << "GPU envelope unavailable, drawing it on the CPU.\n";
+            }
+        }
+
         if (!valid()) {
             glLoadIdentity();
             glViewport(0, 0, w(), h());
@@ -206,204 +374,346 @@ protected:
             glOrtho(0, w(), 0, h(), -1.0, 1.0);  
         }
 
-        int halfHeight = h() / 2;
-
         // White background.
         glClearColor(1, 1, 1, 1);
         glClear(GL_COLOR_BUFFER_BIT);
 
-        if (leftSamples.empty()) return;
+        if (totalSamples == 0) return;
 
+        // Ask for this view's columns and draw the newest ones that match;
+        // until they arrive the pyramids stand in for them.
+        // The GPU envelope only needs samples for columns narrower than a
+        // pyramid block.
+        ColumnView view = currentColumnView();
+        bool needColumns = !drawingGpuEnvelope() || samplesPerColumn() < PeakPyramid::baseBlockSize;
 
-        // Blue waveform.
-        glColor3f(0.0f, 0.0f, 1.0f);
-        // Ensure full-pixel lines.
-        glLineWidth(1.0f);
+        if (needColumns) columns.request(view);
+        shownColumns = needColumns ? columns.latest() : nullptr;
 
-        // Lambda function that draws a channel.
-        auto drawChannel = [&](const std::vector<float>& channel, int yOffset, int heightPx) {
-            float samplesPerPixel = 1.0f / zoomLevel;
+        if (shownColumns && !(shownColumns->view == view)) {
+            shownColumns.reset();
+        }
 
-            // Decide rendering mode based on zoom level.
-            if (samplesPerPixel > 5.0f) {
-                // ZOOMED OUT: Envelope (min/max per pixel column)
-                glBegin(GL_LINES);
+        // Rebuild the vertices only when what they show has changed.
+        currentGeometryKey(frameKey);
+        bool changed = !(frameKey == geometryKey);
 
-                for (int x = 0; x < w(); ++x) {
-                    int startSample = scrollOffset + static_cast<int>(x * samplesPerPixel);
-                    int endSample = std::min(scrollOffset + static_cast<int>((x + 1) * samplesPerPixel), (int)channel.size());
+        if (changed) {
+            buildGeometry();
+            renderer.upload(geometry);
+            std::swap(geometryKey, frameKey);
+        }
 
-                    float minY = 1.0f, maxY = -1.0f;
-                    for (int i = startSample; i < endSample; ++i) {
-                        float s = channel[i];
-                        minY = std::min(minY, s);
-                        maxY = std::max(maxY, s);
-                    }
+        uint64_t envelopeEnd = Instrumentation::now();
 
-                    bool isSilent = true;
+        // Render the waveform into the cached layer when it changed; frames
+        // where only the cursor moved just copy the layer to the screen.
+        if (!changed && waveformLayer.holds(w(), h())) {
+            waveformLayer.present();
+        }
+        else if (waveformLayer.begin(w(), h())) {
+            glClear(GL_COLOR_BUFFER_BIT);
+            drawWaveform();
+            waveformLayer.end();
+            waveformLayer.present();
+        }
+        else {
+            drawWaveform();
+        }
 
-                    for (int i = startSample; i < endSample; ++i) {
-                        // Noise threshold
-                        if (std::abs(channel[i]) > 0.005f) {  
-                            isSilent = false;
-                            break;
-                        }
-                    }
+        uint64_t submitEnd = Instrumentation::now();
 
-                    if (isSilent) {
-                        // Flat silent section → draw a thin horizontal line
-                        float yFlatPx = yOffset + (1.0f - 0.0f) * (heightPx / 2.0f);  // Amplitude 0
+        // --- Draw playback cursor ---
+        int64_t sampleToDraw = drawnCursorSample();
 
-                        glVertex2f(x, yFlatPx);
-                        // 1-pixel wide horizontal line.
-                        glVertex2f(x + 1, yFlatPx);  
-                        // Skip the rest of loop.
-                        continue;  
-                    }
+        if (sampleToDraw >= 0) {
+            int64_t visibleStart = scrollOffset;
+            int64_t visibleEnd = scrollOffset + static_cast<int64_t>(std::ceil(w() / zoomLevel));
 
-                    // Avoid disappearing lines: pad very flat sections
-                    // Note: Near-flat, but not completely silent → pad it
-                    if (std::abs(maxY - minY) < 0.01f) {
-                        minY -= 0.005f; maxY += 0.005f;
-                    }
+            if (sampleToDraw >= visibleStart && sampleToDraw < visibleEnd) {
+                float x = static_cast<float>((sampleToDraw - scrollOffset) * zoomLevel);
+                renderer.drawCursor(x, 0.0f, (float)h(), 1.0f, 0.0f, 0.0f);
+            }
+        }
 
-                    float yMinPx = yOffset + (1.0f - std::clamp(minY, -1.0f, 1.0f)) * (heightPx / 2.0f);
-                    float yMaxPx = yOffset + (1.0f - std::clamp(maxY, -1.0f, 1.0f)) * (heightPx / 2.0f);
+        if (levelsVisible && !channelLevels.empty()) {
+            drawLoudness();
+        }
 
-                    glVertex2f(x, yMinPx);
-                    glVertex2f(x, yMaxPx);
-                }
-                glEnd();
-            }
-            else {
-                // ZOOMED IN: One sample per vertex, smooth line.
-                glBegin(GL_LINE_STRIP);
-
-                // Note: Add +1 sample to visible range to ensure last visible pixel is drawn.
-                int visibleSamples = static_cast<int>(std::ceil(w() / zoomLevel)) + 1;
-                int endSample = std::min(scrollOffset + visibleSamples, (int)channel.size());
-
-                for (int i = scrollOffset; i < endSample; ++i) {
-                    float x = (i - scrollOffset) * zoomLevel;
-                    float y = yOffset + (1.0f - std::clamp(channel[i], -1.0f, 1.0f)) * (heightPx / 2.0f);
-                    glVertex2f(x, y);
-                }
+        if (meterVisible && ctx) {
+            drawMeter(ctx->capture ? ctx->capture->meter.read() : ctx->audio->meter.read());
+        }
 
-                glEnd();
+        uint64_t drawEnd = Instrumentation::now();
+        Instrumentation& probes = instrumentation();
+        probes.record(Probe::Envelope, drawStart, envelopeEnd);
+        probes.record(Probe::Submit, envelopeEnd, submitEnd);
+        probes.record(Probe::Cursor, submitEnd, drawEnd);
+        probes.record(Probe::Draw, drawStart, drawEnd);
+        probes.collect();
 
-                // --- Draw nodes if zoomed in enough ---
-                float samplesPerPixel = 1.0f / zoomLevel;
+        if (hudVisible) {
+            drawHud(probes);
+        }
+    }
 
-                if (samplesPerPixel <= 0.1f) {
-                    glColor3f(1.0f, 0.0f, 0.0f); // red nodes
-                    glPointSize(4.0f);           // size of each node
-                    glBegin(GL_POINTS);
+    // Timings of the last second, top left, over the waveform.
+    void drawHud(const Instrumentation& probes) {
+        std::vector<std::string> lines = probes.summary();
+        const int lineHeight = 14;
 
-                    for (int i = scrollOffset; i < endSample; ++i) {
-                        float x = (i - scrollOffset) * zoomLevel;
-                        float y = yOffset + (1.0f - std::clamp(channel[i], -1.0f, 1.0f)) * (heightPx / 2.0f);
-                        glVertex2f(x, y);
-                    }
+        // Translucent white panel behind the text.
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glColor4f(1.0f, 1.0f, 1.0f, 0.8f);
+        glRectf(4.0f, (float)(h() - 6 - lineHeight * static_cast<int>(lines.size())), 420.0f, (float)(h() - 4));
+        glDisable(GL_BLEND);
 
-                    glEnd();
-                }
+        glColor3f(0.0f, 0.0f, 0.0f);
+        gl_font(FL_COURIER, 12);
+
+        for (size_t i = 0; i < lines.size(); ++i) {
+            gl_draw(lines[i].c_str(), 8.0f, (float)(h() - lineHeight * static_cast<int>(i + 1)));
+        }
+    }
+
+    // The file's loudness, top right, once its levels are complete.
+    void drawLoudness() {
+        if (!summaryReady) {
+            bool complete = true;
+            for (const auto& track : channelLevels) complete = complete && track->complete();
+
+            if (complete) {
+                loudnessSummary = summariseLoudness(channelLevels);
+                summaryReady = true;
             }
-        };
+        }
+
+        char text[128];
 
-        // If waveform doesn't fill the full width, paint the rest in grey
-        int totalSamples = leftSamples.size();
-        int visibleSamples = visibleSamplesCount();
-        int endSample = scrollOffset + visibleSamples;
-        // compute last drawn x position
-        float lastX = (float)(std::min(endSample, totalSamples) - scrollOffset) * zoomLevel;
-
-        if (lastX < (float)w()) {
-            glBegin(GL_QUADS);
-                // grey background
-                glColor3f(0.3f, 0.3f, 0.3f); 
-                // top-right
-                glVertex2f((float)w(), (float)h()); 
-                // top-left
-                glVertex2f(lastX, (float)h()); 
-                // bottom-left
-                glVertex2f(lastX, 0.0f);       
-                // bottom-right
-                glVertex2f((float)w(), 0.0f);       
-            glEnd();
-        }
-
-        // Waveform color (blue).
-        glColor3f(0.0f, 0.0f, 1.0f); 
-
-        if (isStereo) {
-            // Draw both left and right channels.
-            drawChannel(leftSamples, 0, halfHeight);
-            drawChannel(rightSamples, halfHeight, halfHeight);
-
-            // --- Draw separation line between waveforms ---
-
-            // Dim gray
-            glColor3f(0.412f, 0.412f, 0.412f); 
-            glLineWidth(1.0f);
-            glBegin(GL_LINES);
-            // from left
-            glVertex2f(0, h() / 2);     
-            // to right
-            glVertex2f(w(), h() / 2);   
-            glEnd();
-
-            // --- Draw zero lines (middle line) for both channels. ---
-
-            // Gainsboro
-            glColor3f(0.863f, 0.863f, 0.863f); 
-            glBegin(GL_LINES);
-                glLineWidth(1.0f);
-                glVertex2f(0.0f,    halfHeight + (halfHeight / 2));
-                glVertex2f((float)w(), halfHeight + (halfHeight / 2));
-                //
-                glLineWidth(1.0f);
-                glVertex2f(0.0f,    halfHeight / 2.0f);
-                glVertex2f((float)w(), halfHeight / 2.0f);
-            glEnd();
-        }
-        // mono = full height
+        if (summaryReady) {
+            std::snprintf(text, sizeof(text), "%.1f LUFS   %.1f dBTP   RMS %.1f dBFS", loudnessSummary.integrated,
+                          loudness::decibels(loudnessSummary.truePeak), loudness::decibels(loudnessSummary.rms));
+        }
         else {
-            drawChannel(leftSamples, 0, h());  
-            // --- Draw zero line (middle line). ---
-            glColor3f(0.863f, 0.863f, 0.863f); 
-            glBegin(GL_LINES);
-                glLineWidth(1.0f);
-                glVertex2f(0.0f,    halfHeight);
-                glVertex2f((float)w(), halfHeight);
-            glEnd();
+            std::snprintf(text, sizeof(text), "Analysing levels...");
         }
 
-        // --- Draw playback cursor ---
-        int sampleToDraw = -1;
+        gl_font(FL_COURIER, 12);
+        float textWidth = static_cast<float>(gl_width(text));
+        // Clear of the meter.
+        float right = w() - (meterVisible ? 58.0f : 8.0f);
+
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glColor4f(1.0f, 1.0f, 1.0f, 0.8f);
+        glRectf(right - textWidth - 8.0f, (float)(h() - 22), right, (float)(h() - 4));
+        glDisable(GL_BLEND);
+
+        glColor3f(0.0f, 0.0f, 0.0f);
+        gl_draw(text, right - textWidth - 4.0f, (float)(h() - 17));
+    }
+
+    // Both sides' RMS bars and peak ticks at the right edge, -60 to 0 dBFS,
+    // with the momentary loudness below them.
+    void drawMeter(const MeterReading& reading) {
+        const float quietest = -60.0f, barWidth = 10.0f;
+        float right = w() - 6.0f, left = right - 40.0f;
+        float bottom = 22.0f, top = h() - 6.0f;
+        auto heightOf = [&](float amplitude) {
+            float fraction = (loudness::decibels(amplitude) - quietest) / -quietest;
+            return bottom + (top - bottom) * std::clamp(fraction, 0.0f, 1.0f);
+        };
+
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glColor4f(1.0f, 1.0f, 1.0f, 0.8f);
+        glRectf(left, 4.0f, right, top);
+        glDisable(GL_BLEND);
+
+        for (size_t side = 0; side < 2; ++side) {
+            float x = left + 8.0f + side * (barWidth + 4.0f);
+            float peak = heightOf(reading.peak[side]);
 
-        if (isPlaying() || isPaused()) {
-            // The cursor moves in realtime (isPlaying) or is shown at its last position (isPaused).
-            sampleToDraw = playbackSample;
+            // Forest green
+            glColor3f(0.13f, 0.55f, 0.13f);
+            glRectf(x, bottom, x + barWidth, heightOf(reading.rms[side]));
+
+            // Red from -1 dBFS up.
+            if (reading.peak[side] >= 0.891f) glColor3f(1.0f, 0.0f, 0.0f);
+            else glColor3f(0.0f, 0.39f, 0.0f);
+            glRectf(x, peak - 1.0f, x + barWidth, peak + 1.0f);
         }
-        else {
-            // The cursor has been manually moved (eg: mouse click, Home key...).
-            sampleToDraw = movedCursorSample;
+
+        char text[16];
+        if (reading.momentary > -100.0f) std::snprintf(text, sizeof(text), "%.1f", reading.momentary);
+        else std::snprintf(text, sizeof(text), "-inf");
+
+        glColor3f(0.0f, 0.0f, 0.0f);
+        gl_font(FL_COURIER, 10);
+        gl_draw(text, left + 4.0f, 8.0f);
+    }
+
+    // Everything the waveform geometry depends on. The cursor is drawn separately.
+    struct GeometryKey {
+        int64_t scrollOffset = -1;
+        double zoomLevel = 0.0;
+        int width = 0;
+        int height = 0;
+        const void* samples = nullptr;
+        size_t decoded = 0;
+        std::vector<const void*> peaks;
+        // Pyramids fill in while the file loads.
+        std::vector<size_t> peaksBuilt;
+        // ColumnData::serial; 0 while the pyramid preview is shown.
+        uint64_t columns = 0;
+        // The loop band, empty when not looping.
+        int64_t loopStart = 0;
+        int64_t loopEnd = 0;
+        // The envelope is drawn by EnvelopeShader, not part of the geometry.
+        bool gpu = false;
+        // The level overlays, if shown, fill in with the tracks.
+        const void* levels = nullptr;
+        size_t levelsBuilt = 0;
+
+        bool operator==(const GeometryKey& other) const {
+            return scrollOffset == other.scrollOffset && zoomLevel == other.zoomLevel
+                && width == other.width && height == other.height
+                && samples == other.samples && decoded == other.decoded
+                && peaks == other.peaks && peaksBuilt == other.peaksBuilt && columns == other.columns
+                && loopStart == other.loopStart && loopEnd == other.loopEnd && gpu == other.gpu
+                && levels == other.levels && levelsBuilt == other.levelsBuilt;
+        }
+    };
+
+    // Fills key in place, so its vectors are reused from frame to frame.
+    void currentGeometryKey(GeometryKey& key) const {
+        key.scrollOffset = scrollOffset;
+        key.zoomLevel = zoomLevel;
+        key.width = w();
+        key.height = h();
+        key.samples = samples.get();
+        key.decoded = samples ? samples->available() : 0;
+        key.peaks.clear();
+        key.peaksBuilt.clear();
+
+        for (const auto& peaks : channelPeaks) {
+            key.peaks.push_back(peaks.get());
+            key.peaksBuilt.push_back(peaks->available());
         }
 
-        if (sampleToDraw >= 0) {
-            int visibleStart = scrollOffset;
-            int visibleEnd = scrollOffset + static_cast<int>(std::ceil(w() / zoomLevel));
+        key.columns = shownColumns ? shownColumns->serial : 0;
+        key.loopStart = isLooping() ? loopStart : 0;
+        key.loopEnd = isLooping() ? loopEnd : 0;
+        key.gpu = drawingGpuEnvelope();
+        key.levels = levelsVisible && !channelLevels.empty() ? channelLevels[0].get() : nullptr;
+        key.levelsBuilt = 0;
 
-            if (sampleToDraw >= visibleStart && sampleToDraw < visibleEnd) {
-                float x = (sampleToDraw - scrollOffset) * zoomLevel;
-                glColor3f(1.0f, 0.0f, 0.0f);
-                glLineWidth(1.0f);
-                glBegin(GL_LINES);
-                glVertex2f(x, 0);
-                glVertex2f(x, h());
-                glEnd();
+        for (const auto& track : channelLevels) {
+            key.levelsBuilt += track->available();
+        }
+    }
+
+    ColumnView currentColumnView() const {
+        ColumnView view;
+        view.scrollOffset = scrollOffset;
+        view.samplesPerColumn = samplesPerColumn();
+        view.width = w();
+        view.decoded = samples ? samples->available() : 0;
+
+        for (const auto& peaks : channelPeaks) {
+            view.peaksBuilt += peaks->available();
+        }
+
+        // The GPU envelope reduces raw samples itself. The window starts on a
+        // column boundary and runs a screen past the view, and only moves
+        // every half screen, so panning doesn't ask for a new one every frame.
+        if (drawingGpuEnvelope()) {
+            int64_t half = std::max(w() / 2, 1);
+            int64_t first = view.firstColumn();
+            int64_t alignedColumn = (first >= 0 ? first : first - half + 1) / half * half;
+
+            view.rawSamples = true;
+            view.scrollOffset = static_cast<int64_t>(alignedColumn * view.samplesPerColumn);
+            view.width = 2 * w();
+        }
+
+        return view;
+    }
+
+    // Zoomed out with a working shader that can hold every channel's pyramid.
+    bool drawingGpuEnvelope() const {
+        if (!gpuEnvelope || !envelopeShader.supported() || samplesPerColumn() <= 5.0) return false;
+
+        for (const auto& peaks : channelPeaks) {
+            if (!envelopeShader.canDraw(*peaks)) return false;
+        }
+
+        return true;
+    }
+
+    // Draws each lane's envelope with the shader, positioned as in appendWaveformChannel().
+    void drawGpuEnvelopes() {
+        if (!drawingGpuEnvelope()) return;
+
+        EnvelopeShader::Columns grid;
+        grid.samplesPerColumn = samplesPerColumn();
+        grid.firstColumn = static_cast<int64_t>(std::floor(scrollOffset / grid.samplesPerColumn));
+        grid.count = static_cast<size_t>(std::max(w(), 0)) + 1;
+        grid.shift = scrollOffset / grid.samplesPerColumn - grid.firstColumn;
+
+        size_t lanes = channelPeaks.size();
+        auto laneTop = [&](size_t lane) { return static_cast<int>(lane * h() / lanes); };
+
+        if (!shownColumns) envelopeShader.clearSampleWindows();
+
+        for (size_t c = 0; c < lanes; ++c) {
+            envelopeShader.updatePeaks(c, *channelPeaks[c]);
+
+            if (shownColumns && c < shownColumns->samples.size()) {
+                envelopeShader.setSampleWindow(c, shownColumns->serial, shownColumns->view.scrollOffset, shownColumns->samples[c]);
             }
+
+            envelopeShader.draw(c, grid, (float)laneTop(c), (float)(laneTop(c + 1) - laneTop(c)), 0.0f, 0.0f, 1.0f);
+        }
+    }
+
+    // The geometry with the GPU envelopes between the waveforms and the overlays.
+    void drawWaveform() {
+        renderer.draw(geometry, 0, overlayFirst);
+        drawGpuEnvelopes();
+        renderer.draw(geometry, overlayFirst);
+    }
+
+    static void columnsReady(void* view) {
+        static_cast<WaveformView*>(view)->redraw();
+    }
+
+    // Fills geometry with the background, waveforms and guide lines, in drawing order.
+    void buildGeometry() {
+        WaveformScene scene;
+        scene.width = w();
+        scene.height = h();
+        scene.scrollOffset = scrollOffset;
+        scene.zoomLevel = zoomLevel;
+        scene.samplesPerColumn = samplesPerColumn();
+        scene.totalSamples = totalSamples;
+
+        if (isLooping()) {
+            scene.loopStart = loopStart;
+            scene.loopEnd = loopEnd;
         }
+
+        scene.peaks = &channelPeaks;
+        scene.columns = shownColumns.get();
+        // The shader draws the envelope itself (drawGpuEnvelopes()).
+        scene.skipEnvelopes = drawingGpuEnvelope();
+
+        scene.levels = levelsVisible ? &channelLevels : nullptr;
+
+        buildWaveformGeometry(geometry, scene);
+        overlayFirst = geometry.batches.size();
+        appendLevelOverlays(geometry, scene);
     }
 
     int handle(int event) override {
@@ -419,20 +729,23 @@ protected:
             // Zoom with mouse wheel
             case FL_MOUSEWHEEL: {
                 // zoom in/out
-                if (Fl::event_dy() < 0) {
-                    zoomLevel *= 1.1f;  // zoom in
+                if (quantizedZoom) {
+                    setZoomStep(zoomStep + (Fl::event_dy() < 0 ? -1 : 1));
+                }
+                else if (Fl::event_dy() < 0) {
+                    zoomLevel *= 1.1;  // zoom in
                 }
                 else {
-                    zoomLevel *= 0.9f;  // zoom out
+                    zoomLevel *= 0.9;  // zoom out
                 }
 
                 zoomLevel = std::clamp(zoomLevel, zoomMin, zoomMax);
 
                 //int visibleSamples = static_cast<int>(w() / zoomLevel);
                 // re-clamp scrollOffset to keep view valid
-                int visibleSamples = visibleSamplesCount();
-                int maxOffset = std::max(0, (int)leftSamples.size() - visibleSamples);
-                scrollOffset = std::clamp(scrollOffset, 0, maxOffset);
+                int64_t visibleSamples = visibleSamplesCount();
+                int64_t maxOffset = std::max<int64_t>(0, totalSamples - visibleSamples);
+                scrollOffset = std::clamp<int64_t>(scrollOffset, 0, maxOffset);
 
                 updateScrollbar();
                 redraw();
@@ -443,11 +756,7 @@ protected:
             // The user has clicked and moved the cursor along the waveform.
             case FL_PUSH: {
                 if (Fl::event_button() == FL_LEFT_MOUSE) {
-                    int mouseX = Fl::event_x();
-                    int sample = scrollOffset + static_cast<int>(mouseX / zoomLevel);
-
-                    // Clamp within sample range
-                    sample = std::clamp(sample, 0, (int)leftSamples.size() - 1);
+                    int64_t sample = sampleAt(Fl::event_x());
 
                     setPlaybackSample(sample);
                     movedCursorSample = sample;
@@ -464,15 +773,43 @@ protected:
                 return 0;
             }
 
+            // Dragging the cursor scrubs: the audio follows the mouse.
+            case FL_DRAG: {
+                if (!(Fl::event_state() & FL_BUTTON1)) return 0;
+
+                int64_t sample = sampleAt(Fl::event_x());
+                setPlaybackSample(sample);
+                movedCursorSample = sample;
+                scrubbing = true;
+
+                if (onScrubCallback != nullptr) {
+                    onScrubCallback(sample, false);
+                }
+
+                return 1;
+            }
+
+            case FL_RELEASE: {
+                if (!scrubbing || Fl::event_button() != FL_LEFT_MOUSE) return 0;
+
+                scrubbing = false;
+
+                if (onScrubCallback != nullptr) {
+                    onScrubCallback(sampleAt(Fl::event_x()), true);
+                }
+
+                return 1;
+            }
+
             case FL_KEYDOWN: {
                 int key = Fl::event_key();
 
                 // Spacebar: ' ' => ASCII code 32.
                 if (key == ' ') {
                     if (ctx) {
-                        if (isPaused() || ctx->audio->eof) {
+                        // The seek in stop() clears the end of file state.
+                        if (isPaused() || ctx->audio->atEnd()) {
                           stop(ctx);
-                          ctx->audio->eof = false;
                         }
 
                         if (isPlaying()) {
@@ -486,6 +823,32 @@ protected:
 
                     return 1;
                 }
+                else if (key == 'h') {
+                    toggleHud();
+                    return 1;
+                }
+                else if (key == 'v') {
+                    setLevelsVisible(!levelsVisible);
+                    return 1;
+                }
+                else if (key == 'm') {
+                    toggleMeter();
+                    return 1;
+                }
+                else if (key == 'a' || key == 'b') {
+                    // Loop start (A) or end (B) at the cursor; the loop turns
+                    // on once both are set.
+                    int64_t sample = drawnCursorSample();
+                    (key == 'a' ? loopStart : loopEnd) = sample;
+                    loopEnabled = true;
+                    loopChanged();
+                    return 1;
+                }
+                else if (key == 'l') {
+                    loopEnabled = !loopEnabled;
+                    loopChanged();
+                    return 1;
+                }
                 else if (key == FL_Pause) {
                     if (ctx) {
                         pause(ctx);
@@ -510,7 +873,7 @@ protected:
                     // Process only when playback is stopped.
                     if (ctx && !isPlaying()) {
                         // Take the audio cursor to the end position.
-                        movedCursorSample = static_cast<int>(leftSamples.size()) - 1;
+                        movedCursorSample = totalSamples - 1;
                         resetCursor(ctx);
 
                         return 1;
@@ -528,113 +891,176 @@ protected:
     }
 
 private:
-    std::vector<float> leftSamples;
-    std::vector<float> rightSamples;
+    // The file's samples, shared with the audio device. Null while decoding.
+    std::shared_ptr<const SampleSource> samples;
+    // Prepares the columns off the UI thread; shownColumns is the result
+    // drawn by the current geometry, if any.
+    ColumnWorker columns;
+    std::shared_ptr<const ColumnData> shownColumns;
+    // Waveform vertices, rebuilt when geometryKey no longer matches the view.
+    // The level overlays are the batches from overlayFirst on.
+    BatchGeometry geometry;
+    size_t overlayFirst = 0;
+    GeometryKey geometryKey;
+    // This frame's key, kept to reuse its storage.
+    GeometryKey frameKey;
+    BatchRenderer renderer;
+    // The rendered waveform without the cursor.
+    LayerCache waveformLayer;
+    // Zoomed-out envelope on the GPU (setGpuEnvelope()).
+    EnvelopeShader envelopeShader;
+    bool gpuEnvelope = false;
+    // Envelope pyramids, one per channel (drawn as stacked lanes), rebuilt
+    // whenever the samples change.
+    std::vector<std::shared_ptr<const PeakPyramid>> channelPeaks{ std::make_shared<PeakPyramid>() };
+    // Length of the file, known from the pyramids before the samples arrive.
+    // Live input's length so far.
+    int64_t totalSamples = 0;
+    // Samples shown at most of live input (setLiveInput()), 0 for a file.
+    int64_t liveWindow = 0;
+    // followLive()'s last position: complete columns at that zoom.
+    int64_t liveColumns = -1;
+    double livePerColumn = 0.0;
+    // Level tracks, one per channel (setLevels()), and the summary drawn once
+    // they are complete.
+    LevelTracks channelLevels;
+    LoudnessSummary loudnessSummary;
+    bool summaryReady = false;
+    bool levelsVisible = false;
+    bool meterVisible = false;
     Fl_Scrollbar* scrollbar = nullptr;
+    // Samples per scrollbar unit.
+    int64_t scrollbarStep = 1;
     // Auto-calculated minimum zoom (fit to screen).
     // Pixels per sample.
-    float zoomLevel = 1.0f;
+    double zoomLevel = 1.0;
     // Fit-to-screen (current starting zoom)
-    float zoomFit = 1.0f;     
+    double zoomFit = 1.0;
     // Allow zooming out further
-    float zoomMin = 1.0f;     
+    double zoomMin = 1.0;
     // Allow up to 10 pixels per sample
-    float zoomMax = 10.0f; 
-    int scrollOffset = 0;
+    double zoomMax = 10.0;
+    int64_t scrollOffset = 0;
     // -1 = not playing
-    int playbackSample = -1;
+    int64_t playbackSample = -1;
     bool playing = false;
     bool paused = false;
-    bool isStereo = true;
     // Position of the cursor when it is manually moved.
-    int movedCursorSample = 0;
+    int64_t movedCursorSample = 0;
+    // A/B loop; only played when loopEnabled and loopEnd > loopStart.
+    int64_t loopStart = 0;
+    int64_t loopEnd = 0;
+    bool loopEnabled = false;
+    // The left button is down and has moved.
+    bool scrubbing = false;
     AppContext* ctx = nullptr;
+    bool hudVisible = false;
+    bool quantizedZoom = true;
+    // Ladder step of zoomLevel when quantizedZoom.
+    int zoomStep = 0;
+
+    // Moves to ladder step, kept within zoomMin and zoomMax. The finest step
+    // is the one at or just past zoomMax, so that the steps reach it (and the
+    // sample nodes drawn there).
+    void setZoomStep(int step) {
+        int first = stepForSamplesPerColumn(1.0 / zoomMax);
+        if (stepSamplesPerColumn(first) > 1.0 / zoomMax) --first;
+        int last = std::max(first, stepForSamplesPerColumn(1.0 / zoomMin) - 1);
+        zoomStep = std::clamp(step, first, last);
+        zoomLevel = 1.0 / stepSamplesPerColumn(zoomStep);
+    }
+
+    // Where draw() puts the cursor.
+    int64_t drawnCursorSample() const {
+        // The cursor moves in realtime (isPlaying) or is shown at its last position (isPaused).
+        if (isPlaying() || isPaused()) return playbackSample;
+
+        // The cursor has been manually moved (eg: mouse click, Home key...).
+        return movedCursorSample;
+    }
+
+    // The pixel column the cursor is in at sample.
+    int64_t cursorColumn(int64_t sample) const {
+        return static_cast<int64_t>(std::floor((sample - scrollOffset) * zoomLevel));
+    }
+
+    // The sample under x, within the file.
+    int64_t sampleAt(int x) const {
+        int64_t sample = scrollOffset + static_cast<int64_t>(x / zoomLevel);
+        return std::clamp<int64_t>(sample, 0, std::max<int64_t>(totalSamples - 1, 0));
+    }
+
+    void loopChanged() {
+        if (onLoopCallback != nullptr) {
+            onLoopCallback(isLooping() ? loopStart : 0, isLooping() ? loopEnd : 0);
+        }
+
+        redraw();
+    }
+
     // helper to compute how many samples fit inside the widget width at current zoom
-    int visibleSamplesCount() const {
-        if (zoomLevel <= 0.0f) return (int)leftSamples.size();
+    int64_t visibleSamplesCount() const {
+        if (zoomLevel <= 0.0) return totalSamples;
         // number of samples that correspond to the width: ceil(w / zoomLevel)
-        int vs = static_cast<int>(std::ceil(static_cast<float>(w()) / zoomLevel));
-        vs = std::max(1, vs);
-        vs = std::min((int)leftSamples.size(), vs);
+        int64_t vs = static_cast<int64_t>(std::ceil(w() / zoomLevel));
+        vs = std::max<int64_t>(1, vs);
+        vs = std::min(totalSamples, vs);
         return vs;
     }
 };
 
-// ---- Timer Callback ----
-void update_cursor_timer(void* userdata) {
-    auto* ctx = static_cast<AppContext*>(userdata);
-    // Reads from atomic.
-    int sample = ctx->audio->currentSample();
-    ctx->view->setPlaybackSample(sample);
+// ---- Frame Ticks ----
+// Moves the playback cursor, or scrolls along with live input. Returns the
+// seconds until the picture changes next (the cursor or the input reaching
+// the next pixel column), or -1 once nothing moves.
+double advance_view(AppContext* ctx) {
+    auto* view = ctx->view;
+
+    if (ctx->capture) {
+        view->followLive(static_cast<int64_t>(ctx->capture->frames()));
+        return view->samplesPerColumn() / std::max(ctx->capture->sampleRate(), 1u);
+    }
+
+    if (!view->isPlaying()) return -1.0;
+
+    // What is being heard, not what was last handed to the device.
+    int64_t sample = ctx->audio->heardSample();
+    view->setPlaybackSample(sample);
 
     // --- Smart auto-scroll ---
     // Auto-scroll the view if cursor gets near right edge
 
     // pixels from right edge
     int margin = 30;  
-    float zoom = ctx->view->getZoomLevel();
-    int viewWidth = ctx->view->w();
-    int cursorX = static_cast<int>((sample - ctx->view->getScrollOffset()) * zoom);
+    double zoom = view->getZoomLevel();
+    int viewWidth = view->w();
+    double cursorX = (sample - view->getScrollOffset()) * zoom;
 
     if (cursorX > viewWidth - margin) {
-        int newOffset = sample - static_cast<int>((viewWidth - margin) / zoom);
-        ctx->view->setScrollOffset(newOffset);
-    }
-
-    if (sample < ctx->audio->totalSamples && ctx->view->isPlaying()) {
-        // ~60 FPS
-        Fl::repeat_timeout(0.016, update_cursor_timer, ctx);
-    }
-}
-
-// ---- WAV Loader ----
-bool loadWavStereo(const std::string& path, std::vector<float>& left, std::vector<float>& right, bool& isStereo) {
-    // Force float output
-    ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 0, 0);  
-    ma_decoder decoder;
-
-    if (ma_decoder_init_file(path.c_str(), &config, &decoder) != MA_SUCCESS) {
-        std::cerr << "Failed to load WAV file: " << path << std::endl;
-        return false;
+        int64_t newOffset = sample - static_cast<int64_t>((viewWidth - margin) / zoom);
+        view->setScrollOffset(newOffset);
     }
-
-    ma_uint64 frameCount = 0;
-    if (ma_decoder_get_length_in_pcm_frames(&decoder, &frameCount) != MA_SUCCESS) {
-        std::cerr << "Failed to get length" << std::endl;
-        ma_decoder_uninit(&decoder);
-        return false;
+    else if (cursorX < 0 && view->isLooping()) {
+        // Wrapped back to a loop start that is scrolled out of view.
+        view->setScrollOffset(sample - static_cast<int64_t>(margin / zoom));
     }
 
-    std::vector<float> tempData(static_cast<size_t>(frameCount * decoder.outputChannels));
+    if (sample >= ctx->audio->totalSamples) return -1.0;
 
-    ma_uint64 framesRead = 0;
-    if (ma_decoder_read_pcm_frames(&decoder, tempData.data(), frameCount, &framesRead) != MA_SUCCESS) {
-        std::cerr << "Failed to read PCM frames" << std::endl;
-        ma_decoder_uninit(&decoder);
-        return false;
-    }
-
-    ma_decoder_uninit(&decoder);
+    return static_cast<double>(view->samplesToNextColumn(sample)) / std::max(ctx->audio->sampleRate, 1);
+}
 
-    if (decoder.outputChannels == 1) {
-        // Mono data
-        left = std::vector<float>(tempData);  
-        // Mirror for playback
-        right = left;                         
-        isStereo = false;
-    }
-    else {
-        // Split into left/right channels
-        left.clear();  right.clear();
-        for (size_t i = 0; i < framesRead; ++i) {
-            left.push_back(tempData[i * decoder.outputChannels]);
-            right.push_back(tempData[i * decoder.outputChannels + 1]);
-        }
+// What the frame scheduler does on each tick: advance_view(), and the level
+// meter if shown.
+double advance_frame(AppContext* ctx) {
+    auto* view = ctx->view;
+    bool moving = ctx->capture || view->isPlaying();
 
-        isStereo = true;
-    }
+    // The meter moves with the sound, not by pixel columns: every refresh.
+    if (moving && view->isMeterVisible()) view->redraw();
 
-    return true;
+    double next = advance_view(ctx);
+    return moving && view->isMeterVisible() ? 0.0 : next;
 }
 
 void resetCursor(AppContext* ctx) 
@@ -643,43 +1069,55 @@ void resetCursor(AppContext* ctx)
     auto* audio = ctx->audio;
 
     // Get the cursor's starting point.
-    int resetTo = view->getMovedCursorSample();
+    int64_t resetTo = view->getMovedCursorSample();
     // Reset the cursor to its initial audio position.
-    audio->playbackSampleIndex = resetTo;
+    audio->seek(resetTo);
 
     // Compute a target offset before the cursor, (e.g: show 10% of the window before the cursor.)
-    float zoom = view->getZoomLevel();
+    double zoom = view->getZoomLevel();
     // Number of samples that fit in the view
-    int visibleSamples = static_cast<int>(view->w() / zoom);
+    int64_t visibleSamples = static_cast<int64_t>(view->w() / zoom);
     // Shift back by a percentage of visible samples (e.g., 10%)
-    int marginSamples = static_cast<int>(visibleSamples * 0.1f);
+    int64_t marginSamples = static_cast<int64_t>(visibleSamples * 0.1);
     // Compute the new scroll offset
-    int newScrollOffset = std::max(0, resetTo - marginSamples);
+    int64_t newScrollOffset = std::max<int64_t>(0, resetTo - marginSamples);
     // Apply it.
     view->setScrollOffset(newScrollOffset);
     // Force the waveform (and cursor) to repaint
     view->redraw();  
 }
 
+// Stops the device a scrub of a stopped (or paused) file started.
+void settle_scrub(void* data)
+{
+    auto* ctx = static_cast<AppContext*>(data);
+
+    if (!ctx->view->isPlaying()) ctx->audio->stop();
+}
+
 void play(AppContext* ctx) 
 {
-    if (ctx->view->isPlaying() && ctx->audio->eof) {
+    // Samples are still being decoded.
+    if (!ctx->audio->ready) {
+        return;
+    }
+
+    if (ctx->view->isPlaying() && ctx->audio->atEnd()) {
         ctx->view->setPlaying(false);
     }
 
     if (!ctx->view->isPlaying()) {
         ctx->view->setPlaying(true);
 
-        if (ctx->view->isPaused() || ctx->audio->eof) {
+        if (ctx->view->isPaused() || ctx->audio->atEnd()) {
             resetCursor(ctx);
-            ctx->audio->eof = false;
         }
         else {
             ctx->view->setPlaybackSample(0);
         }
 
         ctx->audio->start();
-        Fl::add_timeout(0.016, update_cursor_timer, ctx);
+        ctx->frames->wake();
     }
     else {
         resetCursor(ctx);
@@ -693,7 +1131,8 @@ void stop(AppContext* ctx)
 
     if (view->isPlaying()) {
         view->setPlaying(false);
-        ma_device_stop(&audio->device);
+        audio->stop();
+        ctx->frames->stop();
     }
 
     // Cancel possible pause state.
@@ -708,55 +1147,296 @@ void pause(AppContext* ctx)
     auto* audio = ctx->audio;
 
     if (view->isPlaying()) {
-        // Pause
+        // Pause where the cursor is now, not where the last tick left it.
+        view->setPlaybackSample(audio->heardSample());
         view->setPlaying(false);
         view->setPaused(true);
-        ma_device_stop(&audio->device);
+        audio->stop();
+        ctx->frames->stop();
     }
     else if (view->isPaused() && !view->isPlaying()) {
         // Resume from where playback paused
-        int resumeSample = view->getPlaybackSample();
-        audio->playbackSampleIndex = resumeSample;
+        int64_t resumeSample = view->getPlaybackSample();
+        audio->seek(resumeSample);
         view->setPlaying(true);
         view->setPaused(false);
-        ma_device_start(&audio->device);
-        Fl::add_timeout(0.016, update_cursor_timer, ctx);
+        audio->start();
+        ctx->frames->wake();
     }
 }
 
-// ---- Main ----
-int main(int argc, char** argv) {
-    if (argc < 2) {
-        std::cerr << "Usage: ./waveform_viewer file.wav\n";
-        return 1;
+// ---- Background Loading ----
+
+// Gives decoded samples to the audio device and the waveform view.
+bool installSamples(AppContext* ctx, std::shared_ptr<const SampleSource> samples) 
+{
+    if (!ctx->audio->init(samples, static_cast<int>(ctx->loader->sampleRate))) {
+        std::cerr << "Failed to initialize audio.\n";
+        return false;
     }
 
-    std::vector<float> left;
-    std::vector<float> right;
-    bool isStereo;
+    ctx->view->setSamples(samples);
 
-    if (!loadWavStereo(argv[1], left, right, isStereo)) {
-        std::cerr << "Failed to load WAV file.\n";
-        return 1;
+    return true;
+}
+
+// Runs on the UI thread while the decoder works: shows the pyramids filling in.
+void on_decode_progress(void* userdata) 
+{
+    auto* ctx = static_cast<AppContext*>(userdata);
+    ctx->view->redraw();
+}
+
+// Prints the file's loudness once its levels are complete.
+void reportLoudness(const LevelTracks& levels)
+{
+    if (levels.empty() || !levels[0]->complete()) return;
+
+    LoudnessSummary summary = summariseLoudness(levels);
+
+    std::cout << "Loudness: " << summary.integrated << " LUFS integrated, " << loudness::decibels(summary.truePeak)
+              << " dBTP true peak, " << loudness::decibels(summary.rms) << " dBFS RMS\n";
+}
+
+// Runs on the UI thread once the decoder is done.
+void on_samples_decoded(void* userdata) 
+{
+    auto* ctx = static_cast<AppContext*>(userdata);
+    auto* loader = ctx->loader;
+
+    // Files of unknown length only get their tracks now.
+    if (!loader->levels.empty()) {
+        LevelTracks levels(loader->levels.begin(), loader->levels.end());
+        ctx->view->setLevels(levels);
+        reportLoudness(levels);
     }
 
+    // Mapped files were installed up front; their pyramids are complete now.
+    if (ctx->audio->ready) {
+        ctx->view->redraw();
+        return;
+    }
+
+    if (!loader->samples || loader->samples->frames() == 0) {
+        std::cerr << "Failed to decode the file.\n";
+        return;
+    }
 
-    // Make sure each channel has the same number of audio samples.
-    if (left.size() != right.size()) {
-        std::cerr << "Error: Left and right channels have different lengths!" << std::endl;
+    installSamples(ctx, loader->samples);
+}
+
+// Opens path with ctx->loader, shows its cached (or filling) envelope and
+// starts decoding it.
+bool loadFile(AppContext* ctx, const std::string& path)
+{
+    std::vector<std::shared_ptr<PeakPyramid>> cachedPeaks;
+    size_t cachedFrames = 0;
+    SeekIndex cachedIndex;
+    std::vector<std::shared_ptr<LevelTrack>> cachedLevels;
+    bool cached = loadPeakCache(path, cachedPeaks, cachedFrames, &cachedIndex, &cachedLevels);
+
+    // Build the pyramids while decoding unless the cache already has them.
+    StreamingDecoder& loader = *ctx->loader;
+    loader.seekIndex = cachedIndex;
+    if (!loader.open(path, !cached)) {
         return false;
     }
 
-    auto* audio = new Audio();
-    if (!audio->init(left, right, 44100)) {
-        std::cerr << "Failed to initialize audio.\n";
+    if (cached) {
+        // Show the cached envelope at once.
+        ctx->view->setPeaks({ cachedPeaks.begin(), cachedPeaks.end() }, static_cast<int64_t>(cachedFrames), cachedPeaks.size());
+        ctx->view->setLevels({ cachedLevels.begin(), cachedLevels.end() });
+        reportLoudness({ cachedLevels.begin(), cachedLevels.end() });
+    }
+    else {
+        // Show the envelope as it is being built.
+        ctx->view->setPeaks({ loader.peaks.begin(), loader.peaks.end() }, static_cast<int64_t>(loader.frameCount), loader.channelCount);
+        ctx->view->setLevels({ loader.levels.begin(), loader.levels.end() });
+    }
+
+    // Mapped WAV files play and draw straight away.
+    if (loader.samplesReady() && !installSamples(ctx, loader.samples)) {
+        return false;
+    }
+
+    loader.start(
+        [ctx]() {
+            Fl::awake(on_decode_progress, ctx);
+        },
+        [ctx, path, cached](bool completed) {
+            auto* loader = ctx->loader;
+
+            // Keep the freshly built pyramids for the next launch.
+            if (completed && !cached && !loader->peaks.empty() && loader->peaks[0]->complete()) {
+                std::vector<const PeakPyramid*> channels;
+                std::vector<const LevelTrack*> levels;
+                for (const auto& peaks : loader->peaks) channels.push_back(peaks.get());
+                for (const auto& track : loader->levels) levels.push_back(track.get());
+                savePeakCache(path, channels, loader->peaks[0]->samples(), &loader->seekIndex, &levels);
+            }
+
+            Fl::awake(on_samples_decoded, ctx);
+        });
+
+    return true;
+}
+
+// Records the input device into the view instead of showing a file. The
+// meter is shown from the start.
+bool startCapture(AppContext* ctx, LiveCapture& live, const AudioDeviceOptions& device, const CaptureOptions& options)
+{
+    if (!live.open(device, options) || !live.start()) return false;
+
+    ctx->capture = &live;
+    ctx->view->setLiveInput(live.samples(), live.peaks, static_cast<int64_t>(live.window()));
+    ctx->view->toggleMeter();
+    ctx->frames->wake();
+
+    return true;
+}
+
+// ---- Main ----
+int main(int argc, char** argv) {
+    AudioDeviceOptions deviceOptions;
+    // Decoded files above this size (in bytes) are paged from disk, and FLAC
+    // and MP3 files decode into a page cache of this size.
+    size_t memoryBudget = size_t(512) << 20;
+    bool smoothZoom = false;
+    bool gpuEnvelope = false;
+    bool showLevels = false;
+    // Records the input device instead of opening a file (see LiveCapture).
+    bool capture = false;
+    CaptureOptions captureOptions;
+    // Display refresh rate, the fastest the view redraws by itself.
+    double refreshRate = 60.0;
+    // Where to write the timings on exit, if anywhere.
+    std::string tracePath;
+    // Headless rendering and export instead of the window (see runBatch()).
+    BatchOptions batch;
+    bool memorySet = false;
+    std::vector<std::string> files;
+    bool usage = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--period" && hasValue) {
+            deviceOptions.periodSizeInFrames = static_cast<ma_uint32>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--periods" && hasValue) {
+            deviceOptions.periods = static_cast<ma_uint32>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--backend" && hasValue) {
+            deviceOptions.backend = argv[++i];
+        }
+        else if (arg == "--rate" && hasValue) {
+            deviceOptions.sampleRate = static_cast<ma_uint32>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--resampler" && hasValue) {
+            if (!parseResampleQuality(argv[++i], deviceOptions.quality)) {
+                usage = true;
+                break;
+            }
+        }
+        else if (arg == "--memory" && hasValue) {
+            memoryBudget = static_cast<size_t>(std::strtoul(argv[++i], nullptr, 10)) << 20;
+            memorySet = true;
+        }
+        else if (arg == "--exclusive") {
+            deviceOptions.shareMode = ma_share_mode_exclusive;
+        }
+        else if (arg == "--smooth-zoom") {
+            smoothZoom = true;
+        }
+        else if (arg == "--gpu-envelope") {
+            gpuEnvelope = true;
+        }
+        else if (arg == "--levels") {
+            showLevels = true;
+            batch.levels = true;
+        }
+        else if (arg == "--capture") {
+            capture = true;
+        }
+        else if (arg == "--window" && hasValue) {
+            captureOptions.windowSeconds = std::strtod(argv[++i], nullptr);
+        }
+        else if (arg == "--monitor") {
+            captureOptions.monitor = true;
+        }
+        else if (arg == "--refresh" && hasValue) {
+            refreshRate = std::strtod(argv[++i], nullptr);
+        }
+        else if (arg == "--trace" && hasValue) {
+            tracePath = argv[++i];
+        }
+        else if (arg == "--render" && hasValue) {
+            batch.renderPath = argv[++i];
+        }
+        else if (arg == "--peaks" && hasValue) {
+            batch.peaksPath = argv[++i];
+        }
+        else if (arg == "--width" && hasValue) {
+            batch.width = std::atoi(argv[++i]);
+        }
+        else if (arg == "--height" && hasValue) {
+            batch.height = std::atoi(argv[++i]);
+        }
+        else if (arg == "--samples-per-pixel" && hasValue) {
+            batch.samplesPerPixel = static_cast<size_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--jobs" && hasValue) {
+            batch.jobs = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--list" && hasValue) {
+            if (!readFileList(argv[++i], files)) return 1;
+        }
+        else if (arg.rfind("--", 0) != 0) {
+            files.push_back(arg);
+        }
+        else {
+            usage = true;
+            break;
+        }
+    }
+
+    // The budget is per worker in batch mode, where several decode at once.
+    if (batch.active() && !usage && !files.empty()) {
+        if (memorySet) batch.memoryBudget = memoryBudget;
+        return runBatch(batch, files);
+    }
+
+    if (usage || files.size() != (capture ? 0u : 1u)) {
+        std::cerr << "Usage: ./waveform_viewer [--period frames] [--periods count] [--exclusive] [--backend name]"
+                     " [--rate hz] [--resampler linear|cubic|sinc] [--memory MB] [--smooth-zoom]"
+                     " [--gpu-envelope] [--levels] [--refresh hz] [--trace out.json|out.csv] file.wav\n"
+                     "       ./waveform_viewer --capture [--window seconds] [--monitor] [--period frames]"
+                     " [--periods count] [--exclusive] [--backend name] [--rate hz] [--refresh hz]\n"
+                     "       ./waveform_viewer [--render out.png] [--width px] [--height px] [--levels]"
+                     " [--peaks out.json|out.dat] [--samples-per-pixel n] [--jobs n] [--memory MB]"
+                     " [--list files.txt] file...\n"
+                     "With several files, {} in an output path stands for each file's name.\n";
         return 1;
     }
 
+    std::string path = capture ? std::string() : files[0];
+
+    // Enables Fl::awake(), used by the background decoder.
+    Fl::lock();
+
+    instrumentation().setTracing(!tracePath.empty());
+
+    // The device is opened once the samples are decoded (see installSamples()).
+    auto* audio = new Audio();
+    audio->options = deviceOptions;
+
     Fl_Window win(800, 400, "Waveform Viewer");
     auto* waveform = new WaveformView(10, 10, 780, 280);
     waveform->take_focus();  // Request keyboard focus
-    waveform->setStereoMode(isStereo);  // update visual behavior
+    waveform->setQuantizedZoom(!smoothZoom);
+    waveform->setGpuEnvelope(gpuEnvelope);
+    waveform->setLevelsVisible(showLevels);
 
     auto* scrollbar = new Fl_Scrollbar(10, 295, 780, 15);
     scrollbar->type(FL_HORIZONTAL);
@@ -766,11 +1446,10 @@ int main(int argc, char** argv) {
     scrollbar->callback([](Fl_Widget* w, void* data) {
         auto* sb = (Fl_Scrollbar*)w;
         auto* wf = (WaveformView*)data;
-        wf->setScrollOffset(sb->value());
+        wf->scrollbarMoved(sb->value());
     }, waveform);
 
     waveform->setScrollbar(scrollbar);
-    waveform->setStereoSamples(left, right);
 
     Fl_Group* btns = new Fl_Group(10, 320, 240, 30);
     // Create buttons.
@@ -783,6 +1462,12 @@ int main(int argc, char** argv) {
     auto* ctx = new AppContext{ audio, waveform, playBtn, pauseBtn };
     waveform->setContext(ctx);
 
+    // Moves the cursor, or follows live input, only while something moves.
+    auto* frames = new FrameScheduler();
+    frames->setRefreshRate(refreshRate);
+    frames->onFrame = [ctx]() { return advance_frame(ctx); };
+    ctx->frames = frames;
+
     // --- Play Button ---
     playBtn->callback([](Fl_Widget*, void* userData) {
         play(static_cast<AppContext*>(userData));
@@ -804,14 +1489,63 @@ int main(int argc, char** argv) {
     pauseBtn->clear_visible_focus();
 
     // Actual definition of the onSeekCallback(sample) function variable.
-    ctx->view->setOnSeekCallback([ctx](int newSample) {
-        ctx->audio->playbackSampleIndex = newSample;
+    ctx->view->setOnSeekCallback([ctx](int64_t newSample) {
+        ctx->audio->seek(newSample);
+    });
+
+    ctx->view->setOnScrubCallback([ctx](int64_t sample, bool finished) {
+        if (!ctx->audio->ready) return;
+
+        if (finished) {
+            ctx->audio->endScrub(sample);
+
+            // Nothing plays on: once the fade out is heard, the device stops.
+            if (!ctx->view->isPlaying()) {
+                Fl::add_timeout(ctx->audio->scrubSettleSeconds(), settle_scrub, ctx);
+            }
+        }
+        else {
+            Fl::remove_timeout(settle_scrub, ctx);
+            ctx->audio->scrub(sample);
+        }
+    });
+
+    ctx->view->setOnLoopCallback([ctx](int64_t start, int64_t end) {
+        ctx->audio->setLoopRegion(start, end);
     });
 
+    StreamingDecoder loader;
+    loader.memoryBudget = memoryBudget;
+    ctx->loader = &loader;
+    LiveCapture live;
+
+    if (capture) {
+        if (!startCapture(ctx, live, deviceOptions, captureOptions)) return 1;
+    }
+    else if (!loadFile(ctx, path)) {
+        return 1;
+    }
+
     // Make the waveform view resizable.
     win.resizable(ctx->view);
     win.end();
     win.show();
-    return Fl::run();
+
+    int result = Fl::run();
+
+    // Stop decoding if the window was closed early.
+    loader.cancel();
+
+    if (capture) {
+        live.stop();
+        if (live.droppedFrames() > 0) std::cerr << "Capture: " << live.droppedFrames() << " input frames dropped.\n";
+    }
+
+    if (!tracePath.empty()) {
+        instrumentation().collect();
+        instrumentation().exportTrace(tracePath);
+    }
+
+    return result;
 }
 
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ---- Mapped File ----
+// Read-only memory mapping of a whole file. Pages are loaded by the OS on
+// first access, so opening costs the same whatever the file size.
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        close();
+    }
+
+    bool open(const std::string& path) {
+        close();
+
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+            ::close(fd);
+            return false;
+        }
+
+        void* address = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        // The mapping stays valid once the descriptor is closed.
+        ::close(fd);
+
+        if (address == MAP_FAILED) return false;
+
+        bytes = static_cast<const unsigned char*>(address);
+        length = static_cast<size_t>(info.st_size);
+
+        return true;
+    }
+
+    void close() {
+        if (bytes) {
+            munmap(const_cast<unsigned char*>(bytes), length);
+            bytes = nullptr;
+            length = 0;
+        }
+    }
+
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+    // Hints that [offset, offset + count) won't be needed soon, so the OS can
+    // drop those pages from the resident set. They are read again on access.
+    void release(size_t offset, size_t count) const {
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t start = (offset + page - 1) / page * page;
+        size_t end = std::min(offset + count, length) / page * page;
+
+        if (bytes && end > start) {
+            madvise(const_cast<unsigned char*>(bytes) + start, end - start, MADV_DONTNEED);
+        }
+    }
+
+private:
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+};
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "sample_source.h"
+#include "mapped_file.h"
+#include <string>
+#include <cstring>
+#include <cstdint>
+
+// ---- Mapped WAV Source ----
+// Plays and draws uncompressed WAV files straight from a memory mapping of
+// the data chunk. Samples are converted to float only when read, so opening
+// costs nothing and only the pages in use stay resident.
+// Handles 8/16/24/32-bit integer PCM and 32/64-bit float, plain or
+// WAVE_FORMAT_EXTENSIBLE; anything else is left to the decoder.
+class MappedWavSource : public SampleSource {
+public:
+    bool open(const std::string& path) {
+        if (!file.open(path)) return false;
+
+        const unsigned char* bytes = file.data();
+        size_t size = file.size();
+
+        if (size < 12 || std::memcmp(bytes, "RIFF", 4) != 0 || std::memcmp(bytes + 8, "WAVE", 4) != 0) {
+            file.close();
+            return false;
+        }
+
+        bool haveFormat = false;
+        size_t offset = 12;
+
+        // Walk the chunks up to the data chunk; fmt must come before it.
+        while (offset + 8 <= size) {
+            const unsigned char* chunk = bytes + offset;
+            size_t chunkSize = readU32(chunk + 4);
+            size_t body = offset + 8;
+
+            if (std::memcmp(chunk, "fmt ", 4) == 0 && chunkSize >= 16 && body + chunkSize <= size) {
+                haveFormat = parseFormat(bytes + body, chunkSize);
+                if (!haveFormat) break;
+            }
+            else if (std::memcmp(chunk, "data", 4) == 0) {
+                if (!haveFormat) break;
+
+                // Streamed writers leave the size at 0 or 0xFFFFFFFF: use what is on disk.
+                size_t dataSize = (chunkSize == 0 || body + chunkSize > size) ? size - body : chunkSize;
+
+                dataOffset = body;
+                frameCount = dataSize / blockAlign;
+                return frameCount > 0;
+            }
+
+            // Chunks are padded to an even size.
+            offset = body + chunkSize + (chunkSize & 1);
+        }
+
+        file.close();
+        return false;
+    }
+
+    size_t channels() const override { return channelCount; }
+    size_t frames() const override { return frameCount; }
+    unsigned sampleRate() const { return rate; }
+
+    void read(size_t c, size_t start, size_t count, float* out) const override {
+        const unsigned char* in = file.data() + dataOffset + start * blockAlign + c * bytesPerSample;
+
+        switch (encoding) {
+            case Encoding::U8:
+                for (size_t i = 0; i < count; ++i, in += blockAlign) {
+                    out[i] = (static_cast<int>(in[0]) - 128) * (1.0f / 128.0f);
+                }
+                break;
+
+            case Encoding::S16:
+                for (size_t i = 0; i < count; ++i, in += blockAlign) {
+                    int16_t s;
+                    std::memcpy(&s, in, sizeof(s));
+                    out[i] = s * (1.0f / 32768.0f);
+                }
+                break;
+
+            case Encoding::S24:
+                for (size_t i = 0; i < count; ++i, in += blockAlign) {
+                    // Place the 3 bytes in the top of an int32 so the sign extends.
+                    int32_t s = static_cast<int32_t>((uint32_t(in[0]) << 8) | (uint32_t(in[1]) << 16) | (uint32_t(in[2]) << 24));
+                    out[i] = (s >> 8) * (1.0f / 8388608.0f);
+                }
+                break;
+
+            case Encoding::S32:
+                for (size_t i = 0; i < count; ++i, in += blockAlign) {
+                    int32_t s;
+                    std::memcpy(&s, in, sizeof(s));
+                    out[i] = static_cast<float>(s * (1.0 / 2147483648.0));
+                }
+                break;
+
+            case Encoding::F32:
+                for (size_t i = 0; i < count; ++i, in += blockAlign) {
+                    std::memcpy(&out[i], in, sizeof(float));
+                }
+                break;
+
+            case Encoding::F64:
+                for (size_t i = 0; i < count; ++i, in += blockAlign) {
+                    double s;
+                    std::memcpy(&s, in, sizeof(s));
+                    out[i] = static_cast<float>(s);
+                }
+                break;
+        }
+    }
+
+    // Drops the pages of frames [start, start + count) from memory, e.g. once
+    // the peak builder is past them.
+    void release(size_t start, size_t count) const {
+        file.release(dataOffset + start * blockAlign, count * blockAlign);
+    }
+
+private:
+    enum class Encoding { U8, S16, S24, S32, F32, F64 };
+
+    static uint16_t readU16(const unsigned char* p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+    static uint32_t readU32(const unsigned char* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24); }
+
+    bool parseFormat(const unsigned char* fmt, size_t size) {
+        // WAVE_FORMAT_PCM = 1, WAVE_FORMAT_IEEE_FLOAT = 3, WAVE_FORMAT_EXTENSIBLE = 0xFFFE.
+        uint16_t format = readU16(fmt);
+        channelCount = readU16(fmt + 2);
+        rate = readU32(fmt + 4);
+        blockAlign = readU16(fmt + 12);
+        unsigned bits = readU16(fmt + 14);
+
+        if (format == 0xFFFE && size >= 40) {
+            // The sub-format GUID starts with the plain format code.
+            format = readU16(fmt + 24);
+        }
+
+        bytesPerSample = bits / 8;
+
+        if (channelCount == 0 || bits % 8 != 0 || blockAlign < channelCount * bytesPerSample) return false;
+
+        if (format == 1) {
+            switch (bits) {
+                case 8: encoding = Encoding::U8; return true;
+                case 16: encoding = Encoding::S16; return true;
+                case 24: encoding = Encoding::S24; return true;
+                case 32: encoding = Encoding::S32; return true;
+            }
+        }
+        else if (format == 3) {
+            switch (bits) {
+                case 32: encoding = Encoding::F32; return true;
+                case 64: encoding = Encoding::F64; return true;
+            }
+        }
+
+        return false;
+    }
+
+    MappedFile file;
+    Encoding encoding = Encoding::S16;
+    size_t channelCount = 0;
+    size_t bytesPerSample = 0;
+    size_t blockAlign = 0;
+    size_t dataOffset = 0;
+    size_t frameCount = 0;
+    unsigned rate = 0;
+};
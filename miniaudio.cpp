@@ -0,0 +1,3 @@
+// The miniaudio implementation, in a translation unit of its own.
+#define MINIAUDIO_IMPLEMENTATION
+#include "../libraries/miniaudio.h"
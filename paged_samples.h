@@ -0,0 +1,386 @@
+#pragma once
+
+#include "sample_source.h"
+#include "arena.h"
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+
+// ---- Paged Samples ----
+// Decoded PCM kept in an unlinked temporary file instead of RAM, for files
+// that don't fit the memory budget. The file is a sequence of pages of
+// pageFrames frames (each channel planar inside its page); at most
+// budget / page size of them are held in memory at once, least recently used
+// first out.
+//
+// read() loads whatever it needs and may block on disk. tryRead() never
+// blocks or locks, so the audio callback can use it; pages that aren't in
+// memory read as silence. prefetch() tells a background thread where playback
+// is, and it keeps the following pages loaded. Page memory comes from the
+// source's own Arena, so the next file reuses it.
+//
+// Subclasses can fill pages from elsewhere (see CompressedSampleSource): they
+// call allocate() instead of create() and override fill().
+class PagedSampleSource : public SampleSource {
+public:
+    static constexpr size_t pageFrames = 65536;
+    // Pages kept loaded ahead of the prefetch position (~12 s at 44.1 kHz).
+    static constexpr size_t readAheadPages = 8;
+
+    PagedSampleSource() = default;
+    PagedSampleSource(const PagedSampleSource&) = delete;
+    PagedSampleSource& operator=(const PagedSampleSource&) = delete;
+
+    ~PagedSampleSource() override {
+        stopPrefetch();
+
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    // Creates the backing file for channels x frames samples, cached in at
+    // most budgetBytes of memory.
+    bool create(size_t channels, size_t frames, size_t budgetBytes) {
+        std::string directory = std::getenv("TMPDIR") ? std::getenv("TMPDIR") : "/tmp";
+        std::string name = directory + "/avpagesXXXXXX";
+        std::vector<char> path(name.begin(), name.end());
+        path.push_back('\0');
+
+        fd = ::mkstemp(path.data());
+
+        if (fd < 0) {
+            std::cerr << "Failed to create page file in " << directory << std::endl;
+            return false;
+        }
+
+        // Gone from the directory at once; the space is freed when fd closes.
+        ::unlink(path.data());
+
+        allocate(channels, frames, budgetBytes);
+        staging = arena->allocate<float>(channels * pageFrames);
+
+        return true;
+    }
+
+    size_t channels() const override { return channelCount; }
+    size_t frames() const override { return frameCount; }
+    size_t available() const override { return written.load(std::memory_order_acquire); }
+
+    void read(size_t c, size_t start, size_t count, float* out) const override {
+        while (count > 0) {
+            size_t page = start / pageFrames;
+            size_t offset = start % pageFrames;
+            size_t n = std::min(count, pageFrames - offset);
+            Slot* slot = pin(page);
+
+            while (!slot) {
+                std::lock_guard<std::mutex> lock(loadMutex);
+                load(page);
+                slot = pin(page);
+            }
+
+            std::memcpy(out, slot->data + c * pageFrames + offset, n * sizeof(float));
+            unpin(slot);
+
+            start += n;
+            count -= n;
+            out += n;
+        }
+    }
+
+    bool tryRead(size_t c, size_t start, size_t count, float* out) const override {
+        bool complete = true;
+
+        while (count > 0) {
+            size_t page = start / pageFrames;
+            size_t offset = start % pageFrames;
+            size_t n = std::min(count, pageFrames - offset);
+
+            if (Slot* slot = pin(page)) {
+                std::memcpy(out, slot->data + c * pageFrames + offset, n * sizeof(float));
+                unpin(slot);
+            }
+            else {
+                std::fill(out, out + n, 0.0f);
+                misses.fetch_add(1, std::memory_order_relaxed);
+                complete = false;
+            }
+
+            start += n;
+            count -= n;
+            out += n;
+        }
+
+        return complete;
+    }
+
+    // Wait-free: only records the position for the prefetch thread.
+    void prefetch(size_t frame) const override {
+        readAheadFrame.store(frame, std::memory_order_relaxed);
+    }
+
+    // tryRead() calls that found a page missing.
+    size_t missCount() const { return misses.load(std::memory_order_relaxed); }
+
+    // Writer side (the decoder). Appends count frames, one pointer per channel.
+    void append(const float* const* channelData, size_t count) {
+        for (size_t done = 0; done < count; ) {
+            size_t n = std::min(count - done, pageFrames - stagedFrames);
+
+            for (size_t c = 0; c < channelCount; ++c) {
+                std::memcpy(staging + c * pageFrames + stagedFrames, channelData[c] + done, n * sizeof(float));
+            }
+
+            stagedFrames += n;
+            done += n;
+
+            if (stagedFrames == pageFrames) {
+                flush();
+            }
+        }
+    }
+
+    // Writes the last partial page and sets the final length, which may be
+    // less than announced.
+    void finish(size_t count) {
+        if (stagedFrames > 0) {
+            flush();
+        }
+
+        frameCount = std::min(count, frameCount);
+        written.store(frameCount, std::memory_order_release);
+    }
+
+protected:
+    struct Slot {
+        // pageFrames x channels(), from the arena once the slot is first used.
+        float* data = nullptr;
+        std::atomic<int64_t> page{-1};
+        std::atomic<int> pins{0};
+        std::atomic<uint64_t> lastUsed{0};
+    };
+
+    // Sets up the cache for channels x frames samples in at most budgetBytes,
+    // and starts the prefetch thread.
+    void allocate(size_t channels, size_t frames, size_t budgetBytes) {
+        channelCount = channels;
+        frameCount = frames;
+        pageCount = (frames + pageFrames - 1) / pageFrames;
+
+        slotCount = std::max<size_t>(budgetBytes / pageBytes(), 4);
+        arena = std::make_shared<Arena>();
+        slots.reset(new Slot[slotCount]);
+        pageSlot.reset(new std::atomic<int>[pageCount]);
+
+        for (size_t p = 0; p < pageCount; ++p) {
+            pageSlot[p].store(-1, std::memory_order_relaxed);
+        }
+
+        prefetcher = std::thread(&PagedSampleSource::prefetchLoop, this);
+    }
+
+    // Joins the prefetch thread. Subclasses call it first thing in their
+    // destructor, so fill() never runs on a half-destroyed object.
+    void stopPrefetch() {
+        {
+            std::lock_guard<std::mutex> lock(prefetchMutex);
+            stopping = true;
+        }
+
+        prefetchWake.notify_one();
+
+        if (prefetcher.joinable()) {
+            prefetcher.join();
+        }
+    }
+
+    // Writes page's pageFrames frames into slot.data, channel after channel,
+    // zero past the end of the file. Called with loadMutex held.
+    virtual void fill(Slot& slot, size_t page) const {
+        char* bytes = reinterpret_cast<char*>(slot.data);
+        size_t size = pageBytes();
+        off_t at = static_cast<off_t>(page * pageBytes());
+
+        while (size > 0) {
+            ssize_t n = ::pread(fd, bytes, size, at);
+            if (n <= 0) break;
+            bytes += n;
+            size -= static_cast<size_t>(n);
+            at += n;
+        }
+
+        // Past the end of the last page.
+        std::memset(bytes, 0, size);
+    }
+
+    size_t pageBytes() const { return pageFrames * channelCount * sizeof(float); }
+
+    // Serializes loads; never taken by tryRead().
+    mutable std::mutex loadMutex;
+    // The source's buffers (pages, staging, a subclass's own), created by allocate().
+    std::shared_ptr<Arena> arena;
+
+private:
+
+    void flush() {
+        size_t page = written.load(std::memory_order_relaxed) / pageFrames;
+        off_t base = static_cast<off_t>(page * pageBytes());
+
+        for (size_t c = 0; c < channelCount; ++c) {
+            const char* bytes = reinterpret_cast<const char*>(staging + c * pageFrames);
+            size_t size = stagedFrames * sizeof(float);
+            off_t at = base + static_cast<off_t>(c * pageFrames * sizeof(float));
+
+            while (size > 0) {
+                ssize_t n = ::pwrite(fd, bytes, size, at);
+                if (n <= 0) {
+                    std::cerr << "Failed to write page file" << std::endl;
+                    break;
+                }
+                bytes += n;
+                size -= static_cast<size_t>(n);
+                at += n;
+            }
+        }
+
+        written.store(std::min(page * pageFrames + stagedFrames, frameCount), std::memory_order_release);
+        stagedFrames = 0;
+    }
+
+    // Wait-free lookup. The slot can't be reused until unpin(): evictions mark
+    // the slot empty before checking pins, pin() checks the page after
+    // pinning, so one of the two always sees the other.
+    Slot* pin(size_t page) const {
+        if (page >= pageCount) return nullptr;
+
+        int index = pageSlot[page].load(std::memory_order_acquire);
+        if (index < 0) return nullptr;
+
+        Slot& slot = slots[index];
+        slot.pins.fetch_add(1, std::memory_order_seq_cst);
+
+        if (slot.page.load(std::memory_order_seq_cst) != static_cast<int64_t>(page)) {
+            slot.pins.fetch_sub(1, std::memory_order_release);
+            return nullptr;
+        }
+
+        slot.lastUsed.store(tick.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+        return &slot;
+    }
+
+    static void unpin(Slot* slot) {
+        slot->pins.fetch_sub(1, std::memory_order_release);
+    }
+
+    // Brings page into memory, evicting the least recently used unpinned page
+    // if no slot is free. Caller holds loadMutex.
+    void load(size_t page) const {
+        int current = pageSlot[page].load(std::memory_order_relaxed);
+        if (current >= 0 && slots[current].page.load() == static_cast<int64_t>(page)) return;
+
+        for (;;) {
+            int victim = -1;
+            uint64_t oldest = UINT64_MAX;
+
+            for (size_t s = 0; s < slotCount; ++s) {
+                const Slot& slot = slots[s];
+
+                if (slot.page.load(std::memory_order_relaxed) < 0) {
+                    victim = static_cast<int>(s);
+                    break;
+                }
+
+                uint64_t used = slot.lastUsed.load(std::memory_order_relaxed);
+                if (used < oldest && slot.pins.load(std::memory_order_relaxed) == 0) {
+                    oldest = used;
+                    victim = static_cast<int>(s);
+                }
+            }
+
+            if (victim < 0) {
+                // Every slot is being read right now.
+                std::this_thread::yield();
+                continue;
+            }
+
+            Slot& slot = slots[victim];
+            int64_t old = slot.page.load(std::memory_order_relaxed);
+
+            if (old >= 0) {
+                slot.page.store(-1, std::memory_order_seq_cst);
+
+                if (slot.pins.load(std::memory_order_seq_cst) != 0) {
+                    // Pinned in the meantime: keep it and look again.
+                    slot.page.store(old, std::memory_order_seq_cst);
+                    continue;
+                }
+
+                pageSlot[old].store(-1, std::memory_order_release);
+            }
+
+            if (!slot.data) slot.data = arena->allocate<float>(pageFrames * channelCount);
+
+            fill(slot, page);
+            slot.lastUsed.store(tick.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+            slot.page.store(static_cast<int64_t>(page), std::memory_order_seq_cst);
+            pageSlot[page].store(victim, std::memory_order_release);
+            return;
+        }
+    }
+
+    void prefetchLoop() {
+        std::unique_lock<std::mutex> lock(prefetchMutex);
+
+        while (!stopping) {
+            prefetchWake.wait_for(lock, std::chrono::milliseconds(5));
+
+            size_t first = readAheadFrame.load(std::memory_order_relaxed) / pageFrames;
+            size_t ready = (available() + pageFrames - 1) / pageFrames;
+            size_t last = std::min({ first + std::min(readAheadPages, slotCount / 2), ready, pageCount });
+
+            for (size_t page = first; page < last && !stopping; ++page) {
+                if (pageSlot[page].load(std::memory_order_acquire) >= 0) continue;
+
+                std::lock_guard<std::mutex> loadLock(loadMutex);
+                load(page);
+            }
+        }
+    }
+
+    int fd = -1;
+    size_t channelCount = 0;
+    size_t frameCount = 0;
+    size_t pageCount = 0;
+    std::atomic<size_t> written{0};
+
+    // Cache. slots and pageSlot are fixed once created, so lookups need no lock.
+    size_t slotCount = 0;
+    std::unique_ptr<Slot[]> slots;
+    std::unique_ptr<std::atomic<int>[]> pageSlot;
+    mutable std::atomic<uint64_t> tick{1};
+    mutable std::atomic<size_t> misses{0};
+
+    mutable std::atomic<size_t> readAheadFrame{0};
+    std::mutex prefetchMutex;
+    std::condition_variable prefetchWake;
+    bool stopping = false;
+    std::thread prefetcher;
+
+    // Writer: one page, channel after channel.
+    float* staging = nullptr;
+    size_t stagedFrames = 0;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "peaks.h"
+#include "sample_source.h"
+#include "thread_pool.h"
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstddef>
+
+// ---- Peak Builder ----
+// Builds pyramids on the shared thread pool. Every channel is cut into
+// chunks of peakChunkFrames that are reduced to level 0 independently, then
+// each pyramid merges its upper levels on the calling thread (a tiny fraction
+// of the work), so building scales with the cores even for a mono file.
+
+// Frames per task; a multiple of PeakPyramid::baseBlockSize.
+constexpr size_t peakChunkFrames = 16384;
+
+// Queues the reduction of count samples of one channel, starting at frame
+// start, on group. samples must stay valid until the group is waited for;
+// publish() the pyramid afterwards.
+inline void summariseAsync(TaskGroup& group, PeakPyramid& peaks, size_t start, const float* samples, size_t count) {
+    for (size_t offset = 0; offset < count; offset += peakChunkFrames) {
+        size_t n = std::min(peakChunkFrames, count - offset);
+        PeakPyramid* target = &peaks;
+
+        group.run([target, start, samples, offset, n]() {
+            target->summarise(start + offset, samples + offset, n);
+        });
+    }
+}
+
+// Summarises and publishes frames [start, start + count) of every channel of
+// source, one pyramid per channel. Blocks until done.
+inline void summariseRange(const SampleSource& source, const std::vector<std::shared_ptr<PeakPyramid>>& peaks,
+                           size_t start, size_t count) {
+    size_t chunks = (count + peakChunkFrames - 1) / peakChunkFrames;
+
+    parallelFor(peaks.size() * chunks, [&](size_t task) {
+        size_t c = task / chunks;
+        size_t at = start + (task % chunks) * peakChunkFrames;
+        size_t n = std::min(peakChunkFrames, start + count - at);
+        // One conversion buffer per thread, reused across calls.
+        thread_local std::vector<float> block(peakChunkFrames);
+
+        peaks[c]->summarise(at, source.fetch(c, at, n, block.data()), n);
+    });
+
+    for (const auto& pyramid : peaks) {
+        pyramid->publish(start + count);
+    }
+}
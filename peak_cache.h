@@ -0,0 +1,228 @@
+#pragma once
+
+#include "peaks.h"
+#include "levels.h"
+#include "mapped_file.h"
+#include "seek_index.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+
+// ---- Peak Cache ----
+// Sidecar "<audio file>.peaks" holding the envelope pyramid of every channel,
+// so reopening a file can show its waveform without decoding it first, and
+// the seek index of compressed files, so it can be played from anywhere
+// without scanning it first, and the level tracks, so its loudness is known
+// without decoding it either.
+//
+// Layout: PeakCacheHeader, the absolute source path (pathLength bytes), zero
+// padding up to a 16-byte boundary, then for each channel the flat pyramid
+// entries (PeakPyramid::entryCount(frameCount) Peaks), then for each of the
+// levelChannels channels the track's LevelTrack::floatCount(frameCount,
+// sampleRate) floats, then seekPointCount SeekPoints.
+// The cache is only used when path, size and modification time of the source
+// file all match the header.
+
+// Bump whenever the layout above or the pyramid block size changes.
+// Version 2: every channel of the file is stored (version 1 had at most two).
+// Version 3: seek index.
+// Version 4: level tracks.
+constexpr uint32_t peakCacheVersion = 4;
+
+struct PeakCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t channels;
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    uint64_t frameCount;
+    uint32_t baseBlockSize;
+    uint32_t pathLength;
+    // SeekIndex::headerBytes and the number of points; 0 without an index.
+    uint64_t seekHeaderBytes;
+    uint64_t seekPointCount;
+    // Rate of the level tracks, and their number: 0 or channels.
+    uint32_t sampleRate;
+    uint32_t levelChannels;
+};
+
+static const char peakCacheMagic[8] = { 'A', 'V', 'P', 'E', 'A', 'K', 'S', '\0' };
+
+inline std::string peakCachePath(const std::string& audioPath) {
+    return audioPath + ".peaks";
+}
+
+// Fills in the fields identifying the source file. Returns false if it can't be stat'ed.
+inline bool peakCacheKey(const std::string& audioPath, PeakCacheHeader& header, std::string& absolutePath) {
+    std::error_code error;
+    absolutePath = std::filesystem::absolute(audioPath, error).lexically_normal().string();
+    if (error) return false;
+
+    auto size = std::filesystem::file_size(audioPath, error);
+    if (error) return false;
+
+    auto mtime = std::filesystem::last_write_time(audioPath, error);
+    if (error) return false;
+
+    std::memcpy(header.magic, peakCacheMagic, sizeof(header.magic));
+    header.version = peakCacheVersion;
+    header.sourceSize = size;
+    header.sourceMtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+    header.baseBlockSize = static_cast<uint32_t>(PeakPyramid::baseBlockSize);
+    header.pathLength = static_cast<uint32_t>(absolutePath.size());
+
+    return true;
+}
+
+// Offset of the first pyramid entry.
+inline size_t peakCacheDataOffset(uint32_t pathLength) {
+    return (sizeof(PeakCacheHeader) + pathLength + 15) & ~static_cast<size_t>(15);
+}
+
+// Maps the sidecar of audioPath and points one pyramid per channel into it,
+// copies its seek index into seekIndex and points levels into it if given
+// (left empty when the cache has no levels).
+// Returns false (leaving the outputs untouched) if there is no usable cache.
+inline bool loadPeakCache(const std::string& audioPath, std::vector<std::shared_ptr<PeakPyramid>>& channels, size_t& frameCount,
+                          SeekIndex* seekIndex = nullptr, std::vector<std::shared_ptr<LevelTrack>>* levels = nullptr) {
+    PeakCacheHeader expected;
+    std::string absolutePath;
+
+    if (!peakCacheKey(audioPath, expected, absolutePath)) return false;
+
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(peakCachePath(audioPath)) || file->size() < sizeof(PeakCacheHeader)) return false;
+
+    PeakCacheHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+
+    bool matches = std::memcmp(header.magic, expected.magic, sizeof(header.magic)) == 0
+        && header.version == expected.version
+        && header.sourceSize == expected.sourceSize
+        && header.sourceMtime == expected.sourceMtime
+        && header.baseBlockSize == expected.baseBlockSize
+        && header.pathLength == expected.pathLength
+        && header.channels > 0
+        && (header.levelChannels == 0 || (header.levelChannels == header.channels && header.sampleRate > 0))
+        && file->size() >= sizeof(header) + header.pathLength
+        && std::memcmp(file->data() + sizeof(header), absolutePath.data(), absolutePath.size()) == 0;
+
+    if (!matches) return false;
+
+    size_t entries = PeakPyramid::entryCount(header.frameCount);
+    size_t offset = peakCacheDataOffset(header.pathLength);
+
+    size_t pyramidBytes = header.channels * entries * sizeof(Peak);
+    size_t levelFloats = header.levelChannels > 0 ? LevelTrack::floatCount(header.frameCount, header.sampleRate) : 0;
+    size_t levelBytes = header.levelChannels * levelFloats * sizeof(float);
+
+    if (file->size() != offset + pyramidBytes + levelBytes + header.seekPointCount * sizeof(SeekPoint)) return false;
+
+    std::vector<std::shared_ptr<PeakPyramid>> pyramids;
+
+    for (uint32_t c = 0; c < header.channels; ++c) {
+        const Peak* data = reinterpret_cast<const Peak*>(file->data() + offset + c * entries * sizeof(Peak));
+        pyramids.push_back(std::make_shared<PeakPyramid>());
+        pyramids.back()->adopt(data, header.frameCount, file);
+    }
+
+    channels = std::move(pyramids);
+    frameCount = static_cast<size_t>(header.frameCount);
+
+    if (levels) {
+        levels->clear();
+
+        for (uint32_t c = 0; c < header.levelChannels; ++c) {
+            const float* data = reinterpret_cast<const float*>(file->data() + offset + pyramidBytes + c * levelFloats * sizeof(float));
+            levels->push_back(std::make_shared<LevelTrack>());
+            levels->back()->adopt(data, header.frameCount, header.sampleRate, file);
+        }
+    }
+
+    if (seekIndex) {
+        // Not necessarily aligned after the pyramids.
+        seekIndex->headerBytes = header.seekHeaderBytes;
+        seekIndex->points.resize(header.seekPointCount);
+        std::memcpy(seekIndex->points.data(), file->data() + offset + pyramidBytes + levelBytes, header.seekPointCount * sizeof(SeekPoint));
+    }
+
+    return true;
+}
+
+// Writes the sidecar of audioPath, with seekIndex and levels (complete, one
+// per channel) if given. The file is written under a temporary name and
+// renamed, so a reader never maps a partial cache.
+inline bool savePeakCache(const std::string& audioPath, const std::vector<const PeakPyramid*>& channels, size_t frameCount,
+                          const SeekIndex* seekIndex = nullptr, const std::vector<const LevelTrack*>* levels = nullptr) {
+    PeakCacheHeader header;
+    std::string absolutePath;
+
+    if (channels.empty() || !peakCacheKey(audioPath, header, absolutePath)) return false;
+
+    header.channels = static_cast<uint32_t>(channels.size());
+    header.frameCount = frameCount;
+    header.seekHeaderBytes = seekIndex ? seekIndex->headerBytes : 0;
+    header.seekPointCount = seekIndex ? seekIndex->points.size() : 0;
+
+    bool withLevels = levels && levels->size() == channels.size();
+    for (size_t c = 0; withLevels && c < levels->size(); ++c) {
+        withLevels = (*levels)[c]->complete() && (*levels)[c]->samples() == frameCount;
+    }
+
+    header.sampleRate = withLevels ? (*levels)[0]->sampleRate() : 0;
+    header.levelChannels = withLevels ? header.channels : 0;
+
+    std::string cachePath = peakCachePath(audioPath);
+    std::string tempPath = cachePath + ".tmp";
+
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "Cannot write peak cache: " << cachePath << std::endl;
+            return false;
+        }
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(absolutePath.data(), absolutePath.size());
+
+        size_t padding = peakCacheDataOffset(header.pathLength) - sizeof(header) - absolutePath.size();
+        static const char zeros[16] = {};
+        out.write(zeros, padding);
+
+        for (const PeakPyramid* pyramid : channels) {
+            out.write(reinterpret_cast<const char*>(pyramid->data()), pyramid->size() * sizeof(Peak));
+        }
+
+        for (size_t c = 0; c < header.levelChannels; ++c) {
+            const LevelTrack* track = (*levels)[c];
+            out.write(reinterpret_cast<const char*>(track->data()), track->size() * sizeof(float));
+        }
+
+        if (seekIndex) {
+            out.write(reinterpret_cast<const char*>(seekIndex->points.data()), seekIndex->points.size() * sizeof(SeekPoint));
+        }
+
+        if (!out) {
+            std::cerr << "Failed to write peak cache: " << cachePath << std::endl;
+            out.close();
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, cachePath, error);
+
+    if (error) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "peaks.h"
+#include "sample_source.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+// ---- Peak Export ----
+// The envelope for other programs: a min/max pair per channel every
+// samplesPerPixel samples, in the format of BBC's audiowaveform (version 2,
+// 16-bit values), which web players such as peaks.js load. Written as JSON,
+// or in its binary layout for a path ending in ".dat": int32 version,
+// uint32 flags (0: 16-bit), int32 sample rate, int32 samples per pixel,
+// uint32 length (pixels), int32 channels, then for each pixel the int16 min
+// and max of each channel, all little-endian.
+struct PeakExport {
+    unsigned sampleRate = 0;
+    size_t samplesPerPixel = 256;
+    size_t channels = 0;
+    // Pixels.
+    size_t length = 0;
+    // length x channels x (min, max).
+    std::vector<int16_t> data;
+};
+
+// Pyramids are only exact on their block boundaries: pixels of a multiple of
+// PeakPyramid::baseBlockSize are read from them, others from the samples.
+inline bool peakExportFromPyramids(size_t samplesPerPixel) {
+    return samplesPerPixel > 0 && samplesPerPixel % PeakPyramid::baseBlockSize == 0;
+}
+
+// Fills out for frames samples from the pyramids, one per channel, or from
+// source (which may be null otherwise) unless peakExportFromPyramids().
+inline bool computePeakExport(const std::vector<std::shared_ptr<const PeakPyramid>>& pyramids, const SampleSource* source,
+                              size_t frames, PeakExport& out) {
+    bool fromPyramids = peakExportFromPyramids(out.samplesPerPixel);
+
+    if (out.samplesPerPixel == 0 || pyramids.empty() || (!fromPyramids && !source)) return false;
+
+    out.channels = pyramids.size();
+    out.length = (frames + out.samplesPerPixel - 1) / out.samplesPerPixel;
+    out.data.resize(out.length * out.channels * 2);
+
+    std::vector<float> scratch(fromPyramids ? 0 : out.samplesPerPixel);
+    auto toInt = [](float value) {
+        return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+    };
+
+    // The coarsest level whose blocks tile every pixel: read() picks by width
+    // alone and would widen pixels such as 9 blocks to a coarser level's.
+    size_t level = 0;
+
+    while (fromPyramids && (out.samplesPerPixel / PeakPyramid::baseBlockSize) % (size_t(2) << level) == 0) {
+        ++level;
+    }
+
+    for (size_t c = 0; c < out.channels; ++c) {
+        for (size_t pixel = 0; pixel < out.length; ++pixel) {
+            size_t start = pixel * out.samplesPerPixel;
+            size_t end = std::min(start + out.samplesPerPixel, frames);
+            Peak peak = fromPyramids ? pyramids[c]->readLevel(level, start, end)
+                                     : scanPeak(source->fetch(c, start, end - start, scratch.data()), end - start);
+
+            out.data[(pixel * out.channels + c) * 2] = toInt(peak.min);
+            out.data[(pixel * out.channels + c) * 2 + 1] = toInt(peak.max);
+        }
+    }
+
+    return true;
+}
+
+inline bool writePeakExport(const std::string& path, const PeakExport& peaks) {
+    bool binary = path.size() >= 4 && path.compare(path.size() - 4, 4, ".dat") == 0;
+    std::ofstream out(path, binary ? std::ios::binary : std::ios::out);
+
+    if (binary) {
+        auto put32 = [&](uint32_t value) {
+            for (int shift = 0; shift < 32; shift += 8) out.put(static_cast<char>(value >> shift));
+        };
+
+        put32(2);
+        put32(0);
+        put32(peaks.sampleRate);
+        put32(static_cast<uint32_t>(peaks.samplesPerPixel));
+        put32(static_cast<uint32_t>(peaks.length));
+        put32(static_cast<uint32_t>(peaks.channels));
+
+        for (int16_t value : peaks.data) {
+            out.put(static_cast<char>(value & 0xff));
+            out.put(static_cast<char>((value >> 8) & 0xff));
+        }
+    }
+    else {
+        out << "{\"version\":2,\"channels\":" << peaks.channels << ",\"sample_rate\":" << peaks.sampleRate
+            << ",\"samples_per_pixel\":" << peaks.samplesPerPixel << ",\"bits\":16,\"length\":" << peaks.length
+            << ",\"data\":[";
+
+        for (size_t i = 0; i < peaks.data.size(); ++i) {
+            if (i > 0) out << ',';
+            out << peaks.data[i];
+        }
+
+        out << "]}\n";
+    }
+
+    if (!out) {
+        std::cerr << "Failed to write peaks: " << path << std::endl;
+        return false;
+    }
+
+    return true;
+}
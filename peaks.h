@@ -0,0 +1,374 @@
+#pragma once
+
+#include "kernels.h"
+#include "arena.h"
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+// ---- Peak Summary ----
+// Envelope of a run of samples: lowest value, highest value and the
+// largest magnitude (used for the silence check).
+struct Peak {
+    float min = 1.0f;
+    float max = -1.0f;
+    float absMax = 0.0f;
+
+    void merge(const Peak& other) {
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        absMax = std::max(absMax, other.absMax);
+    }
+};
+
+// Computes min, max and absMax of count samples in a single vectorized pass.
+// absMax falls out of the extremes, so the silence check needs no extra scan.
+inline Peak scanPeak(const float* samples, size_t count) {
+    Peak peak;
+
+    if (count == 0) return peak;
+
+    float lo, hi;
+    minMaxKernel().run(samples, count, lo, hi);
+
+    peak.min = std::min(peak.min, lo);
+    peak.max = std::max(peak.max, hi);
+    peak.absMax = std::max(hi, -lo);
+
+    return peak;
+}
+
+// ---- Peak Pyramid ----
+// Mip-style stack of per-block peaks for one channel. Level 0 summarises
+// baseBlockSize samples per entry and every level above halves the entry
+// count, so any column width maps onto a level with only a few blocks to merge.
+// All levels live in one flat array (level 0 first) which is either owned,
+// carved from the file's Arena, or borrowed from external storage such as a
+// memory-mapped peak cache.
+//
+// A pyramid can also be filled incrementally: reserve() sizes it for the whole
+// channel and append() adds samples as they are decoded. One thread may append
+// while others read; readers only see blocks that are complete.
+//
+// For parallel building, summarise() reduces independent block-aligned ranges
+// to level 0 from any number of threads and publish() then merges the upper
+// levels (see PeakBuilder).
+//
+// A rolling pyramid (reserveRolling()) summarises an endless stream, such as
+// live input, in fixed memory: it keeps the last window samples, each level a
+// ring of a power of two entries. Positions stay absolute (block b of a level
+// lives in entry b mod its size), so the levels still tile exactly and
+// readers index it as any other pyramid, from oldest() to available().
+class PeakPyramid {
+public:
+    // Samples covered by one level-0 entry.
+    static constexpr size_t baseBlockSize = 256;
+
+    PeakPyramid() = default;
+    // Readers may hold on to the entries, so a pyramid never moves.
+    PeakPyramid(const PeakPyramid&) = delete;
+    PeakPyramid& operator=(const PeakPyramid&) = delete;
+
+    // Total number of entries over all levels for a channel of sampleCount samples.
+    static size_t entryCount(size_t sampleCount) {
+        size_t total = 0;
+        size_t size = (sampleCount + baseBlockSize - 1) / baseBlockSize;
+
+        while (size > 0) {
+            total += size;
+            if (size == 1) break;
+            size = (size + 1) / 2;
+        }
+
+        return total;
+    }
+
+    void build(const float* samples, size_t count) {
+        reserve(count);
+        append(samples, count);
+    }
+
+    void build(const std::vector<float>& samples) {
+        build(samples.data(), samples.size());
+    }
+
+    // Allocates an empty pyramid for a channel of count samples, from arena
+    // when given (which the pyramid then keeps alive).
+    // Not thread safe: call before the pyramid is shared.
+    void reserve(size_t count, std::shared_ptr<Arena> arena = nullptr) {
+        layout(count);
+
+        if (arena) {
+            std::vector<Peak>().swap(owned);
+            writable = arena->allocate<Peak>(entryCount(count));
+            std::fill(writable, writable + entryCount(count), Peak());
+        }
+        else {
+            owned.assign(entryCount(count), Peak());
+            writable = owned.data();
+        }
+
+        entries = writable;
+        storage = std::move(arena);
+        pending = Peak();
+        built.store(0, std::memory_order_relaxed);
+    }
+
+    // Allocates an empty rolling pyramid for at least the last window samples
+    // of a stream that append() then fills without end. window is rounded up
+    // to a power of two number of blocks; samples() is that capacity. Built
+    // through append() only, not summarise().
+    // Not thread safe: call before the pyramid is shared.
+    void reserveRolling(size_t window, std::shared_ptr<Arena> arena = nullptr) {
+        size_t blocks = 2;
+        while (blocks * baseBlockSize < window) blocks *= 2;
+
+        reserve(blocks * baseBlockSize, std::move(arena));
+        ring = true;
+    }
+
+    // Adds the next count samples of the channel and publishes every block
+    // they complete. Only one thread may append.
+    void append(const float* samples, size_t count) {
+        size_t done = built.load(std::memory_order_relaxed);
+        if (!ring) count = std::min(count, sampleCount - done);
+
+        while (count > 0) {
+            size_t offset = done % baseBlockSize;
+            size_t take = std::min(baseBlockSize - offset, count);
+
+            pending.merge(scanPeak(samples, take));
+            samples += take;
+            count -= take;
+            done += take;
+
+            // The block is complete when it's full or the channel ends.
+            if (done % baseBlockSize == 0 || (!ring && done == sampleCount)) {
+                propagate((done - 1) / baseBlockSize, pending);
+                pending = Peak();
+            }
+        }
+
+        built.store(done, std::memory_order_release);
+    }
+
+    // Computes the level-0 entries of the count samples from frame start,
+    // without publishing them. start must be a multiple of baseBlockSize, and
+    // so must count unless the range ends the channel. Threads may summarise
+    // disjoint ranges at the same time; not to be mixed with append().
+    void summarise(size_t start, const float* samples, size_t count) {
+        size_t end = std::min(start + count, sampleCount);
+
+        for (size_t at = start; at < end; at += baseBlockSize) {
+            writable[at / baseBlockSize] = scanPeak(samples + (at - start), std::min(baseBlockSize, end - at));
+        }
+    }
+
+    // Makes the first count samples visible to readers, deriving the upper
+    // levels of the blocks summarised since the last call. count follows the
+    // same alignment rule as in summarise(). Only one thread may publish.
+    void publish(size_t count) {
+        size_t from = built.load(std::memory_order_relaxed);
+        count = std::min(count, sampleCount);
+
+        if (count <= from) return;
+
+        // New blocks of the level below; a parent is new once its last child is.
+        size_t first = from / baseBlockSize;
+        size_t last = count == sampleCount ? levelSizes[0] : count / baseBlockSize;
+
+        for (size_t level = 1; level < levelSizes.size() && first < last; ++level) {
+            const Peak* below = writable + levelOffsets[level - 1];
+            Peak* above = writable + levelOffsets[level];
+            size_t parentFirst = first / 2;
+            size_t parentLast = last == levelSizes[level - 1] ? levelSizes[level] : last / 2;
+
+            for (size_t p = parentFirst; p < parentLast; ++p) {
+                Peak parent = below[2 * p];
+                if (2 * p + 1 < levelSizes[level - 1]) parent.merge(below[2 * p + 1]);
+                above[p] = parent;
+            }
+
+            first = parentFirst;
+            last = parentLast;
+        }
+
+        built.store(count, std::memory_order_release);
+    }
+
+    // Uses entryCount(count) entries laid out as build() would, without copying.
+    // The owner keeps the memory behind data alive for the pyramid's lifetime.
+    void adopt(const Peak* data, size_t count, std::shared_ptr<const void> owner) {
+        layout(count);
+        std::vector<Peak>().swap(owned);
+        writable = nullptr;
+        entries = data;
+        storage = std::move(owner);
+        built.store(count, std::memory_order_release);
+    }
+
+    bool empty() const { return levelSizes.empty(); }
+    size_t samples() const { return sampleCount; }
+    // Samples summarised so far; equals samples() once the pyramid is complete.
+    // Rolling pyramids count every sample appended.
+    size_t available() const { return built.load(std::memory_order_acquire); }
+    bool complete() const { return !ring && available() == sampleCount; }
+    bool rolling() const { return ring; }
+    // The first sample a rolling pyramid still summarises; reads start there
+    // at the earliest. 0 unless rolling.
+    size_t oldest() const {
+        size_t whole = available() / baseBlockSize * baseBlockSize;
+        return ring && whole > sampleCount ? whole - sampleCount : 0;
+    }
+    size_t levelCount() const { return levelSizes.size(); }
+    size_t blockSize(size_t level) const { return baseBlockSize << level; }
+    // Entries in level, stored after those of the levels below it in data().
+    size_t levelSize(size_t level) const { return levelSizes[level]; }
+    // Flat view of every level, as written to the peak cache.
+    const Peak* data() const { return entries; }
+    size_t size() const { return entryCount(sampleCount); }
+
+    // Envelope of the sample range [start, end), read from the coarsest level
+    // whose blocks are no wider than the range. The range is widened to that
+    // level's block boundaries, i.e. by less than one block on each side,
+    // unless it is aligned to a slightly finer level (see read()).
+    // Returns false when the range is narrower than a level-0 block, in which
+    // case the caller should scan the raw samples instead.
+    bool query(size_t start, size_t end, Peak& out) const {
+        end = std::min(end, ring ? available() : sampleCount);
+
+        if (empty() || start >= end || end - start < baseBlockSize) return false;
+
+        out = read(start, end);
+        return true;
+    }
+
+    // Same as query() but always answers, falling back to level 0 for narrow
+    // ranges. Used as a coarse preview while the raw samples are unavailable.
+    // Blocks that are not built yet are left out.
+    Peak read(size_t start, size_t end) const {
+        end = std::min(end, ring ? available() : sampleCount);
+        start = std::max(start, oldest());
+
+        if (empty() || start >= end) return Peak();
+
+        size_t span = end - start;
+        size_t level = 0;
+
+        while (level + 1 < levelSizes.size() && blockSize(level + 1) <= span) {
+            ++level;
+        }
+
+        // A range on block boundaries (as quantized zoom columns are) is read
+        // exactly from a level up to two finer whose blocks tile it.
+        for (size_t finer = level; finer + 2 >= level; --finer) {
+            size_t size = blockSize(finer);
+
+            if (start % size == 0 && (end % size == 0 || end == sampleCount)) {
+                level = finer;
+                break;
+            }
+
+            if (finer == 0) break;
+        }
+
+        return readLevel(level, start, end);
+    }
+
+    // Envelope of [start, end) merged from the blocks of level, widened to
+    // its block boundaries; exact for a range that level's blocks tile.
+    // Blocks that are not built yet are left out.
+    Peak readLevel(size_t level, size_t start, size_t end) const {
+        Peak out;
+        end = std::min(end, ring ? available() : sampleCount);
+        start = std::max(start, oldest());
+
+        if (empty() || start >= end) return out;
+
+        level = std::min(level, levelSizes.size() - 1);
+
+        size_t ready = available();
+        const Peak* blocks = entries + levelOffsets[level];
+        size_t size = blockSize(level);
+        size_t first = start / size;
+        size_t last = (end + size - 1) / size;
+
+        if (!ring) last = std::min(last, levelSizes[level]);
+
+        if (ring || ready < sampleCount) {
+            last = std::min(last, ready / size);
+        }
+
+        for (size_t b = first; b < last; ++b) {
+            out.merge(blocks[slot(level, b)]);
+        }
+
+        return out;
+    }
+
+private:
+    // Computes the size and offset of every level for count samples.
+    void layout(size_t count) {
+        sampleCount = count;
+        ring = false;
+        levelSizes.clear();
+        levelOffsets.clear();
+
+        size_t size = (count + baseBlockSize - 1) / baseBlockSize;
+        size_t offset = 0;
+
+        while (size > 0) {
+            levelSizes.push_back(size);
+            levelOffsets.push_back(offset);
+            offset += size;
+            if (size == 1) break;
+            size = (size + 1) / 2;
+        }
+    }
+
+    // Where block index of level is stored: its own entry, or in a rolling
+    // pyramid the ring cell it shares with the blocks a whole window apart.
+    size_t slot(size_t level, size_t index) const {
+        return ring ? index & (levelSizes[level] - 1) : index;
+    }
+
+    // Stores a finished level-0 block and updates every parent it completes.
+    void propagate(size_t index, const Peak& peak) {
+        writable[slot(0, index)] = peak;
+
+        for (size_t level = 1; level < levelSizes.size(); ++level) {
+            // A rolling pyramid has no last, unpaired block.
+            bool lastChild = (index % 2 == 1) || (!ring && index + 1 == levelSizes[level - 1]);
+            if (!lastChild) break;
+
+            const Peak* below = writable + levelOffsets[level - 1];
+            size_t first = index & ~static_cast<size_t>(1);
+            Peak parent = below[slot(level - 1, first)];
+
+            if (ring || first + 1 < levelSizes[level - 1]) {
+                parent.merge(below[slot(level - 1, first + 1)]);
+            }
+
+            index /= 2;
+            writable[levelOffsets[level] + slot(level, index)] = parent;
+        }
+    }
+
+    std::vector<size_t> levelSizes;
+    std::vector<size_t> levelOffsets;
+    std::vector<Peak> owned;
+    // The entries being built: owned's or the arena's. Null when borrowed.
+    Peak* writable = nullptr;
+    const Peak* entries = nullptr;
+    // Keeps borrowed entries (e.g. a file mapping) or the arena alive.
+    std::shared_ptr<const void> storage;
+    size_t sampleCount = 0;
+    // Set by reserveRolling().
+    bool ring = false;
+    // Incremental building: the level-0 block in progress and the published sample count.
+    Peak pending;
+    std::atomic<size_t> built{0};
+};
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+// ---- PNG Writer ----
+// Writes 8-bit RGB images as PNG, with no library: waveform pictures use a
+// handful of colours, so they go out palette-indexed (truecolor past 256
+// colours), compressed with deflate's fixed Huffman codes and a greedy LZ77
+// match search. Long runs and repeated rows, which is most of a waveform,
+// shrink to a few bits each; a thumbnail is typically a few kilobytes.
+namespace png {
+
+inline uint32_t crc32(const uint8_t* bytes, size_t count, uint32_t crc = 0) {
+    static const std::vector<uint32_t> table = [] {
+        std::vector<uint32_t> t(256);
+
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+
+        return t;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < count; ++i) crc = table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+inline uint32_t adler32(const uint8_t* bytes, size_t count) {
+    uint32_t a = 1, b = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        a = (a + bytes[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+
+    return (b << 16) | a;
+}
+
+// Deflate bit stream, least significant bit first.
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out(out) {}
+
+    void bits(uint32_t value, int count) {
+        buffer |= static_cast<uint64_t>(value) << filled;
+        filled += count;
+
+        while (filled >= 8) {
+            out.push_back(static_cast<uint8_t>(buffer));
+            buffer >>= 8;
+            filled -= 8;
+        }
+    }
+
+    // Huffman codes go most significant bit first.
+    void code(uint32_t value, int count) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < count; ++i) reversed |= ((value >> i) & 1) << (count - 1 - i);
+        bits(reversed, count);
+    }
+
+    void flush() {
+        if (filled > 0) out.push_back(static_cast<uint8_t>(buffer));
+        buffer = 0;
+        filled = 0;
+    }
+
+private:
+    std::vector<uint8_t>& out;
+    uint64_t buffer = 0;
+    int filled = 0;
+};
+
+// Literal or length symbol in the fixed code.
+inline void fixedSymbol(BitWriter& writer, unsigned symbol) {
+    if (symbol < 144) writer.code(0x30 + symbol, 8);
+    else if (symbol < 256) writer.code(0x190 + (symbol - 144), 9);
+    else if (symbol < 280) writer.code(symbol - 256, 7);
+    else writer.code(0xc0 + (symbol - 280), 8);
+}
+
+// A zlib stream of data in one fixed-Huffman deflate block.
+inline void deflate(const std::vector<uint8_t>& data, std::vector<uint8_t>& out) {
+    static const uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                             35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                             3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const uint16_t distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                               257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                               8193, 12289, 16385, 24577 };
+    static const uint8_t distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                               7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    const size_t window = 32768, hashSize = 1 << 15, maxChain = 64, minMatch = 3, maxMatch = 258;
+
+    // Deflate, 32 KB window, no dictionary, fastest level.
+    out.push_back(0x78);
+    out.push_back(0x01);
+
+    BitWriter writer(out);
+    // Final block, fixed codes.
+    writer.bits(1, 1);
+    writer.bits(1, 2);
+
+    std::vector<int64_t> head(hashSize, -1);
+    std::vector<int64_t> chain(window, -1);
+    auto hash = [&](size_t at) {
+        return ((data[at] << 10) ^ (data[at + 1] << 5) ^ data[at + 2]) & (hashSize - 1);
+    };
+    auto insert = [&](size_t at) {
+        if (at + minMatch > data.size()) return;
+        size_t h = hash(at);
+        chain[at % window] = head[h];
+        head[h] = static_cast<int64_t>(at);
+    };
+
+    for (size_t at = 0; at < data.size(); ) {
+        size_t bestLength = 0, bestDistance = 0;
+
+        if (at + minMatch <= data.size()) {
+            size_t limit = std::min(maxMatch, data.size() - at);
+            int64_t candidate = head[hash(at)];
+
+            for (size_t tries = 0; candidate >= 0 && at - candidate <= window && tries < maxChain; ++tries) {
+                size_t length = 0;
+                while (length < limit && data[candidate + length] == data[at + length]) ++length;
+
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestDistance = at - static_cast<size_t>(candidate);
+                    if (length == limit) break;
+                }
+
+                int64_t next = chain[candidate % window];
+                // Older than the window, or overwritten by a newer position.
+                if (next >= candidate) break;
+                candidate = next;
+            }
+        }
+
+        if (bestLength >= minMatch) {
+            unsigned l = 0;
+            while (l + 1 < 29 && lengthBase[l + 1] <= bestLength) ++l;
+            fixedSymbol(writer, 257 + l);
+            writer.bits(static_cast<uint32_t>(bestLength - lengthBase[l]), lengthExtra[l]);
+
+            unsigned d = 0;
+            while (d + 1 < 30 && distanceBase[d + 1] <= bestDistance) ++d;
+            writer.code(d, 5);
+            writer.bits(static_cast<uint32_t>(bestDistance - distanceBase[d]), distanceExtra[d]);
+
+            for (size_t i = 0; i < bestLength; ++i) insert(at + i);
+            at += bestLength;
+        }
+        else {
+            fixedSymbol(writer, data[at]);
+            insert(at);
+            ++at;
+        }
+    }
+
+    // End of block.
+    fixedSymbol(writer, 256);
+    writer.flush();
+
+    uint32_t check = adler32(data.data(), data.size());
+    for (int shift = 24; shift >= 0; shift -= 8) out.push_back(static_cast<uint8_t>(check >> shift));
+}
+
+inline void put32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) out.push_back(static_cast<uint8_t>(value >> shift));
+}
+
+inline void chunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& body) {
+    put32(out, static_cast<uint32_t>(body.size()));
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), body.begin(), body.end());
+    put32(out, crc32(out.data() + start, out.size() - start));
+}
+
+} // namespace png
+
+// Writes width x height pixels (rows top to bottom, 3 bytes each) to path.
+inline bool writePng(const std::string& path, int width, int height, const uint8_t* rgb) {
+    size_t pixelCount = static_cast<size_t>(std::max(width, 0)) * std::max(height, 0);
+
+    // Palette of the colours in order of appearance, while they fit.
+    std::vector<uint32_t> palette;
+    std::vector<uint8_t> indices(pixelCount);
+    bool indexed = true;
+
+    for (size_t i = 0; i < pixelCount && indexed; ++i) {
+        uint32_t colour = (uint32_t(rgb[3 * i]) << 16) | (uint32_t(rgb[3 * i + 1]) << 8) | rgb[3 * i + 2];
+        auto found = std::find(palette.begin(), palette.end(), colour);
+
+        if (found == palette.end()) {
+            if (palette.size() == 256) {
+                indexed = false;
+                break;
+            }
+
+            found = palette.insert(palette.end(), colour);
+        }
+
+        indices[i] = static_cast<uint8_t>(found - palette.begin());
+    }
+
+    // Scanlines, each after a filter byte (0: none).
+    size_t rowBytes = static_cast<size_t>(width) * (indexed ? 1 : 3);
+    std::vector<uint8_t> raw;
+    raw.reserve((rowBytes + 1) * height);
+
+    for (int y = 0; y < height; ++y) {
+        raw.push_back(0);
+        const uint8_t* row = indexed ? indices.data() + static_cast<size_t>(y) * width : rgb + static_cast<size_t>(y) * rowBytes;
+        raw.insert(raw.end(), row, row + rowBytes);
+    }
+
+    std::vector<uint8_t> file = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    std::vector<uint8_t> body;
+
+    png::put32(body, static_cast<uint32_t>(width));
+    png::put32(body, static_cast<uint32_t>(height));
+    // 8 bits, palette or RGB, deflate, no filter method, no interlacing.
+    body.insert(body.end(), { 8, static_cast<uint8_t>(indexed ? 3 : 2), 0, 0, 0 });
+    png::chunk(file, "IHDR", body);
+
+    if (indexed) {
+        body.clear();
+
+        for (uint32_t colour : palette) {
+            body.insert(body.end(), { static_cast<uint8_t>(colour >> 16), static_cast<uint8_t>(colour >> 8), static_cast<uint8_t>(colour) });
+        }
+
+        png::chunk(file, "PLTE", body);
+    }
+
+    body.clear();
+    png::deflate(raw, body);
+    png::chunk(file, "IDAT", body);
+    png::chunk(file, "IEND", {});
+
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+
+    if (!out) {
+        std::cerr << "Failed to write image: " << path << std::endl;
+        return false;
+    }
+
+    return true;
+}
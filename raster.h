@@ -0,0 +1,151 @@
+#pragma once
+
+#include "gl_batch.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+// ---- Raster Image ----
+// Software rendering of BatchGeometry into an RGB image, for drawing without
+// a GL context or display (batch mode). It follows GL's rules closely enough
+// for the picture to match the viewer's: coordinates as set up by
+// glOrtho(0, width, 0, height), so the image's first row is the top one
+// (y = height); a pixel is covered when its centre is; lines are one pixel
+// wide and, like GL's, half open (a shared end is drawn once).
+// Quads are filled as their bounding box: the view only draws axis-aligned ones.
+class RasterImage {
+public:
+    // Resizes to w x h filled with r, g, b (0 to 1). Keeps the storage.
+    void reset(int w, int h, float r, float g, float b) {
+        imageWidth = std::max(w, 0);
+        imageHeight = std::max(h, 0);
+        rgb.resize(static_cast<size_t>(imageWidth) * imageHeight * 3);
+        setColor(r, g, b);
+
+        for (size_t i = 0; i < rgb.size(); i += 3) {
+            rgb[i] = color[0];
+            rgb[i + 1] = color[1];
+            rgb[i + 2] = color[2];
+        }
+    }
+
+    int width() const { return imageWidth; }
+    int height() const { return imageHeight; }
+    // Rows top to bottom, 3 bytes per pixel.
+    const uint8_t* pixels() const { return rgb.data(); }
+
+    // Draws the batches in order, as BatchRenderer::draw() would.
+    void draw(const BatchGeometry& geometry) {
+        for (const DrawBatch& batch : geometry.batches) {
+            const float* v = geometry.vertices.data() + 2 * static_cast<size_t>(batch.first);
+            setColor(batch.r, batch.g, batch.b);
+
+            switch (batch.mode) {
+                case GL_QUADS:
+                    for (GLsizei i = 0; i + 3 < batch.count; i += 4) {
+                        const float* q = v + 2 * i;
+                        fillRect(std::min({ q[0], q[2], q[4], q[6] }), std::min({ q[1], q[3], q[5], q[7] }),
+                                 std::max({ q[0], q[2], q[4], q[6] }), std::max({ q[1], q[3], q[5], q[7] }));
+                    }
+                    break;
+                case GL_LINES:
+                    for (GLsizei i = 0; i + 1 < batch.count; i += 2) {
+                        line(v[2 * i], v[2 * i + 1], v[2 * i + 2], v[2 * i + 3]);
+                    }
+                    break;
+                case GL_LINE_STRIP:
+                    for (GLsizei i = 0; i + 1 < batch.count; ++i) {
+                        line(v[2 * i], v[2 * i + 1], v[2 * i + 2], v[2 * i + 3]);
+                    }
+                    break;
+                case GL_POINTS:
+                    for (GLsizei i = 0; i < batch.count; ++i) {
+                        float half = batch.size / 2.0f;
+                        fillRect(v[2 * i] - half, v[2 * i + 1] - half, v[2 * i] + half, v[2 * i + 1] + half);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+private:
+    void setColor(float r, float g, float b) {
+        color[0] = toByte(r);
+        color[1] = toByte(g);
+        color[2] = toByte(b);
+    }
+
+    static uint8_t toByte(float value) {
+        return static_cast<uint8_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+    }
+
+    // x, y in GL coordinates (y up).
+    void plot(int x, int y) {
+        if (x < 0 || y < 0 || x >= imageWidth || y >= imageHeight) return;
+
+        uint8_t* pixel = rgb.data() + (static_cast<size_t>(imageHeight - 1 - y) * imageWidth + x) * 3;
+        pixel[0] = color[0];
+        pixel[1] = color[1];
+        pixel[2] = color[2];
+    }
+
+    // The first pixel whose centre is at or past edge.
+    static int firstCentre(float edge) {
+        return static_cast<int>(std::ceil(edge - 0.5f));
+    }
+
+    // The last pixel whose centre is at or before edge.
+    static int lastCentre(float edge) {
+        return static_cast<int>(std::floor(edge - 0.5f));
+    }
+
+    // Pixels with centres in [x0, x1) x [y0, y1).
+    void fillRect(float x0, float y0, float x1, float y1) {
+        int left = std::max(firstCentre(x0), 0), right = std::min(firstCentre(x1), imageWidth);
+        int bottom = std::max(firstCentre(y0), 0), top = std::min(firstCentre(y1), imageHeight);
+
+        for (int y = bottom; y < top; ++y) {
+            for (int x = left; x < right; ++x) plot(x, y);
+        }
+    }
+
+    // The pixel a coordinate falls in; one exactly on a boundary goes to the
+    // lower pixel, as GL's line rasterization does.
+    static int pixelOf(float coordinate) {
+        return static_cast<int>(std::ceil(coordinate)) - 1;
+    }
+
+    // One pixel per column (or row, for steep lines) whose centre the segment
+    // spans from its first end up to but not including its second, the one it
+    // passes through there.
+    void line(float x0, float y0, float x1, float y1) {
+        bool steep = std::abs(y1 - y0) > std::abs(x1 - x0);
+        // Major and minor axis.
+        float a0 = steep ? y0 : x0, a1 = steep ? y1 : x1;
+        float b0 = steep ? x0 : y0, b1 = steep ? x1 : y1;
+
+        if (a0 == a1) return;
+
+        // Centres in [a0, a1) going up, (a1, a0] going down.
+        int first = a1 > a0 ? firstCentre(a0) : lastCentre(a1) + 1;
+        int last = a1 > a0 ? firstCentre(a1) : lastCentre(a0) + 1;
+        int limit = steep ? imageHeight : imageWidth;
+        float slope = (b1 - b0) / (a1 - a0);
+
+        for (int a = std::max(first, 0); a < std::min(last, limit); ++a) {
+            int b = pixelOf(b0 + (a + 0.5f - a0) * slope);
+
+            if (steep) plot(b, a);
+            else plot(a, b);
+        }
+    }
+
+    std::vector<uint8_t> rgb;
+    int imageWidth = 0;
+    int imageHeight = 0;
+    uint8_t color[3] = {};
+};
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "kernels.h"
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+enum class ResampleQuality { Linear, Cubic, Sinc };
+
+inline const char* resampleQualityName(ResampleQuality quality) {
+    switch (quality) {
+        case ResampleQuality::Linear: return "linear";
+        case ResampleQuality::Cubic: return "cubic";
+        default: return "sinc";
+    }
+}
+
+inline bool parseResampleQuality(const std::string& name, ResampleQuality& quality) {
+    for (ResampleQuality q : { ResampleQuality::Linear, ResampleQuality::Cubic, ResampleQuality::Sinc }) {
+        if (name == resampleQualityName(q)) {
+            quality = q;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// ---- Resampler ----
+// Polyphase FIR sample rate converter. All three qualities are tables of
+// filter phases; an output is the dot product of the input around its
+// position with the two nearest phases, blended. The dot product is a SIMD
+// kernel, so the cost grows with the tap count rather than with the quality:
+//   linear  2 taps
+//   cubic   4 taps (Catmull-Rom)
+//   sinc    32 taps when upsampling, more when downsampling (Kaiser windowed,
+//           cut off below the lower Nyquist frequency, so no aliasing)
+// The resampler holds no stream state: callers keep their position and pass
+// the input with before() frames of history and after() frames of lookahead.
+class Resampler {
+public:
+    // Phases per input frame in the table.
+    static constexpr int phases = 256;
+    // Sinc filter zero crossings on each side of the center.
+    static constexpr int sincZeroCrossings = 16;
+    static constexpr int maxTaps = 256;
+
+    void configure(unsigned inputRate, unsigned outputRate, ResampleQuality quality) {
+        step = static_cast<double>(inputRate) / std::max(outputRate, 1u);
+        dot = dotKernel().run;
+
+        // Band limit relative to the input Nyquist frequency.
+        double cutoff = 1.0;
+
+        if (quality == ResampleQuality::Linear) {
+            taps = 2;
+        }
+        else if (quality == ResampleQuality::Cubic) {
+            taps = 4;
+        }
+        else {
+            cutoff = 0.95 * std::min(1.0, 1.0 / step);
+            int half = static_cast<int>(std::ceil(sincZeroCrossings / cutoff));
+            // Very large ratios get fewer zero crossings rather than a cut-off window.
+            taps = std::min(2 * half, maxTaps);
+        }
+
+        table.assign(static_cast<size_t>(phases + 1) * taps, 0.0f);
+
+        for (int p = 0; p <= phases; ++p) {
+            float* row = table.data() + static_cast<size_t>(p) * taps;
+            double fraction = static_cast<double>(p) / phases;
+            double sum = 0.0;
+
+            for (int j = 0; j < taps; ++j) {
+                // Distance from tap j to the interpolated position.
+                double d = j - before() - fraction;
+                double c = coefficient(quality, d, cutoff, taps / 2.0);
+                row[j] = static_cast<float>(c);
+                sum += c;
+            }
+
+            // Unity gain at DC for every phase.
+            for (int j = 0; sum != 0.0 && j < taps; ++j) {
+                row[j] = static_cast<float>(row[j] / sum);
+            }
+        }
+    }
+
+    // Input frames per output frame.
+    double ratio() const { return step; }
+    int length() const { return taps; }
+    // Input frames needed before and after the frame an output falls in.
+    int before() const { return taps / 2 - 1; }
+    int after() const { return taps / 2; }
+
+    // out[i] is the input signal at position time + i * ratio(), in frames
+    // from input[0]. Every position must have before() frames before it and
+    // after() frames after it in input.
+    void process(const float* input, double time, float* out, size_t count) const {
+        for (size_t i = 0; i < count; ++i) {
+            double t = time + i * step;
+            size_t index = static_cast<size_t>(t);
+            double scaled = (t - index) * phases;
+            int phase = static_cast<int>(scaled);
+            float blend = static_cast<float>(scaled - phase);
+
+            const float* window = input + index - before();
+            const float* row = table.data() + static_cast<size_t>(phase) * taps;
+            float a = dot(window, row, taps);
+            float b = dot(window, row + taps, taps);
+            out[i] = a + (b - a) * blend;
+        }
+    }
+
+private:
+    // Filter response at distance d (in input frames); half is the sinc window half width.
+    static double coefficient(ResampleQuality quality, double d, double cutoff, double half) {
+        double x = std::abs(d);
+
+        switch (quality) {
+            case ResampleQuality::Linear:
+                return x < 1.0 ? 1.0 - x : 0.0;
+
+            case ResampleQuality::Cubic:
+                if (x < 1.0) return (1.5 * x - 2.5) * x * x + 1.0;
+                if (x < 2.0) return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+                return 0.0;
+
+            default: {
+                if (x >= half) return 0.0;
+
+                double arg = M_PI * cutoff * d;
+                double sinc = x < 1e-9 ? 1.0 : std::sin(arg) / arg;
+                double r = d / half;
+
+                return cutoff * sinc * besselI0(kaiserBeta * std::sqrt(1.0 - r * r)) / besselI0(kaiserBeta);
+            }
+        }
+    }
+
+    // Zeroth-order modified Bessel function of the first kind, for the Kaiser window.
+    static double besselI0(double x) {
+        double sum = 1.0, term = 1.0;
+
+        for (int k = 1; k < 32; ++k) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+
+        return sum;
+    }
+
+    // About 80 dB stopband attenuation.
+    static constexpr double kaiserBeta = 8.0;
+
+    // (phases + 1) rows of taps coefficients; the last row is phase 0 shifted
+    // one frame, so blending never reads past the table.
+    std::vector<float> table;
+    double step = 1.0;
+    int taps = 2;
+    DotFn dot = dotScalar;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "sample_source.h"
+#include "arena.h"
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+
+// ---- Sample Buffer ----
+// The one copy of a file's decoded PCM, shared (through
+// std::shared_ptr<const SampleSource>) by the audio device and the waveform
+// view. Channels are stored planar, any number of them, in one allocation
+// where every channel starts on a cache line (so SIMD loads of a channel are
+// aligned and channels never share a line). The allocation comes from the
+// file's Arena when one is given, so it is recycled for the next file.
+//
+// The decoder writes frames in order and publishes them; published frames
+// are never modified again, so readers only need available().
+class SampleBuffer : public SampleSource {
+public:
+    // Bytes between channel starts are a multiple of this.
+    static constexpr size_t alignment = 64;
+
+    // Allocates channels x frames samples, to be filled through writableChannel().
+    SampleBuffer(size_t channels, size_t frames, std::shared_ptr<Arena> arena = nullptr)
+        : arena(std::move(arena)), channelCount(channels), frameCount(frames) {
+        allocate();
+    }
+
+    // Copies fully decoded channels of equal length.
+    explicit SampleBuffer(const std::vector<std::vector<float>>& channels, std::shared_ptr<Arena> arena = nullptr)
+        : arena(std::move(arena)), channelCount(channels.size()), frameCount(channels.empty() ? 0 : channels[0].size()) {
+        allocate();
+
+        for (size_t c = 0; c < channelCount; ++c) {
+            std::memcpy(writableChannel(c), channels[c].data(), frameCount * sizeof(float));
+        }
+
+        publish(frameCount);
+    }
+
+    SampleBuffer(const SampleBuffer&) = delete;
+    SampleBuffer& operator=(const SampleBuffer&) = delete;
+
+    size_t channels() const override { return channelCount; }
+    size_t frames() const override { return frameCount; }
+
+    // Frames that are decoded and safe to read.
+    size_t available() const override { return published.load(std::memory_order_acquire); }
+
+    void read(size_t c, size_t start, size_t count, float* out) const override {
+        std::memcpy(out, channelData(c) + start, count * sizeof(float));
+    }
+
+    const float* channelData(size_t c) const override { return data + c * stride; }
+    float* writableChannel(size_t c) { return data + c * stride; }
+
+    // Called by the writer once frames [0, count) are filled.
+    void publish(size_t count) {
+        published.store(std::min(count, frameCount), std::memory_order_release);
+    }
+
+    // Drops the frames past count when the file turns out shorter than announced.
+    // Only the writer may call this, before the buffer is shared.
+    void truncate(size_t count) {
+        frameCount = std::min(count, frameCount);
+        publish(frameCount);
+    }
+
+private:
+    void allocate() {
+        constexpr size_t lineFloats = alignment / sizeof(float);
+        stride = (frameCount + lineFloats - 1) / lineFloats * lineFloats;
+        // Left uninitialised: the writer fills frames before publishing them.
+        size_t bytes = std::max(stride * channelCount * sizeof(float), alignment);
+
+        if (arena) {
+            data = static_cast<float*>(arena->allocateBytes(bytes));
+            return;
+        }
+
+        storage.reset(static_cast<float*>(std::aligned_alloc(alignment, bytes)));
+
+        if (!storage) throw std::bad_alloc();
+
+        data = storage.get();
+    }
+
+    struct Free {
+        void operator()(float* p) const { std::free(p); }
+    };
+
+    // Set when not allocated from arena.
+    std::unique_ptr<float[], Free> storage;
+    std::shared_ptr<Arena> arena;
+    float* data = nullptr;
+    // Floats from one channel's start to the next.
+    size_t stride = 0;
+    size_t channelCount = 0;
+    size_t frameCount = 0;
+    std::atomic<size_t> published{0};
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+
+// ---- Sample Source ----
+// Read access to a file's PCM, whatever the storage behind it: decoded floats
+// in memory (SampleBuffer), an uncompressed WAV mapped from disk
+// (MappedWavSource) or decoded floats paged from disk (PagedSampleSource).
+// Frames below available() never change.
+class SampleSource {
+public:
+    virtual ~SampleSource() = default;
+
+    virtual size_t channels() const = 0;
+    virtual size_t frames() const = 0;
+
+    // Frames that are safe to read (all of them unless still decoding).
+    virtual size_t available() const { return frames(); }
+
+    // Converts count samples of channel c, starting at frame start, into out.
+    virtual void read(size_t c, size_t start, size_t count, float* out) const = 0;
+
+    // Like read(), for callers that can't wait on disk (the audio callback).
+    // Samples that aren't at hand read as silence and false is returned.
+    virtual bool tryRead(size_t c, size_t start, size_t count, float* out) const {
+        read(c, start, count, out);
+        return true;
+    }
+
+    // Hint that reading continues from frame. Must not block.
+    virtual void prefetch(size_t) const {}
+
+    // Planar float samples of channel c when the storage holds them, else
+    // nullptr and the caller goes through read().
+    virtual const float* channelData(size_t) const { return nullptr; }
+
+    bool isStereo() const { return channels() > 1; }
+    bool complete() const { return available() == frames(); }
+
+    // Pointer to count samples of channel c from frame start: straight into the
+    // storage when possible, otherwise converted into scratch.
+    const float* fetch(size_t c, size_t start, size_t count, float* scratch) const {
+        if (const float* data = channelData(c)) {
+            return data + start;
+        }
+
+        read(c, start, count, scratch);
+        return scratch;
+    }
+
+    // fetch() through tryRead().
+    const float* tryFetch(size_t c, size_t start, size_t count, float* scratch) const {
+        if (const float* data = channelData(c)) {
+            return data + start;
+        }
+
+        tryRead(c, start, count, scratch);
+        return scratch;
+    }
+};
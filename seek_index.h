@@ -0,0 +1,192 @@
+#pragma once
+
+#include "mapped_file.h"
+#include <vector>
+#include <string>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+// ---- Seek Index ----
+// Where decoding can start inside a compressed file: the byte offset of a
+// frame and the first sample it holds. Decoding from the point at or before
+// a position, instead of from the start of the file, is what makes random
+// access into a long file cheap (see CompressedSampleSource).
+//
+// Only FLAC is indexed: its frames decode independently and each header
+// carries its first sample. MP3 frames depend on the ones before them (bit
+// reservoir, encoder delay), so MP3 seeks are left to the decoder's own
+// seek table.
+struct SeekPoint {
+    uint64_t frame = 0;
+    uint64_t offset = 0;
+};
+
+struct SeekIndex {
+    // Size of everything before the first audio frame (stream marker and
+    // metadata), which a decoder needs before any frame.
+    uint64_t headerBytes = 0;
+    // Ascending, the first one at frame 0.
+    std::vector<SeekPoint> points;
+
+    bool empty() const { return points.empty(); }
+
+    // The last point at or before frame.
+    const SeekPoint* find(uint64_t frame) const {
+        size_t lo = 0, hi = points.size();
+
+        while (hi - lo > 1) {
+            size_t mid = (lo + hi) / 2;
+            if (points[mid].frame <= frame) lo = mid; else hi = mid;
+        }
+
+        return points.empty() ? nullptr : &points[lo];
+    }
+};
+
+namespace flac {
+
+// CRC-8 (polynomial 0x07) that ends every frame header.
+inline uint8_t crc8(const unsigned char* bytes, size_t count) {
+    uint8_t crc = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        crc ^= bytes[i];
+        for (int bit = 0; bit < 8; ++bit) crc = static_cast<uint8_t>((crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1);
+    }
+
+    return crc;
+}
+
+// Parses the frame header at bytes (size bytes readable). On success gives
+// the header's coded number (frame number with a fixed block size, else the
+// first sample) and the frame's sample count.
+inline bool parseFrameHeader(const unsigned char* bytes, size_t size, bool& variable, uint64_t& number, uint32_t& blockSize) {
+    if (size < 6 || bytes[0] != 0xff || (bytes[1] & 0xfe) != 0xf8) return false;
+
+    variable = bytes[1] & 1;
+    unsigned blockCode = bytes[2] >> 4;
+    unsigned rateCode = bytes[2] & 0x0f;
+    unsigned channelCode = bytes[3] >> 4;
+    unsigned sizeCode = (bytes[3] >> 1) & 0x07;
+
+    if (blockCode == 0 || rateCode == 15 || channelCode > 10 || sizeCode == 3 || (bytes[3] & 1)) return false;
+
+    // UTF-8 style coded number, 1 to 7 bytes.
+    size_t at = 4;
+    unsigned first = bytes[at++];
+    int extra = 0;
+
+    if (first < 0x80) { number = first; }
+    else if ((first & 0xe0) == 0xc0) { number = first & 0x1f; extra = 1; }
+    else if ((first & 0xf0) == 0xe0) { number = first & 0x0f; extra = 2; }
+    else if ((first & 0xf8) == 0xf0) { number = first & 0x07; extra = 3; }
+    else if ((first & 0xfc) == 0xf8) { number = first & 0x03; extra = 4; }
+    else if ((first & 0xfe) == 0xfc) { number = first & 0x01; extra = 5; }
+    else if (first == 0xfe && variable) { number = 0; extra = 6; }
+    else return false;
+
+    for (int i = 0; i < extra; ++i) {
+        if (at >= size || (bytes[at] & 0xc0) != 0x80) return false;
+        number = (number << 6) | (bytes[at++] & 0x3f);
+    }
+
+    if (blockCode == 1) blockSize = 192;
+    else if (blockCode <= 5) blockSize = 576u << (blockCode - 2);
+    else if (blockCode == 6) { if (at >= size) return false; blockSize = bytes[at++] + 1u; }
+    else if (blockCode == 7) { if (at + 1 >= size) return false; blockSize = ((bytes[at] << 8) | bytes[at + 1]) + 1u; at += 2; }
+    else blockSize = 256u << (blockCode - 8);
+
+    if (rateCode == 12) at += 1;
+    else if (rateCode == 13 || rateCode == 14) at += 2;
+
+    return at < size && crc8(bytes, at) == bytes[at];
+}
+
+} // namespace flac
+
+// Indexes a native FLAC file, a point at least every spacing samples. Reads
+// the file once but decodes nothing. A header is only taken as such when it
+// continues the frame before it, so sync patterns inside audio data are
+// skipped. Returns false if path isn't FLAC, or cancel was set.
+inline bool buildFlacSeekIndex(const std::string& path, SeekIndex& index, uint64_t spacing = 16384,
+                               const std::atomic<bool>* cancel = nullptr) {
+    MappedFile file;
+    if (!file.open(path)) return false;
+
+    const unsigned char* bytes = file.data();
+    size_t size = file.size();
+
+    if (size < 8 || std::memcmp(bytes, "fLaC", 4) != 0) return false;
+
+    // Metadata blocks: STREAMINFO gives the fixed block size, the last one
+    // ends the header.
+    size_t at = 4;
+    uint32_t fixedBlockSize = 0;
+    bool last = false;
+
+    while (!last) {
+        if (at + 4 > size) return false;
+
+        last = bytes[at] & 0x80;
+        unsigned type = bytes[at] & 0x7f;
+        size_t length = (size_t(bytes[at + 1]) << 16) | (size_t(bytes[at + 2]) << 8) | bytes[at + 3];
+
+        if (type == 0 && length >= 4 && at + 8 <= size) {
+            uint32_t minBlock = (bytes[at + 4] << 8) | bytes[at + 5];
+            uint32_t maxBlock = (bytes[at + 6] << 8) | bytes[at + 7];
+            if (minBlock == maxBlock) fixedBlockSize = maxBlock;
+        }
+
+        at += 4 + length;
+    }
+
+    SeekIndex result;
+    result.headerBytes = at;
+    uint64_t expected = 0;
+    size_t nextCheck = at;
+    size_t released = 0;
+
+    // Frames are at least a header long.
+    while (at + 6 <= size) {
+        if (at >= nextCheck) {
+            if (cancel && cancel->load(std::memory_order_relaxed)) return false;
+            nextCheck = at + (size_t(1) << 20);
+            // Scanned pages aren't needed again.
+            file.release(released, at - released);
+            released = at;
+        }
+
+        const unsigned char* sync = static_cast<const unsigned char*>(std::memchr(bytes + at, 0xff, size - at));
+        if (!sync) break;
+
+        at = static_cast<size_t>(sync - bytes);
+
+        bool variable;
+        uint64_t number;
+        uint32_t blockSize;
+
+        if (flac::parseFrameHeader(bytes + at, std::min<size_t>(size - at, 16), variable, number, blockSize)) {
+            uint64_t first = variable ? number : number * (fixedBlockSize ? fixedBlockSize : blockSize);
+
+            if (first == expected) {
+                if (result.points.empty() || first >= result.points.back().frame + spacing) {
+                    result.points.push_back({ first, static_cast<uint64_t>(at) });
+                }
+
+                expected = first + blockSize;
+                at += 6;
+                continue;
+            }
+        }
+
+        ++at;
+    }
+
+    if (result.points.empty()) return false;
+
+    index = std::move(result);
+    return true;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+
+// ---- SPSC Queue ----
+// Wait-free ring for one producer thread and one consumer thread. Neither
+// side ever blocks or allocates, so the consumer can be an audio callback.
+// Each side caches the other's index and only reloads it when the ring looks
+// full (or empty), which keeps cross-core traffic to a minimum.
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    // Producer side. Returns false (dropping item) when the ring is full.
+    bool push(const T& item) {
+        size_t write = writeIndex.load(std::memory_order_relaxed);
+
+        if (write - cachedRead == Capacity) {
+            cachedRead = readIndex.load(std::memory_order_acquire);
+            if (write - cachedRead == Capacity) return false;
+        }
+
+        slots[write & (Capacity - 1)] = item;
+        writeIndex.store(write + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Consumer side. Returns false when the ring is empty.
+    bool pop(T& item) {
+        size_t read = readIndex.load(std::memory_order_relaxed);
+
+        if (read == cachedWrite) {
+            cachedWrite = writeIndex.load(std::memory_order_acquire);
+            if (read == cachedWrite) return false;
+        }
+
+        item = slots[read & (Capacity - 1)];
+        readIndex.store(read + 1, std::memory_order_release);
+
+        return true;
+    }
+
+private:
+    // Consumer-owned.
+    alignas(64) std::atomic<size_t> readIndex{0};
+    size_t cachedWrite = 0;
+    // Producer-owned.
+    alignas(64) std::atomic<size_t> writeIndex{0};
+    size_t cachedRead = 0;
+    alignas(64) T slots[Capacity];
+};
+
+// ---- SPSC Sample Ring ----
+// The same ring for runs of samples, sized at runtime: the capture callback
+// pushes each buffer whole and a worker thread pops what has arrived. Only
+// reset() allocates.
+class SampleRing {
+public:
+    // Room for at least capacity samples, rounded up to a power of two.
+    // Not thread safe: call before either side runs.
+    void reset(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size *= 2;
+
+        slots.assign(size, 0.0f);
+        mask = size - 1;
+        readIndex.store(0, std::memory_order_relaxed);
+        writeIndex.store(0, std::memory_order_relaxed);
+        cachedRead = cachedWrite = 0;
+    }
+
+    size_t capacity() const { return slots.size(); }
+
+    // Producer side. Copies all count samples, or none (returning false) when
+    // they don't fit, so runs of whole frames stay whole.
+    bool push(const float* samples, size_t count) {
+        size_t write = writeIndex.load(std::memory_order_relaxed);
+
+        if (capacity() - (write - cachedRead) < count) {
+            cachedRead = readIndex.load(std::memory_order_acquire);
+            if (capacity() - (write - cachedRead) < count) return false;
+        }
+
+        copyIn(write, samples, count);
+        writeIndex.store(write + count, std::memory_order_release);
+
+        return true;
+    }
+
+    // Consumer side. Moves up to count samples into out; returns how many.
+    size_t pop(float* out, size_t count) {
+        size_t read = readIndex.load(std::memory_order_relaxed);
+
+        if (cachedWrite - read < count) {
+            cachedWrite = writeIndex.load(std::memory_order_acquire);
+        }
+
+        count = std::min(count, cachedWrite - read);
+        copyOut(read, out, count);
+        readIndex.store(read + count, std::memory_order_release);
+
+        return count;
+    }
+
+private:
+    // Copies in at most two pieces, around the end of the slots.
+    void copyIn(size_t at, const float* samples, size_t count) {
+        size_t first = std::min(count, capacity() - (at & mask));
+        std::memcpy(slots.data() + (at & mask), samples, first * sizeof(float));
+        std::memcpy(slots.data(), samples + first, (count - first) * sizeof(float));
+    }
+
+    void copyOut(size_t at, float* out, size_t count) const {
+        size_t first = std::min(count, capacity() - (at & mask));
+        std::memcpy(out, slots.data() + (at & mask), first * sizeof(float));
+        std::memcpy(out + first, slots.data(), (count - first) * sizeof(float));
+    }
+
+    // Consumer-owned.
+    alignas(64) std::atomic<size_t> readIndex{0};
+    size_t cachedWrite = 0;
+    // Producer-owned.
+    alignas(64) std::atomic<size_t> writeIndex{0};
+    size_t cachedRead = 0;
+    alignas(64) std::vector<float> slots;
+    size_t mask = 0;
+};
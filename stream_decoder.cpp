@@ -0,0 +1,267 @@
+#include "stream_decoder.h"
+
+bool StreamingDecoder::open(const std::string& path, bool buildPeaks)
+{
+    auto wav = std::make_shared<MappedWavSource>();
+
+    if (wav->open(path)) {
+        mapped = wav;
+        samples = wav;
+        frameCount = wav->frames();
+        channelCount = wav->channels();
+        sampleRate = wav->sampleRate();
+        reservePeaks(buildPeaks);
+
+        return true;
+    }
+
+    auto source = std::make_shared<CompressedSampleSource>();
+
+    if (source->open(path, memoryBudget, seekIndex)) {
+        compressed = source;
+        samples = source;
+        sourcePath = path;
+        frameCount = source->frames();
+        channelCount = source->channels();
+        sampleRate = source->sampleRate();
+        reservePeaks(buildPeaks);
+
+        // The samples are read through the source; the worker's own decoder
+        // is only needed for the pyramids.
+        if (!buildPeaks) return true;
+    }
+
+    // Force float output
+    ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 0, 0);
+
+    if (ma_decoder_init_file(path.c_str(), &config, &decoder) != MA_SUCCESS) {
+        std::cerr << "Failed to decode: " << path << std::endl;
+        return false;
+    }
+
+    opened = true;
+
+    if (compressed) return true;
+
+    ma_uint64 length = 0;
+    if (ma_decoder_get_length_in_pcm_frames(&decoder, &length) != MA_SUCCESS) {
+        // Unknown length: the storage grows block by block instead.
+        length = 0;
+    }
+
+    frameCount = static_cast<size_t>(length);
+    channelCount = decoder.outputChannels;
+    sampleRate = decoder.outputSampleRate;
+
+    if (frameCount > 0 && frameCount * channelCount * sizeof(float) > memoryBudget) {
+        paged = std::make_shared<PagedSampleSource>();
+
+        if (!paged->create(channelCount, frameCount, memoryBudget)) {
+            return false;
+        }
+
+        samples = paged;
+    }
+    else if (frameCount > 0) {
+        buffer = std::make_shared<SampleBuffer>(channelCount, frameCount, arena);
+        samples = buffer;
+    }
+
+    reservePeaks(buildPeaks);
+
+    return true;
+}
+
+void StreamingDecoder::reservePeaks(bool buildPeaks)
+{
+    buildingPeaks = buildPeaks;
+
+    if (!buildPeaks || frameCount == 0) return;
+
+    for (size_t c = 0; c < channelCount; ++c) {
+        peaks.push_back(std::make_shared<PeakPyramid>());
+        peaks.back()->reserve(frameCount, arena);
+        levels.push_back(std::make_shared<LevelTrack>());
+        levels.back()->reserve(frameCount, sampleRate, arena);
+    }
+}
+
+bool StreamingDecoder::scanMapped()
+{
+    // Summarised in parallel, a span of blocks at a time.
+    const size_t spanFrames = static_cast<size_t>(blockFrames) * 16;
+    size_t done = 0;
+    auto lastProgress = std::chrono::steady_clock::now();
+
+    while (!peaks.empty() && done < frameCount && !cancelled.load(std::memory_order_relaxed)) {
+        size_t count = std::min(spanFrames, frameCount - done);
+        // The levels run through each channel in order while the pyramids
+        // take the other cores.
+        TaskGroup analysis;
+
+        analyseAsync(analysis, *mapped, levels, done, count);
+        summariseRange(*mapped, peaks, done, count);
+        analysis.wait();
+        mapped->release(done, count);
+        done += count;
+        decoded.store(done, std::memory_order_release);
+
+        auto now = std::chrono::steady_clock::now();
+        if (progressCallback && now - lastProgress >= std::chrono::milliseconds(50)) {
+            lastProgress = now;
+            progressCallback();
+        }
+    }
+
+    return !cancelled.load();
+}
+
+bool StreamingDecoder::decode()
+{
+    ma_uint32 channels = decoder.outputChannels;
+    // The only interleaved buffer: one block, reused for the whole file.
+    float* block = arena->allocate<float>(static_cast<size_t>(blockFrames) * channels);
+    bool knownLength = frameCount > 0;
+    bool reachedEnd = false;
+    size_t done = 0;
+    // Unknown length: collect the channels here and wrap them at the end.
+    std::vector<std::vector<float>> growing(channels);
+    // Paged: split each block here before it goes to the page file.
+    // Compressed: only the pyramids are built, the planes aren't kept.
+    // Reductions of the previous block read it while the next one decodes.
+    bool scratchPlanes = paged || compressed;
+    float* planar = scratchPlanes ? arena->allocate<float>(static_cast<size_t>(blockFrames) * channels) : nullptr;
+    // Where this block's frames go, one pointer per channel.
+    std::vector<float*> planes(channels);
+    DeinterleaveFn deinterleave = deinterleaveKernel().run;
+    // Pyramid reductions in flight, for frames up to done.
+    TaskGroup summaries;
+    auto lastProgress = std::chrono::steady_clock::now();
+
+    while (!cancelled.load(std::memory_order_relaxed)) {
+        ma_uint64 wanted = blockFrames;
+
+        if (knownLength) {
+            if (done >= frameCount) {
+                reachedEnd = true;
+                break;
+            }
+
+            wanted = std::min<ma_uint64>(wanted, frameCount - done);
+        }
+
+        ma_uint64 framesRead = 0;
+        ma_result result = ma_decoder_read_pcm_frames(&decoder, block, wanted, &framesRead);
+
+        if (framesRead == 0) {
+            reachedEnd = (result == MA_AT_END);
+            break;
+        }
+
+        // The previous block's planes are about to be overwritten (and its
+        // blocks can now be shown).
+        publishPeaks(summaries, done);
+
+        for (size_t c = 0; c < channels; ++c) {
+            if (scratchPlanes) {
+                planes[c] = planar + c * static_cast<size_t>(blockFrames);
+            }
+            else if (knownLength) {
+                planes[c] = buffer->writableChannel(c) + done;
+            }
+            else {
+                growing[c].resize(done + framesRead);
+                planes[c] = growing[c].data() + done;
+            }
+        }
+
+        deinterleave(block, channels, static_cast<size_t>(framesRead), planes.data());
+
+        for (size_t c = 0; c < peaks.size(); ++c) {
+            summariseAsync(summaries, *peaks[c], done, planes[c], static_cast<size_t>(framesRead));
+        }
+
+        // Blocks go to the tracks in order: the previous block's were waited for above.
+        for (size_t c = 0; c < levels.size(); ++c) {
+            LevelTrack* track = levels[c].get();
+            const float* plane = planes[c];
+            size_t count = static_cast<size_t>(framesRead);
+
+            summaries.run([track, plane, count]() {
+                track->append(plane, count);
+            });
+        }
+
+        if (paged) {
+            paged->append(planes.data(), framesRead);
+        }
+
+        done += framesRead;
+        if (buffer) buffer->publish(done);
+        decoded.store(done, std::memory_order_release);
+
+        auto now = std::chrono::steady_clock::now();
+        if (progressCallback && now - lastProgress >= std::chrono::milliseconds(50)) {
+            lastProgress = now;
+            progressCallback();
+        }
+
+        if (result != MA_SUCCESS) {
+            reachedEnd = (result == MA_AT_END);
+            break;
+        }
+    }
+
+    publishPeaks(summaries, done);
+
+    if (paged) {
+        paged->finish(done);
+    }
+    else if (!knownLength) {
+        buffer = std::make_shared<SampleBuffer>(growing, arena);
+        samples = buffer;
+
+        if (buildingPeaks && done > 0 && !cancelled.load()) {
+            for (size_t c = 0; c < channels; ++c) {
+                levels.push_back(std::make_shared<LevelTrack>());
+                levels.back()->reserve(done, sampleRate, arena);
+            }
+
+            TaskGroup analysis;
+            analyseAsync(analysis, *buffer, levels, 0, done);
+            analysis.wait();
+        }
+    }
+    else if (buffer && done < frameCount) {
+        // The file was shorter than announced.
+        buffer->truncate(done);
+    }
+
+    ma_decoder_uninit(&decoder);
+    opened = false;
+
+    return reachedEnd && !cancelled.load();
+}
+
+bool StreamingDecoder::indexFrames()
+{
+    if (!compressed->isFlac() || !seekIndex.empty()) return true;
+
+    // Points well inside a page apart, so few frames are skipped after a restart.
+    if (!buildFlacSeekIndex(sourcePath, seekIndex, CompressedSampleSource::pageFrames / 4, &cancelled)) {
+        // Cancelled, or not indexable after all: pages keep seeking through the decoder.
+        return !cancelled.load();
+    }
+
+    compressed->setSeekIndex(seekIndex);
+    return true;
+}
+
+void StreamingDecoder::publishPeaks(TaskGroup& summaries, size_t count)
+{
+    summaries.wait();
+
+    for (const auto& pyramid : peaks) {
+        pyramid->publish(count);
+    }
+}
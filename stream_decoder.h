@@ -0,0 +1,164 @@
+#pragma once
+
+#include "../libraries/miniaudio.h"
+#include "peaks.h"
+#include "sample_buffer.h"
+#include "mapped_wav.h"
+#include "paged_samples.h"
+#include "compressed_source.h"
+#include "seek_index.h"
+#include "peak_builder.h"
+#include "levels.h"
+#include "kernels.h"
+#include "arena.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <iostream>
+
+// ---- Streaming Decoder ----
+// Decodes a file in fixed-size blocks on a worker thread. Each block is
+// deinterleaved (all channels in one SIMD pass) straight into the
+// preallocated SampleBuffer, then reduced into the per-channel peak pyramids
+// on the thread pool while the next block decodes, so the envelope fills in
+// while the rest of the file loads. The level tracks (RMS, true peak,
+// loudness) are built in the same pass, one task per channel per block.
+//
+// Uncompressed WAV files skip decoding: they are memory-mapped
+// (MappedWavSource), their samples are usable right after open() and the
+// worker only builds the pyramids, reading straight from the mapping.
+//
+// FLAC and MP3 files are read through a CompressedSampleSource, which decodes
+// pages around whatever is read, so they too are usable right after open().
+// The worker then decodes the file once for the pyramids only (and indexes
+// FLAC frames for the source), or does nothing if the peak cache had both.
+//
+// Other decoded files too large for memoryBudget go to a PagedSampleSource
+// instead of the SampleBuffer.
+//
+// The file's buffers (samples, pyramids, decode blocks) come from one Arena,
+// which goes back to the buffer pool with the last of them, so loading one
+// file after another reuses the same memory.
+class StreamingDecoder {
+public:
+    // Frames decoded per block.
+    static constexpr ma_uint64 blockFrames = 65536;
+
+    // The file's samples, every channel. Only safe to read once onFinished
+    // has been called, unless samplesReady().
+    std::shared_ptr<const SampleSource> samples;
+    size_t channelCount = 0;
+    // The file's own rate; decoded samples are not converted.
+    unsigned sampleRate = 0;
+    // Length reported by the decoder (0 if the format can't tell up front).
+    size_t frameCount = 0;
+    // Decoded files larger than this are paged from a temporary file rather
+    // than held in memory, and the page cache stays within it. Set before open().
+    size_t memoryBudget = size_t(512) << 20;
+    // One per channel, built while decoding when requested in open(). Can be
+    // read at any time.
+    std::vector<std::shared_ptr<PeakPyramid>> peaks;
+    // Likewise, along with the pyramids. For files of unknown length they are
+    // only built at the end, and only safe to read once onFinished is called.
+    std::vector<std::shared_ptr<LevelTrack>> levels;
+    // FLAC seek points. Set before open() when the peak cache has them,
+    // otherwise built by the worker; complete once onFinished(true) is called.
+    SeekIndex seekIndex;
+
+    StreamingDecoder() = default;
+    StreamingDecoder(const StreamingDecoder&) = delete;
+    StreamingDecoder& operator=(const StreamingDecoder&) = delete;
+
+    ~StreamingDecoder() {
+        cancel();
+
+        if (opened) {
+            ma_decoder_uninit(&decoder);
+        }
+    }
+
+    // Opens the file and allocates the channel storage (and the pyramids if
+    // buildPeaks is set). Nothing is decoded until start().
+    bool open(const std::string& path, bool buildPeaks);
+
+    // True when the samples can be played and drawn before the worker is done.
+    bool samplesReady() const {
+        return mapped || compressed;
+    }
+
+    // Starts the worker. onProgress is called from the worker every few blocks,
+    // onFinished once at the end with true when the whole file was decoded.
+    void start(std::function<void()> onProgress, std::function<void(bool)> onFinished) {
+        progressCallback = std::move(onProgress);
+        finishedCallback = std::move(onFinished);
+        worker = std::thread(&StreamingDecoder::run, this);
+    }
+
+    // Stops the worker at the next block boundary and waits for it.
+    void cancel() {
+        cancelled.store(true);
+
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    size_t framesDecoded() const {
+        return decoded.load(std::memory_order_acquire);
+    }
+
+private:
+    // Pyramids and level tracks need the final length up front, otherwise
+    // the view builds the pyramids once decoding ends (and decode() the tracks).
+    void reservePeaks(bool buildPeaks);
+
+    void run() {
+        bool completed = true;
+
+        if (mapped) {
+            completed = scanMapped();
+        }
+        else if (opened) {
+            completed = decode();
+        }
+
+        if (completed && compressed) {
+            completed = indexFrames();
+        }
+
+        if (finishedCallback) {
+            finishedCallback(completed && !cancelled.load());
+        }
+    }
+
+    // Builds the pyramids from the mapped WAV, dropping each block's pages
+    // once it is summarised so the scan doesn't leave the whole file resident.
+    bool scanMapped();
+    // Decodes the whole file; true if it got to the end.
+    bool decode();
+    // Builds the FLAC seek index if the cache didn't have it.
+    bool indexFrames();
+    // Waits for the queued reductions and publishes the first count frames.
+    void publishPeaks(TaskGroup& summaries, size_t count);
+
+    ma_decoder decoder;
+    bool opened = false;
+    // Exactly one of these backs samples.
+    std::shared_ptr<SampleBuffer> buffer;
+    std::shared_ptr<MappedWavSource> mapped;
+    std::shared_ptr<PagedSampleSource> paged;
+    std::shared_ptr<CompressedSampleSource> compressed;
+    std::string sourcePath;
+    // open() was asked for the pyramids (and levels).
+    bool buildingPeaks = false;
+    std::shared_ptr<Arena> arena = std::make_shared<Arena>();
+    std::thread worker;
+    std::atomic<bool> cancelled{false};
+    std::atomic<size_t> decoded{0};
+    std::function<void()> progressCallback;
+    std::function<void(bool)> finishedCallback;
+};
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <cstddef>
+
+// ---- Thread Pool ----
+// Fixed set of worker threads fed from one task queue. shared() is started
+// on first use with one worker per core besides the caller, and lives until
+// exit, so parallel work pays no thread start-up cost per call.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads) {
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back(&ThreadPool::workerLoop, this);
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Runs the tasks still queued, then stops the workers.
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+
+        wake.notify_all();
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    static ThreadPool& shared() {
+        static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+        return pool;
+    }
+
+    size_t size() const { return workers.size(); }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+
+        wake.notify_one();
+    }
+
+    // Runs one queued task on the calling thread. Returns false if there was none.
+    bool runOne() {
+        std::function<void()> task;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (tasks.empty()) return false;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+
+        task();
+        return true;
+    }
+
+private:
+    void workerLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        for (;;) {
+            wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+            if (tasks.empty()) return;
+
+            std::function<void()> task = std::move(tasks.front());
+            tasks.pop_front();
+
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
+
+// ---- Task Group ----
+// Tasks submitted to a pool that can be waited for together. wait() runs
+// queued tasks on the waiting thread instead of sleeping, so a group can be
+// waited for from inside another pool task.
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& pool = ThreadPool::shared()) : pool(pool) {}
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    ~TaskGroup() {
+        wait();
+    }
+
+    void run(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++pending;
+        }
+
+        pool.submit([this, task = std::move(task)]() {
+            task();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0) done.notify_all();
+        });
+    }
+
+    // Returns once every task run so far has finished.
+    void wait() {
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (pending == 0) return;
+            }
+
+            if (!pool.runOne()) {
+                // The rest are running on workers.
+                std::unique_lock<std::mutex> lock(mutex);
+                done.wait(lock, [this]() { return pending == 0; });
+                return;
+            }
+        }
+    }
+
+private:
+    ThreadPool& pool;
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t pending = 0;
+};
+
+// Runs fn(i) for every i in [0, count) on the shared pool, the calling thread
+// included, and returns once all of them are done.
+inline void parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+    if (count <= 1 || ThreadPool::shared().size() == 0) {
+        for (size_t i = 0; i < count; ++i) fn(i);
+        return;
+    }
+
+    TaskGroup group;
+
+    for (size_t i = 0; i < count; ++i) {
+        group.run([&fn, i]() { fn(i); });
+    }
+
+    group.wait();
+}
@@ -0,0 +1,303 @@
+#pragma once
+
+#include "gl_batch.h"
+#include "peaks.h"
+#include "column_worker.h"
+#include "levels.h"
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+// ---- Waveform Geometry ----
+// The waveform picture as BatchGeometry, the same whether it goes to the
+// screen (WaveformView) or into an image (batch mode, see raster.h): grey past
+// the end of the file, the loop band, one lane per channel, the lines between
+// lanes and each lane's zero line. Coordinates are pixels, as set up by
+// glOrtho(0, width, 0, height).
+struct WaveformScene {
+    int width = 0;
+    int height = 0;
+    int64_t scrollOffset = 0;
+    // Pixels per sample, and samples per pixel column (exact when the zoom is
+    // quantized).
+    double zoomLevel = 1.0;
+    double samplesPerColumn = 1.0;
+    int64_t totalSamples = 0;
+    // The loop band, drawn when loopEnd > loopStart.
+    int64_t loopStart = 0;
+    int64_t loopEnd = 0;
+    // One lane per pyramid.
+    const std::vector<std::shared_ptr<const PeakPyramid>>* peaks = nullptr;
+    // The exact columns or samples of this view (see ColumnWorker); null draws
+    // the pyramid preview.
+    const ColumnData* columns = nullptr;
+    // Leaves the envelopes out, for EnvelopeShader to draw.
+    bool skipEnvelopes = false;
+    // One track per lane, for appendLevelOverlays(); may be null or empty.
+    const LevelTracks* levels = nullptr;
+
+    // The envelope columns of the view, as ColumnWorker lays them out.
+    ColumnView columnView() const {
+        ColumnView view;
+        view.scrollOffset = scrollOffset;
+        view.samplesPerColumn = samplesPerColumn;
+        view.width = width;
+        return view;
+    }
+
+    int laneTop(size_t lane) const {
+        size_t lanes = peaks ? std::max<size_t>(peaks->size(), 1) : 1;
+        return static_cast<int>(lane * height / lanes);
+    }
+};
+
+// Appends the vertices of one channel's waveform (blue) and nodes (red),
+// from scene.columns or, while they are being prepared, from the pyramid.
+inline void appendWaveformChannel(BatchGeometry& geometry, const WaveformScene& scene, size_t channel,
+                                  const PeakPyramid& peaks, int yOffset, int heightPx) {
+    double samplesPerPixel = scene.samplesPerColumn;
+    const ColumnData* exact = scene.columns;
+    const std::vector<Peak>* columnPeaks = exact && channel < exact->peaks.size() ? &exact->peaks[channel] : nullptr;
+    const std::vector<float>* visible = exact && channel < exact->samples.size() ? &exact->samples[channel] : nullptr;
+
+    // Decide rendering mode based on zoom level. Zoomed in, the preview is
+    // the level-0 envelope.
+    if (samplesPerPixel > 5.0 || !visible || visible->empty()) {
+        // ZOOMED OUT: Envelope (min/max per pixel column)
+        // Columns are fixed to the file (see ColumnWorker), so the view
+        // scrolls over them by a fraction of a column.
+        ColumnView view = scene.columnView();
+        size_t count = view.columnCount();
+        double shift = scene.scrollOffset / view.samplesPerColumn - view.firstColumn();
+
+        geometry.begin(GL_LINES, 0.0f, 0.0f, 1.0f);
+        geometry.reserve(geometry.vertices.size() / 2 + count * 2);
+
+        for (size_t i = 0; i < count; ++i) {
+            float x = static_cast<float>(i - shift);
+            Peak peak;
+
+            if (columnPeaks) {
+                peak = (*columnPeaks)[i];
+            }
+            else {
+                int64_t startSample, endSample;
+                columnSamples(view.firstColumn() + static_cast<int64_t>(i), view.samplesPerColumn, scene.totalSamples, startSample, endSample);
+                peak = peaks.read(startSample, endSample);
+            }
+
+            float minY = peak.min, maxY = peak.max;
+
+            // Noise threshold
+            bool isSilent = peak.absMax <= 0.005f;
+
+            if (isSilent) {
+                // Flat silent section → draw a thin horizontal line
+                float yFlatPx = yOffset + (1.0f - 0.0f) * (heightPx / 2.0f);  // Amplitude 0
+
+                geometry.vertex(x, yFlatPx);
+                // 1-pixel wide horizontal line.
+                geometry.vertex(x + 1, yFlatPx);
+                // Skip the rest of loop.
+                continue;
+            }
+
+            // Avoid disappearing lines: pad very flat sections
+            // Note: Near-flat, but not completely silent → pad it
+            if (std::abs(maxY - minY) < 0.01f) {
+                minY -= 0.005f; maxY += 0.005f;
+            }
+
+            float yMinPx = yOffset + (1.0f - std::clamp(minY, -1.0f, 1.0f)) * (heightPx / 2.0f);
+            float yMaxPx = yOffset + (1.0f - std::clamp(maxY, -1.0f, 1.0f)) * (heightPx / 2.0f);
+
+            geometry.vertex(x, yMinPx);
+            geometry.vertex(x, yMaxPx);
+        }
+    }
+    else {
+        // ZOOMED IN: One sample per vertex, smooth line.
+
+        geometry.begin(GL_LINE_STRIP, 0.0f, 0.0f, 1.0f);
+        GLint lineFirst = geometry.vertexCount();
+
+        // Visible samples, indexed from scrollOffset.
+        for (size_t i = 0; i < visible->size(); ++i) {
+            float x = static_cast<float>(i * scene.zoomLevel);
+            float y = yOffset + (1.0f - std::clamp((*visible)[i], -1.0f, 1.0f)) * (heightPx / 2.0f);
+            geometry.vertex(x, y);
+        }
+
+        // --- Draw nodes if zoomed in enough ---
+        if (samplesPerPixel <= 0.1) {
+            // Red nodes of 4 px, sharing the line's vertices.
+            DrawBatch nodes = geometry.batches.back();
+            nodes.mode = GL_POINTS;
+            nodes.r = 1.0f; nodes.g = 0.0f; nodes.b = 0.0f;
+            nodes.size = 4.0f;
+            nodes.first = lineFirst;
+            geometry.batches.push_back(nodes);
+        }
+    }
+}
+
+// Fills geometry with the background, waveforms and guide lines, in drawing order.
+inline void buildWaveformGeometry(BatchGeometry& geometry, const WaveformScene& scene) {
+    geometry.clear();
+
+    float width = static_cast<float>(scene.width);
+    float height = static_cast<float>(scene.height);
+
+    // If waveform doesn't fill the full width, paint the rest in grey
+    // (samples that fit inside the width: ceil(width / zoomLevel)).
+    int64_t visibleSamples = scene.zoomLevel > 0.0
+        ? std::clamp<int64_t>(static_cast<int64_t>(std::ceil(scene.width / scene.zoomLevel)), 1, std::max<int64_t>(scene.totalSamples, 1))
+        : scene.totalSamples;
+    int64_t endSample = scene.scrollOffset + visibleSamples;
+    // compute last drawn x position
+    float lastX = static_cast<float>((std::min(endSample, scene.totalSamples) - scene.scrollOffset) * scene.zoomLevel);
+
+    if (lastX < width) {
+        // grey background
+        geometry.begin(GL_QUADS, 0.3f, 0.3f, 0.3f);
+        // top-right
+        geometry.vertex(width, height);
+        // top-left
+        geometry.vertex(lastX, height);
+        // bottom-left
+        geometry.vertex(lastX, 0.0f);
+        // bottom-right
+        geometry.vertex(width, 0.0f);
+    }
+
+    // --- Draw the A/B loop region behind the waveforms ---
+
+    if (scene.loopEnd > scene.loopStart) {
+        float startX = std::max(static_cast<float>((scene.loopStart - scene.scrollOffset) * scene.zoomLevel), 0.0f);
+        float endX = std::min(static_cast<float>((scene.loopEnd - scene.scrollOffset) * scene.zoomLevel), width);
+
+        if (endX > startX) {
+            // Light steel blue
+            geometry.begin(GL_QUADS, 0.8f, 0.87f, 0.96f);
+            geometry.vertex(endX, height);
+            geometry.vertex(startX, height);
+            geometry.vertex(startX, 0.0f);
+            geometry.vertex(endX, 0.0f);
+        }
+    }
+
+    // One lane per channel, stacked top to bottom.
+    size_t lanes = scene.peaks ? scene.peaks->size() : 0;
+
+    for (size_t c = 0; c < lanes && !scene.skipEnvelopes; ++c) {
+        appendWaveformChannel(geometry, scene, c, *(*scene.peaks)[c], scene.laneTop(c), scene.laneTop(c + 1) - scene.laneTop(c));
+    }
+
+    // --- Draw separation lines between waveforms ---
+
+    if (lanes > 1) {
+        // Dim gray
+        geometry.begin(GL_LINES, 0.412f, 0.412f, 0.412f);
+
+        for (size_t c = 1; c < lanes; ++c) {
+            geometry.vertex(0, scene.laneTop(c));
+            geometry.vertex(width, scene.laneTop(c));
+        }
+    }
+
+    // --- Draw zero lines (middle line) for every channel. ---
+
+    // Gainsboro
+    geometry.begin(GL_LINES, 0.863f, 0.863f, 0.863f);
+
+    for (size_t c = 0; c < std::max<size_t>(lanes, 1); ++c) {
+        float middle = (scene.laneTop(c) + scene.laneTop(c + 1)) / 2.0f;
+        geometry.vertex(0.0f, middle);
+        geometry.vertex(width, middle);
+    }
+}
+
+// Appends the level overlays, drawn over the waveforms (and after the GPU
+// envelope): each lane's RMS as a band around its zero line, red ticks on
+// the lane's edges where the true peak goes over 0 dBTP, and the short-term
+// loudness of the whole file as one line across the view, from -60 LUFS at
+// the bottom to 0 at the top.
+inline void appendLevelOverlays(BatchGeometry& geometry, const WaveformScene& scene) {
+    if (!scene.levels || scene.levels->empty() || (*scene.levels)[0]->empty()) return;
+
+    const LevelTracks& tracks = *scene.levels;
+    ColumnView view = scene.columnView();
+    size_t count = view.columnCount();
+    double shift = scene.scrollOffset / view.samplesPerColumn - view.firstColumn();
+    size_t lanes = scene.peaks ? std::min(scene.peaks->size(), tracks.size()) : 0;
+
+    // Zoomed in, a column narrower than a sample reads the one it starts in.
+    auto columnRange = [&](size_t i, int64_t& start, int64_t& end) {
+        columnSamples(view.firstColumn() + static_cast<int64_t>(i), view.samplesPerColumn, scene.totalSamples, start, end);
+        end = std::max(end, std::min(start + 1, scene.totalSamples));
+    };
+
+    for (size_t c = 0; c < lanes; ++c) {
+        const LevelTrack& track = *tracks[c];
+        float top = static_cast<float>(scene.laneTop(c));
+        float half = (scene.laneTop(c + 1) - scene.laneTop(c)) / 2.0f;
+
+        // Cornflower blue
+        geometry.begin(GL_LINES, 0.39f, 0.58f, 0.93f);
+
+        for (size_t i = 0; i < count; ++i) {
+            int64_t start, end;
+            columnRange(i, start, end);
+            float rms = std::min(track.read(static_cast<size_t>(start), static_cast<size_t>(end)).rms, 1.0f);
+
+            if (rms <= 0.0f) continue;
+
+            float x = static_cast<float>(i - shift);
+            geometry.vertex(x, top + (1.0f - rms) * half);
+            geometry.vertex(x, top + (1.0f + rms) * half);
+        }
+
+        geometry.begin(GL_LINES, 1.0f, 0.0f, 0.0f);
+
+        for (size_t i = 0; i < count; ++i) {
+            int64_t start, end;
+            columnRange(i, start, end);
+
+            if (track.read(static_cast<size_t>(start), static_cast<size_t>(end)).truePeak <= 1.0f) continue;
+
+            float x = static_cast<float>(i - shift);
+            geometry.vertex(x, top);
+            geometry.vertex(x, top + 4.0f);
+            geometry.vertex(x, top + 2.0f * half - 4.0f);
+            geometry.vertex(x, top + 2.0f * half);
+        }
+    }
+
+    // Dark orange, a segment between each pair of columns with a level.
+    geometry.begin(GL_LINES, 1.0f, 0.55f, 0.0f);
+    const float quietest = -60.0f;
+    float height = static_cast<float>(scene.height);
+    bool previous = false;
+    float previousX = 0.0f, previousY = 0.0f;
+
+    for (size_t i = 0; i < count; ++i) {
+        int64_t start, end;
+        columnRange(i, start, end);
+        float level = end > start ? loudnessAt(tracks, static_cast<size_t>(end - 1), 3.0) : quietest;
+        bool audible = level > quietest;
+        float x = static_cast<float>(i - shift);
+        float y = (std::min(level, 0.0f) - quietest) / -quietest * height;
+
+        if (audible && previous) {
+            geometry.vertex(previousX, previousY);
+            geometry.vertex(x, y);
+        }
+
+        previous = audible;
+        previousX = x;
+        previousY = y;
+    }
+}